@@ -40,6 +40,19 @@ void Socket::set_reuseaddr()
   assert(setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int)) == 0);
 }
 
+/**
+ * @brief 设置套接字端口复用(SO_REUSEPORT)，多个reactor各自持有一个监听套接字，由内核分发连接.
+ * 
+ */
+void Socket::set_reuseport()
+{
+  int reuse = 1;
+  if(setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(int)) != 0)
+  {
+    WARN("set SO_REUSEPORT error！\n");
+  }
+}
+
 /**
  * @brief 设置服务器地址并绑定地址端口.
  * 
@@ -30,6 +30,8 @@ public:
 
   void set_reuseaddr();
 
+  void set_reuseport();
+
   void bind();
 
   void listen();
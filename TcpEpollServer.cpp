@@ -18,75 +18,53 @@
 #include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
-#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 //#define LOGGER_DEBUG
 #define LOGGER_WARN
 #include <logger.h>
 
 #include "Socket.h"
+#include <http_response.h>
 
 namespace http_server
 {
 
-static const int MAX_MMAP_LENGTH = 10000;
+// 客户端连接的注册事件：边缘触发 + 一次性触发，由处理完该连接的工作线程用 EPOLL_CTL_MOD 重新激活.
+static const int CLIENT_EVENTS = static_cast<int>(EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT);
+// 响应未发完时等待套接字可写。不关注 EPOLLRDHUP：半关闭（shutdown(SHUT_WR)）的客户端仍在读取响应，
+// 发完后读到 EOF 再关闭；对端完全关闭时发送会出错，由 EPOLLERR/EPOLLHUP 通知
+static const int CLIENT_WRITE_EVENTS = static_cast<int>(EPOLLOUT | EPOLLET | EPOLLONESHOT);
 
 
-TcpEpollServer::TcpEpollServer(ThreadPool *pool, parameters::Parameters *parameters)
+TcpEpollServer::TcpEpollServer(ThreadPool *pool, parameters::Parameters *parameters, cache::ContentCache *content_cache,
+                               cache::OpenFileCache *open_files, cache::NegativeCache *negative_cache,
+                               ConnectionTable *connections)
   : TcpServer(pool, parameters->getListenPort()),
-    http_parameters_(parameters)
+    http_parameters_(parameters),
+    content_cache_(content_cache),
+    open_files_(open_files),
+    negative_cache_(negative_cache),
+    connections_(connections)
 {
   document_root_ = parameters->getDocumentRoot();
   default_file_ = parameters->getDefaultFile();
-  file_mmap();
+  keep_alive_timeout_ = parameters->getKeepAliveTimeout();
+  keep_alive_requests_ = parameters->getKeepAliveRequests();
+  header_timeout_ = parameters->getHeaderTimeout();
+  body_timeout_ = parameters->getBodyTimeout();
+  send_timeout_ = parameters->getSendTimeout();
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
  // efd_ = eventfd(0, 0);
 }
 
 int TcpEpollServer::efd_ = eventfd(0, 0);  //事件文件描述符（event fd)。初始化其内部计数器count为0。flags 设置为 0，
                                            //用于sigint退出handle_request循环。用户空间的应用程序可以用这个 eventfd 来实现事件的等待或通知机制，也可以用于内核通知新的事件到用户空间应用程序。
 
-/**
- * @brief Map the file to memory.文件映射到内存中。
- * 
- */
-void TcpEpollServer::file_mmap()
-{
-  std::vector<std::string> file_lists = http_parameters_->getHttpFileLists();// 值为"doc/index.html"
-  
-  file_fd_lists_.resize(file_lists.size());
-
-  for(int i = 0; i < file_lists.size(); ++i)
-  {
-    file_fd_lists_[i] = open(file_lists[i].c_str(), O_RDONLY);//打开file_lists[i].c_str()指定的文件名，为只读模式。返回一个文件描述符，出错时返回-1
-    if(file_fd_lists_[i] == -1)
-    {
-      WARN("open file %s failed!\n", file_lists[i].c_str());
-      continue;
-    }
-    char* file_ptr = (char *)mmap(NULL, MAX_MMAP_LENGTH, PROT_READ, MAP_SHARED, file_fd_lists_[i], 0);//将一个文件或者其它对象映射进内存，成功时返回被映射区的指针
-    if((char*)-1 == file_ptr)
-    {
-      WARN("mmap failure\n");
-    }
-    else
-    {
-      http_file_[file_lists[i]] = file_ptr;
-    }
-  }
-}
-
 TcpEpollServer::~TcpEpollServer()
 {
-  for(int i = 0; i < file_fd_lists_.size(); ++i)
-  {
-    if(file_fd_lists_[i] != -1)
-      close(file_fd_lists_[i]);
-  }
-
-  for(auto iter = http_file_.begin(); iter != http_file_.end(); ++iter)
-  {
-    munmap(iter->second, MAX_MMAP_LENGTH);//解除一个映射关系，iter->second为调用时返回的地址
-  }
+  close(wake_fd_);
 }
 
 
@@ -133,20 +111,207 @@ void TcpEpollServer::del_event(int fd, int event_type)
 }
 
 /**
- * @brief 关闭客户端的 fd 并从客户端定时器队列中删除其计时器timer 
+ * @brief 修改epoll fd中已注册fd的事件，用于重新激活 EPOLLONESHOT 的fd
+ * 
+ * @param fd 
+ * @param event_type 
+ */
+void TcpEpollServer::mod_event(int fd, int event_type)
+{
+  epoll_event e;
+  e.data.fd = fd;
+  e.events = event_type;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &e);//宏EPOLL_CTL_MOD：修改已经注册的fd的监听事件；
+}
+
+/**
+ * @brief 工作线程处理完客户端后重新激活其 EPOLLONESHOT 事件，使reactor可以再次分发该连接。
+ *        按连接所处的阶段选择超时时间：请求头、请求体、空闲长连接或等待可写。
+ * 
+ * @param conn 
+ * @param state CONN_READ 等待可读，CONN_WRITE 等待可写，CONN_PAUSE 等待接收缓冲区（不激活事件，交给reactor）
+ */
+void TcpEpollServer::rearm_client(http::HttpConnection *conn, ConnState state)
+{
+  int64_t now = timer_tick::now_ms();
+  int64_t deadline;
+  if(conn->linger_deadline != 0)  // 错误响应后丢弃客户端的数据，期限固定
+    deadline = conn->linger_deadline;
+  else if(state == CONN_WRITE)  // 等待套接字可写
+    deadline = now + send_timeout_;
+  else if(conn->body_remaining > 0)  // 正在读请求体
+    deadline = now + body_timeout_;
+  else if(conn->input_pending() || conn->requests == 0)  // 请求头不完整，或者新连接还没有发送请求
+  {
+    if(conn->header_deadline == 0)
+      conn->header_deadline = now + header_timeout_;
+    deadline = conn->header_deadline;  // 从请求开始计算，逐字节发送请求头的慢速客户端不能延长期限
+  }
+  else  // 空闲的长连接
+    deadline = now + keep_alive_timeout_;
+
+  conn->release_idle_buffers();  // 等待下一个请求期间只占用连接记录
+  conn->timer.set_overtime(deadline);
+  uint64_t tag = conn->advance(http::HttpConnection::STAGE_IDLE);  // 交还给reactor；之后到期的定时器才能关闭连接
+  conn->timer.set_tag(tag);
+  if(client_timers_queue_.add_timer(&conn->timer))
+    wake_up();  // 新的期限早于 reactor 计划醒来的时刻
+  if(state == CONN_PAUSE)
+    pause_client(conn->fd, tag);
+  else
+    mod_event(conn->fd, state == CONN_WRITE ? CLIENT_WRITE_EVENTS : CLIENT_EVENTS);
+}
+
+/**
+ * @brief 连接暂停读取，交给reactor等待接收缓冲区。暂停期间超时照常计算
+ * 
+ * @param fd 
+ * @param tag 暂停时连接的代数
+ */
+void TcpEpollServer::pause_client(int fd, uint64_t tag)
+{
+  PausedClient client = { fd, tag };
+  bool first;
+  {
+    my_mutex::MutexLockGuard lock(paused_mutex_);
+    first = paused_.empty();
+    paused_.push_back(client);
+  }
+  if(first)
+    wake_up();  // reactor 可能正按较长的超时时间等待，改为定期检查接收缓冲区池
+}
+
+/**
+ * @brief 在reactor中按池中空闲的缓冲区个数依次重新激活暂停读取的连接，先暂停的先恢复。
+ *        代数变化说明连接在暂停期间已经超时关闭（fd 可能已被新连接复用），跳过
+ * 
+ * @return 还有暂停的连接返回true
+ */
+bool TcpEpollServer::resume_paused_clients()
+{
+  std::vector<PausedClient> resumed;
+  {
+    my_mutex::MutexLockGuard lock(paused_mutex_);
+    if(paused_.empty())
+      return false;
+    size_t n = std::min(paused_.size(), my_recv_pool::RecvBufferPool::instance().available());
+    resumed.assign(paused_.begin(), paused_.begin() + n);
+    paused_.erase(paused_.begin(), paused_.begin() + n);
+  }
+  for(size_t i = 0; i < resumed.size(); ++i)
+  {
+    http::HttpConnection *conn = connections_->get(resumed[i].fd);
+    if(conn->owner.load(std::memory_order_acquire) == resumed[i].tag)  // 只有本reactor会改变空闲连接的状态
+      mod_event(resumed[i].fd, CLIENT_EVENTS);  // 已到达的数据使事件立即触发
+  }
+  my_mutex::MutexLockGuard lock(paused_mutex_);
+  return !paused_.empty();
+}
+
+/**
+ * @brief 唤醒阻塞在 epoll_wait 中的 reactor，让它重新计算超时时间
+ * 
+ */
+void TcpEpollServer::wake_up()
+{
+  uint64_t u = 1;
+  if(write(wake_fd_, &u, sizeof(uint64_t)) != sizeof(uint64_t) && errno != EAGAIN)
+    WARN("wake eventfd write error");
+}
+
+/**
+ * @brief 关闭客户端的 fd 并从客户端定时器队列中删除其计时器timer。
+ *        连接对象留给同一个fd的下一个连接复用，不释放：排队中的工作和已经到期的定时器可能还持有它的指针，
+ *        它们通过代数发现连接已经关闭
  * 
  * @param fd 
  */
 void TcpEpollServer::close_client(int fd)
 {
-  client_timers_queue_.del_timer(client_fd_array_[fd]);
-  delete client_fd_array_[fd];
-  client_fd_array_[fd] = nullptr;
+  http::HttpConnection *conn = connections_->get(fd);
+  client_timers_queue_.del_timer(&conn->timer);
+  conn->release_buffers();
+  conn->advance(http::HttpConnection::STAGE_CLOSED);  // 先标记关闭再 close()，之后fd才可能被新连接复用
   close(fd);
 }
 
+/**
+ * @brief 线程池过载时在reactor中拒绝客户端的新请求：应答预先生成的503（带 Retry-After）后和其他错误响应一样
+ *        关闭写方向、丢弃客户端的数据再关闭（见 linger_client()），直接关闭时接收缓冲区里未读的请求会使内核发送RST，
+ *        客户端可能收不到503。响应发送到一半的连接（线程池队列已满）不能再插入503，直接关闭
+ * 
+ * @param fd 
+ */
+void TcpEpollServer::reject_client(int fd)
+{
+  http::HttpConnection *conn = connections_->get(fd);
+  if(conn->output_pending() || conn->linger_deadline != 0)
+  {
+    close_client(fd);
+    return;
+  }
+  client_timers_queue_.del_timer(&conn->timer);  // 连接留在reactor中，由 rearm_client() 重新设置期限
+  conn->acquire_buffers();
+  send_error(conn, 503, false);
+  conn->close_after_output = true;
+  ConnState state = process_requests(conn);  // 发送503，套接字缓冲区满时等待可写
+  if(state == CONN_CLOSE)
+    linger_client(conn);
+  else
+    rearm_client(conn, state);
+}
+
+/**
+ * @brief 错误响应（400、414、431等）发完后关闭连接。客户端可能还在发送请求（例如超长的请求头只读入了一部分），
+ *        接收缓冲区里有未读数据时 close() 会使内核发送RST，客户端可能收不到已经发出的响应。
+ *        先关闭写方向（响应之后发送FIN），再读走并丢弃客户端的数据，直到对端关闭或 LINGER_TIMEOUT 到期
+ * 
+ * @param conn 
+ */
+void TcpEpollServer::linger_client(http::HttpConnection *conn)
+{
+  int64_t now = timer_tick::now_ms();
+  if(conn->linger_deadline == 0)
+  {
+    shutdown(conn->fd, SHUT_WR);
+    conn->release_buffers();  // 之后读到的数据直接丢弃，不再需要缓冲区
+    conn->linger_deadline = now + LINGER_TIMEOUT;
+  }
+  char discard[BUFSIZ];
+  while(now < conn->linger_deadline)
+  {
+    ssize_t n = recv(conn->fd, discard, sizeof(discard), 0);
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      rearm_client(conn, CONN_READ);
+      return;
+    }
+    if(n <= 0)  // 客户端关闭或出错
+      break;
+    now = timer_tick::now_ms();
+  }
+  close_client(conn->fd);
+}
+
+/**
+ * @brief 工作线程执行的任务。连接仍处于提交时的排队状态才处理；排队期间超时已经关闭了连接则直接返回
+ * 
+ * @param client_fd 
+ * @param queued 提交时连接的代数
+ */
+void TcpEpollServer::serve_client(int client_fd, uint64_t queued)
+{
+  http::HttpConnection *conn = connections_->get(client_fd);
+  if(!conn->transfer(queued, http::HttpConnection::STAGE_RUNNING))
+    return;
+  client_timers_queue_.del_timer(&conn->timer);  // 处理期间不计超时，重新激活时再加入定时器队列
+  client_service(client_fd);
+}
+
 /**
  * @brief 从客户端fd中读取数据。从客户端获取服务请求并应答。
+ *        每次可读事件用一次大块 recv 读入连接的读缓冲区，再解析并应答其中所有完整的请求。
+ *        若上次的响应没有发完（可写事件），先继续发送。读缓冲区在 recv 前才从接收缓冲区池取
  * 
  * @param client_fd 
  */
@@ -154,81 +319,229 @@ void TcpEpollServer::client_service(int client_fd)
 {
   DEBUG("handling client request... client fd: %d\n", client_fd);
 
-  char rcv_buffer[BUFSIZ];
-  char method[METHOD_LEN];
-  char url[URL_LEN];
-  char version[VERSION_LEN];
-
-  char if_close;  
-  int ret = recv(client_fd, &if_close, 1, MSG_PEEK); //如果客户端以正常方式关闭连接，返回值为0。MSG_PEEK用于查看可读数据，在函数执行后内核不会丢弃这些数据。
-  if(ret == 0)
+  http::HttpConnection *conn = connections_->get(client_fd);
+  conn->lane = LANE_FAST;
+  if(conn->linger_deadline != 0)  // 已经发出错误响应，继续丢弃客户端的数据
   {
-    close_client(client_fd);
-    DEBUG("client close itself\n");
+    linger_client(conn);
     return;
   }
+  ConnState state = CONN_READ;
+  if(conn->output_pending())  // 可写事件：先发送队列中的数据，再继续应答已经读入缓冲区的流水线请求
+    state = process_requests(conn);
+  run_client(conn, state);
+}
+
+/**
+ * @brief 在较慢的通道中继续处理转交过来的请求，应答后接着处理连接上后续的请求
+ * 
+ * @param client_fd 
+ */
+void TcpEpollServer::resume_client(int client_fd)
+{
+  http::HttpConnection *conn = connections_->get(client_fd);
+  ConnState state = doGetMethod(conn, conn->buffers->parser.request(), conn->defer_keep_alive);
+  if(state == CONN_DEFER)  // 又转交给了更慢的通道
+    return;
+  finish_request(conn);
+  if(state == CONN_CLOSE)
+    conn->close_after_output = true;
+  run_client(conn, process_requests(conn));
+}
+
+/**
+ * @brief 读取并应答请求，直到需要等待事件、连接关闭或请求转交给其他通道
+ * 
+ * @param conn 
+ * @param state 
+ */
+void TcpEpollServer::run_client(http::HttpConnection *conn, ConnState state)
+{
+  int client_fd = conn->fd;
+  while(state == CONN_READ)
+  {
+    if(!conn->acquire_read_buffer())  // 接收缓冲区池已用完，数据留在套接字中
+    {
+      state = CONN_PAUSE;
+      break;
+    }
+    http::ConnectionBuffers *buffers = conn->buffers;
+    size_t space = buffers->read_space();
+    ssize_t n = recv(client_fd, buffers->read_buffer + buffers->read_end, space, 0);
+    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))  //如果客户端以正常方式关闭连接（或关闭了写方向），返回值为0。此时之前的响应都已发完
+    {
+      DEBUG("client close itself\n");
+      state = CONN_CLOSE;
+      break;
+    }
+    if(n > 0)
+      buffers->read_end += n;
+
+    state = process_requests(conn);
+
+    if(n < 0 || static_cast<size_t>(n) < space)  // 没有填满读缓冲区，说明套接字接收缓冲区已读空
+      break;
+  }
 
-  int n;
-  n = get_line(client_fd, rcv_buffer, BUFSIZ);
-  DEBUG("%s\n", rcv_buffer);  //GET /index.html HTTP/1.0
+  if(state == CONN_DEFER)  // 连接已经交给其他通道的工作，不能再访问
+    return;
+  if(state == CONN_CLOSE && conn->linger)
+    linger_client(conn);
+  else if(state == CONN_CLOSE)
+    close_client(client_fd);
+  else
+    rearm_client(conn, state);
+}
 
-  int i = 0, j = 0;
-  while (rcv_buffer[j] != ' ' && i <= METHOD_LEN - 1 && j <= n) //get the method
+/**
+ * @brief 应答读缓冲区中的请求并发送发送队列中的响应。队列积累到上限时先发送，发完再继续应答后面的流水线请求；
+ *        套接字缓冲区满时等待可写，剩下的数据和请求都留在连接中
+ * 
+ * @param conn 
+ * @return 连接的下一步：继续读、等待可写、关闭或已经转交给其他通道
+ */
+TcpEpollServer::ConnState TcpEpollServer::process_requests(http::HttpConnection *conn)
+{
+  while(true)
   {
-    method[i] = rcv_buffer[j];
-    ++i;
-    ++j;
+    ConnState state = conn->close_after_output ? CONN_CLOSE : queue_responses(conn);
+    if(state == CONN_DEFER)  // 解析结果和缓冲区留给接手的工作
+      return state;
+    if(state == CONN_CLOSE)
+      conn->close_after_output = true;
+
+    http::OutputQueue::FlushResult r = conn->buffers->output.flush(conn->fd);
+    if(r == http::OutputQueue::FLUSH_ERROR)
+      return CONN_CLOSE;
+    if(r == http::OutputQueue::FLUSH_AGAIN)
+      return CONN_WRITE;
+    conn->buffers->arena.reset();  // 响应都已发出，请求之间 arena 中没有需要保留的数据
+    if(conn->close_after_output)
+      return CONN_CLOSE;
+    if(state == CONN_READ)
+      return state;
   }
-  method[i] = '\0';
-  DEBUG("method: %s\n", method);
+}
 
-  i = 0;
-	while( rcv_buffer[j] ==' ' && j <= n)
-		j++;
-	while( rcv_buffer[j] != ' ' && j <= n && i < URL_LEN-1)//get the URL
-	{
-		url[i] = rcv_buffer[j];
-		i++;
-		j++;
-	}
-	url[i] = '\0';
-	DEBUG("url: %s\n", url);
+/**
+ * @brief 解析读缓冲区中完整的请求，按顺序把响应加入发送队列（不发送）
+ * 
+ * @param conn 
+ * @return 需要更多数据返回CONN_READ；队列已满返回CONN_WRITE；最后一个响应后关闭返回CONN_CLOSE；转交返回CONN_DEFER
+ */
+TcpEpollServer::ConnState TcpEpollServer::queue_responses(http::HttpConnection *conn)
+{
+  http::ConnectionBuffers *buffers = conn->buffers;
+  while(true)
+  {
+    if(buffers->output.full())
+      return CONN_WRITE;
 
-  i = 0;
-	while(rcv_buffer[j] == ' ' && j <= n)
-		j++;
-	while(rcv_buffer[j] != '\n' && i < VERSION_LEN-1)
-	{
-		version[i] = rcv_buffer[j];
-		i++;
-		j++;
-	}
-	version[i] = '\0';
-	DEBUG("version: %s\n", version);
+    if(conn->body_remaining > 0)  // 丢弃上一个请求未读取的请求体
+    {
+      size_t skip = std::min(conn->body_remaining, buffers->read_end - buffers->read_start);
+      buffers->read_start += skip;
+      conn->body_remaining -= skip;
+      if(conn->body_remaining > 0)
+      {
+        buffers->read_start = buffers->read_end = 0;
+        return CONN_READ;
+      }
+    }
 
-  if(strcasecmp(method, "GET") && strcasecmp(method, "POST"))//strcasecmp判断字符串是否相等(忽略大小写)
-	{
-		//can not under stand the request
-		unimplemented(client_fd);
-		close_client(client_fd);
-		return;
-	}
+    if(buffers->read_buffer == nullptr)  // 读缓冲区已经还给池，没有未处理的数据
+      return CONN_READ;
+    http::HttpParser::ParseResult r =
+      buffers->parser.parse(buffers->read_buffer + buffers->read_start, buffers->read_end - buffers->read_start);
+    if(r == http::HttpParser::PARSE_AGAIN)
+    {
+      buffers->compact();  // 把不完整的请求移到缓冲区开头，解析器记录的是相对偏移，可以直接继续
+      return CONN_READ;
+    }
+    if(r == http::HttpParser::PARSE_ERROR)
+    {
+      DEBUG("bad request: %d\n", buffers->parser.error_code());
+      return send_error(conn, buffers->parser.error_code(), false);
+    }
+
+    ConnState state = serve_request(conn, buffers->parser.request());
+    if(state == CONN_DEFER)
+      return state;
+    finish_request(conn);
+    if(state != CONN_READ)
+      return state;
+  }
+}
+
+/**
+ * @brief 应答完一个请求后从读缓冲区中移除它，准备解析下一个请求
+ * 
+ * @param conn 
+ */
+void TcpEpollServer::finish_request(http::HttpConnection *conn)
+{
+  http::ConnectionBuffers *buffers = conn->buffers;
+  buffers->read_start += buffers->parser.consumed();
+  conn->header_deadline = 0;
+  conn->body_remaining = buffers->parser.request().content_length;
+  buffers->parser.reset();
+  if(buffers->read_start == buffers->read_end)
+    buffers->read_start = buffers->read_end = 0;
+}
 
-  if(strcasecmp(method, "GET") == 0)
+/**
+ * @brief 把当前请求转交给线程池中较慢的通道，本工作线程不再处理该连接。
+ *        冷文件读取、CGI 阻塞的是受限通道的线程，快速通道的请求不受影响
+ * 
+ * @param conn 
+ * @param lane 目标通道
+ * @param keep_alive 是否保持连接
+ * @return 转交成功返回CONN_DEFER；通道已满时应答503并返回CONN_CLOSE
+ */
+TcpEpollServer::ConnState TcpEpollServer::defer_request(http::HttpConnection *conn, work_lane lane, bool keep_alive)
+{
+  conn->lane = lane;
+  conn->defer_keep_alive = keep_alive;
+  conn->buffers->output.flush(conn->fd);  // 先发出前面流水线请求的响应，不让它们等慢请求；没发完的由接手的工作继续发送
+  if(add_task_to_pool(std::bind(&TcpEpollServer::resume_client, this, conn->fd), lane) == FAILED)
+    return send_error(conn, 503, false);
+  return CONN_DEFER;  // 接手的工作可能已经开始执行，之后不能再访问连接
+}
+
+/**
+ * @brief 应答一个请求
+ * 
+ * @param conn 
+ * @param request 
+ * @return 响应加入发送队列后连接的下一步：继续应答、发完后关闭或已经转交给其他通道
+ */
+TcpEpollServer::ConnState TcpEpollServer::serve_request(http::HttpConnection *conn, const http::HttpRequest &request)
+{
+  DEBUG("method: %.*s url: %.*s version: %.*s\n", (int)request.method.len, request.method.data,
+        (int)request.target.len, request.target.data, (int)request.version.len, request.version.data);
+
+  bool keep_alive = request.keep_alive && !request.chunked;  // 不支持分块编码的请求体，应答后关闭连接
+  if(++conn->requests >= keep_alive_requests_)  // 达到单个连接最大请求数后关闭
+    keep_alive = false;
+
+  if(request.method.equals("GET"))
 	{
 		//call GET method function
-		doGetMethod(client_fd, url, version);
+		return doGetMethod(conn, request, keep_alive);
 	}
-	else if(strcasecmp(method, "POST") == 0)
+  if(!request.method.equals("POST"))
 	{
-		//call POST function
-    close_client(client_fd);
+		//can not under stand the request
+		return send_error(conn, 501, false);
 	}
+	//POST method is not supported yet
 
+  return CONN_CLOSE;
 }
 
 /**
- * @brief 采用epoll方法处理请求循环 
+ * @brief 采用epoll方法处理请求循环。多reactor模式下每个reactor线程各自运行一个该循环，
+ *        只处理自己监听套接字上接受的连接。
  * 
  */
 void TcpEpollServer::handle_request()
@@ -248,35 +561,32 @@ void TcpEpollServer::handle_request()
   epoll_fd_ = epoll_create(255);//生成一个epoll专用的文件描述符,用来存放所关注的fd，监听最大数目为255
   assert(epoll_fd_ != -1);
 
-  int time_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);  //创建计时器timefd,类型为系统范围内的时钟,用来周期检查定时器队列
-  assert(time_fd != -1);
-  struct itimerspec new_value;
-  struct timespec now;
-  uint64_t exp;
-  ssize_t s;
-  assert(clock_gettime(CLOCK_REALTIME, &now) != -1);
-  new_value.it_value.tv_sec = 2;//it_value表示定时器第一次超时时间
-  new_value.it_value.tv_nsec = now.tv_nsec;
-  new_value.it_interval.tv_sec = 2;//it_interval表示之后的超时时间即每隔多长时间超时
-  new_value.it_interval.tv_nsec = 0;
-  assert(timerfd_settime(time_fd, 0, &new_value, NULL) != -1);  // 启动定时器，间隔周期 2s
-  bool timer_tick = false;
+  assert(wake_fd_ != -1);
 
   add_event(socket_->fd(), EPOLLIN);//EPOLLIN ：表示对应的文件描述符可以读（包括对端SOCKET正常关闭）
   
   add_event(efd_, EPOLLIN);
    
-  add_event(time_fd, EPOLLIN);
+  add_event(wake_fd_, EPOLLIN);  // 工作线程加入更早的超时期限时唤醒 epoll_wait
+
+  int watch_fd = negative_cache_->watch_fd();
+  if(watch_fd != -1)
+    add_event(watch_fd, EPOLLIN);  // 文档根目录下有文件创建时清空不存在路径的缓存
 
-  int overtime_ms = -1;//超时时间，ms级
   bool run = true;
+  bool paused = false;  // 有因接收缓冲区池用完而暂停读取的连接
   epoll_event events[MAXEVENTS];//epoll 事件数组
   while(run == true)
   {
+    int overtime_ms = client_timers_queue_.wait_timeout(timer_tick::now_ms());//超时时间，ms级，等到最近的一个定时器到期
+    if(paused && (overtime_ms < 0 || overtime_ms > PAUSE_RETRY_MS))
+      overtime_ms = PAUSE_RETRY_MS;
     int ret = epoll_wait(epoll_fd_, events, MAXEVENTS, overtime_ms); //等待注册在epoll_fd_上的事件的发生,如果发生则将发生的sokct fd和事件类型放入到events数组中。并将注册在epfd上的socket fd的事件类型给清空（fd并未清空）。
                                                                      //返回需要处理的事件数目，如返回0表示已超时。
-    if(ret <= 0 && errno != EINTR)//如果返回不为正数，且错误类型不为接收到中断信号
+    if(ret < 0)
     {
+      if(errno == EINTR)//接收到中断信号
+        continue;
       WARN("epoll wait failed!\n");
       break;
     }
@@ -291,23 +601,40 @@ void TcpEpollServer::handle_request()
           continue;
         }
         setNoBlock(client_fd);
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));  // 关闭Nagle算法，避免长连接上小响应被延迟
+        int lowat = http::OutputQueue::NOTSENT_LOWAT;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));  // 内核只缓冲少量待发数据，其余留在发送队列中
         
-        add_event(client_fd, EPOLLIN); //将客户端client_fd注册加入epoll fd
+        add_event(client_fd, CLIENT_EVENTS); //将客户端client_fd注册加入epoll fd（边缘触发、一次性触发）
         
-        timer_tick::Timer *new_timer = new timer_tick::Timer(
-          client_fd, std::bind(&TcpEpollServer::client_overtime_cb, this, std::placeholders::_1), time(NULL) + CLIENT_LIFE_TIME);    //  创建client fd的定时器
-        assert(client_fd < MAX_FD);
-        client_fd_array_[client_fd] = new_timer;   // 记录fd和计时器
-        client_timers_queue_.add_timer(new_timer);  
+        http::HttpConnection *conn = connections_->create(client_fd);
+        if(conn == nullptr)  // fd 超出了连接表的容量（运行中提高了打开文件数的限制）
+        {
+          WARN("client fd %d exceeds connection table capacity %d\n", client_fd, connections_->capacity());
+          close(client_fd);
+          continue;
+        }
+        if(conn->reactor == nullptr)  // 记录第一次使用。回调只设置一次：之前连接过时的超时回调可能正在其他 reactor 中执行
+          conn->timer.set_callback_func([conn](timer_tick::Timer *timer) { client_overtime_cb(conn, timer); });
+        conn->reset();  // 复用该fd上一个连接的记录
+        conn->reactor = this;
+        conn->header_deadline = timer_tick::now_ms() + header_timeout_;  // 新连接在请求头超时时间内必须发送完请求头
+        conn->timer.set_overtime(conn->header_deadline);  // 定时器嵌入在连接中，不需要单独分配
+        conn->timer.set_tag(conn->advance(http::HttpConnection::STAGE_IDLE));
+        client_timers_queue_.add_timer(&conn->timer);
 
         DEBUG("accept a new client[%d]\n", client_fd);
       }
-      else if(events[i].data.fd == time_fd)  // 若得到的是 timer fd ，则timer_tick设置为true，检查定时器队列
+      else if(events[i].data.fd == wake_fd_)
+      {
+        uint64_t u;
+        ssize_t s = read(wake_fd_, &u, sizeof(uint64_t));  // 清空计数，下一轮循环重新计算超时时间
+        (void)s;
+      }
+      else if(events[i].data.fd == watch_fd)
       {
-        s = read(time_fd, &exp, sizeof(uint64_t));
-        assert(s == sizeof(uint64_t));
-        timer_tick = true;
-        DEBUG("timer tick!!!\n");
+        negative_cache_->handle_events();
       }
       else if((events[i].data.fd == efd_ ) && (events[i].events & EPOLLIN))  // 若得到的是event fd (即SIGINT信号），则退出循环.
       {
@@ -315,23 +642,30 @@ void TcpEpollServer::handle_request()
         run = false;
         break;
       }
-      else if(events[i].events & EPOLLIN) // 若为客户端发送请求
+      else if(events[i].events & (EPOLLIN | EPOLLOUT | EPOLLRDHUP)) // 若为客户端发送请求或等待发送的响应可以继续发送。EPOLLONESHOT 保证该fd在工作线程重新激活前不会再次被分发
       {
+        // EPOLLRDHUP 只表示对端关闭了写方向，和可读一样处理：工作线程应答已读入的请求，发完响应后读到 EOF 再关闭连接
         DEBUG("receive a request from client[%d]\n", events[i].data.fd);
+        int client_fd = events[i].data.fd;
+        http::HttpConnection *conn = connections_->get(client_fd);
+        // 排队期间继续计时：工作在期限内没有开始执行时，定时器关闭连接，之后取出的工作因代数变化被丢弃
+        client_timers_queue_.del_timer(&conn->timer);
+        uint64_t queued = conn->advance(http::HttpConnection::STAGE_QUEUED);
+        conn->timer.set_overtime(timer_tick::now_ms() + ((events[i].events & EPOLLOUT) ? send_timeout_ : header_timeout_));
+        conn->timer.set_tag(queued);
+        client_timers_queue_.add_timer(&conn->timer);
+        // 继续发送响应、丢弃错误响应之后的数据属于已经接受的请求，过载时也不能拒绝，否则响应被截断
+        bool admitted = (events[i].events & EPOLLOUT) || conn->linger_deadline != 0;
         status r = 
           add_task_to_pool(std::bind(
-            &TcpEpollServer::client_service, this, static_cast<int>(events[i].data.fd)));  // 添加工作到线程池
-        /*if(r == FAILED)
-        {
-          continue;  // How to handle overflowed task?
-        }*/
-        del_event(events[i].data.fd, EPOLLIN);
+            &TcpEpollServer::serve_client, this, client_fd, queued), &conn->owner, queued, LANE_FAST, admitted);  // 添加工作到线程池
+        if(r == FAILED)  // 线程池过载，由reactor直接拒绝新请求
+          reject_client(client_fd);
       }
-      else if(events[i].events & EPOLLRDHUP) // 客户端关闭了fd. EPOLLRDHUP表示对端断开连接
+      else if(events[i].events & (EPOLLHUP | EPOLLERR)) // 连接两个方向都已关闭或出错
       {
-        DEBUG("EPOLLRDHUP!\n");
-        close_client(events[i].data.fd);
-        del_event(events[i].data.fd, EPOLLIN);
+        DEBUG("EPOLLHUP!\n");
+        close_client(events[i].data.fd);  // close()会自动将fd从epoll中移除
       }
       else
       {
@@ -339,174 +673,86 @@ void TcpEpollServer::handle_request()
       }
     }
 
-    if(timer_tick)   // timer ticking. 删除剩余的客户链接。
-    {
-      time_t current_time = time(NULL);//获取系统时间，单位为秒;
-      while(!client_timers_queue_.empty())
-      {
-        timer_tick::Timer* top_timer = client_timers_queue_.top();
-        if(top_timer->overtime() < current_time)
-        {
-          top_timer->overtime_callback(top_timer);   //如果超时,调用回调函数来处理。
-        }
-        else
-        {
-          break;
-        }   
-      }
-      DEBUG("client queue size: %d\n", client_timers_queue_.size());
-    }
+    client_timers_queue_.expire(timer_tick::now_ms());  // 调用所有已超时定时器的回调函数
+    paused = resume_paused_clients();
+    DEBUG("client queue size: %d\n", client_timers_queue_.size());
   }
   socket_->close();
 }
 
 /**
- * @brief 函数从一个套接字fd得到一行字符串文本，并存于buf指向的空间中。
- *        
- * @param sock 
- * @param buf 
- * @param size 
- * @return int 
- */
-int TcpEpollServer::get_line(int sock, char *buf, int size)
-{
-  int i = 0;
-	char c = '\0';
-	int n;
-  
-  //读取直到换行,并且不管是'\r\n'结尾还是'\n'结尾，都统一成'\n'
-	while ((i < size - 1) && (c != '\n'))
-	{
-	n = recv(sock, &c, 1, 0);//读取一个字符
-	if(n > 0)//若读到了这个字符
-	{
-		if(c == '\r')//若是'\r'就继续读，因为可能是'\r''\n'换行的
-		{
-			n = recv(sock, &c, 1, MSG_PEEK);//MSG_PEEK参数类似于预读取，本次读取的值仍在缓冲区仍可重复被读
-			if((n > 0) && (c == '\n'))//看看预读的数是否是'\n'
-			 recv(sock, &c, 1, 0);//如果是的话，就把'\n'彻底的从缓冲区中拿出来
-			else
-			 c = '\n';//如果下个数不是'\n'，就把'\r'也替换成'\n'
-	  }
-	   buf[i] = c;//将字符存再buf中
-	   i++;
-	}
-	else
-		c = '\n';
-	}
-	buf[i] = '\0';//最后以'\0'结尾
- 
- return i;
-}
-
-/**
- * @brief 回复客户端服务器无法接受请求
+ * @brief 响应 GET 请求。最近不存在的路径直接应答404；否则先按规范化的url路径查内容缓存，未命中再查打开文件缓存，
+ *        不超过内容缓存单个条目上限的文件载入缓存后从内存发送，更大的文件用 sendfile 发送。
  * 
- * @param client 
- */
-void TcpEpollServer::unimplemented(int client)
-{
-  char buf[1024];
-  sprintf(buf, "HTTP/1.0 501 Method Not Implemented\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);//MSG_NOSIGNAL，禁止send()函数向系统发送异常消息
-  sprintf(buf, SERVER_STRING);
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "Content-Type: text/html\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "<HTML><HEAD><TITLE>Method Not Implemented\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "</TITLE></HEAD>\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "<BODY><P>HTTP request method not supported.\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "</BODY></HTML>\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-}
-
-/**
- * @brief 响应 GET 请求
- * 
- * @param client_fd 
- * @param url file path
- * @param version http version
+ * @param conn 
+ * @param request 解析完成的请求
+ * @param keep_alive 是否保持连接
+ * @return 响应加入发送队列后连接的下一步：继续应答、发完后关闭或已经转交给其他通道
  */
-void TcpEpollServer::doGetMethod(int client_fd, char *url, char *version)
+TcpEpollServer::ConnState TcpEpollServer::doGetMethod(http::HttpConnection *conn, const http::HttpRequest &request, bool keep_alive)
 {
-  char path[BUFSIZ];
-  struct stat st;//stat结构体是用来描述一个linux系统文件系统中的文件属性的结构。
-  char *query_string = NULL;
-  query_string = url;
-  while( *query_string != '?' && *query_string != '\0')
-		query_string++;
-	if(*query_string == '?')
-	{
-		*query_string = '\0';
-		query_string++;
-	}
-  sprintf(path, "%s%s", document_root_, url);		
-  if(path[strlen(path)-1] == '/')//如果最后为'/'，将default_file_添加到path之后
-		strcat(path, default_file_);
-  
-  DEBUG("Finding the file: %s\n", path);
-
-  if(stat(path, &st) == -1)//stat()通过文件名path获取文件信息，并保存在st所指的结构体stat中,执行成功则返回0，失败返回-1
+  const char *target = request.target.data;
+  const char *query = static_cast<const char*>(memchr(target, '?', request.target.len));
+  size_t url_len = query ? query - target : request.target.len;
+  if(url_len >= BUFSIZ)
+    return send_error(conn, 414, false);
+  size_t url_size = url_len + 3;  // 规范化可能在开头补一个'/'，每段之后先写'/'，最后是'\0'
+  char *url = static_cast<char*>(conn->buffers->arena.allocate(url_size));
+  url_len = http::normalize_path(target, url_len, url, url_size);
+  if(url_len == 0)  // ".." 越过文档根目录
+    return send_error(conn, 400, false);
+
+  time_t now = time(NULL);
+  if(negative_cache_->contains(url, url_len, now))
+    return send_error(conn, 404, keep_alive);
+
+  bool stale = false;
+  cache::ContentPtr content = content_cache_->find(url, url_len, now, &stale);
+  if(content && !stale)
+    return content_serve(conn, content, request.minor_version, keep_alive);
+  if(conn->lane == LANE_FAST)  // 缓存未命中或需要重新校验：打开、读取文件可能阻塞在磁盘上
+    return defer_request(conn, LANE_IO, keep_alive);
+
+  uint64_t generation = negative_cache_->generation();
+  cache::OpenFilePtr file = open_files_->open(url, url_len, now);
+  if(!file)
   {
-    DEBUG("can not find the file: %s\n", path);
-    close_client(client_fd);
-    return;
+    DEBUG("can not find the file: %s\n", url);
+    negative_cache_->insert(url, url_len, now, generation);
+    return send_error(conn, 404, keep_alive);
   }
-  else
+  if(content)  // 内容缓存过期，与打开文件缓存中的元数据比较
   {
-    if(S_ISDIR(st.st_mode))//是否为目录
+    if(content->same_file(*file))
     {
-      strcat(path, "/");
-      strcat(path, default_file_);
+      content->validated.store(now, std::memory_order_relaxed);
+      return content_serve(conn, content, request.minor_version, keep_alive);
     }
+    content_cache_->erase(url, url_len);
+  }
 
-    if(st.st_mode & S_IXUSR || st.st_mode & S_IXGRP || st.st_mode &S_IXOTH)//文件所有者具可执行权限、用户组具可读取权限、其他用户具可执行权限
-		{
-			//CGI server
-			execute_cgi(client_fd, path, "GET", query_string); 				
-			close_client(client_fd);
-		}
-    else
+  if(file->executable())//文件所有者具可执行权限、用户组具可读取权限、其他用户具可执行权限
+  {
+    if(conn->lane != LANE_SLOW)
+      return defer_request(conn, LANE_SLOW, keep_alive);
+    //CGI server
+    std::string path = std::string(document_root_) + "/" + file->path;
+    std::string query_string = query ? std::string(query + 1, target + request.target.len - query - 1) : std::string();
+    execute_cgi(conn->fd, path.c_str(), "GET", query_string.c_str());
+    return CONN_CLOSE;
+  }
+
+  if(content_cache_->cacheable(file->size))
+  {
+    content = cache::CachedContent::load(*file, http::mime_type(file->path.c_str()));
+    if(content)
     {
-      file_serve(client_fd, path);
-      close_client(client_fd);
+      content_cache_->insert(url, url_len, content);
+      return content_serve(conn, content, request.minor_version, keep_alive);
     }
   }
-  
-}
 
-/**
- * @brief 找不到请求，回应 404 给客户端
- * 
- * @param client 
- */
-void TcpEpollServer::not_found(int client)
-{
-  char buf[1024];
-  DEBUG("send the 404 infomation!\n");
-  sprintf(buf, "HTTP/1.0 404 NOT FOUND\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, SERVER_STRING);
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "Content-Type: text/html\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "<HTML><TITLE>Not Found</TITLE>\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "<BODY><P>The server could not fulfill\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "your request because the resource specified\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "is unavailable or nonexistent.\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "</BODY></HTML>\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
+  return file_serve(conn, file, request.minor_version, keep_alive);
 }
 
 void TcpEpollServer::execute_cgi(int client, const char *path, const char *method, const char *query_string)
@@ -514,79 +760,80 @@ void TcpEpollServer::execute_cgi(int client, const char *path, const char *metho
 }
 
 /**
- * @brief 发送文件到客户端。
+ * @brief 发送文件到客户端。首部之后的文件区间由发送队列用 sendfile 从缓存的文件描述符零拷贝发送
  * 
- * @param client_fd 
- * @param filename 
+ * @param conn 
+ * @param file 打开文件缓存中的条目
+ * @param minor_version 请求的http次版本号
+ * @param keep_alive 是否保持连接
+ * @return 保持连接返回CONN_READ，发完后关闭返回CONN_CLOSE
  */
-void TcpEpollServer::file_serve(int client_fd, char * filename)
+TcpEpollServer::ConnState TcpEpollServer::file_serve(http::HttpConnection *conn, const cache::OpenFilePtr &file,
+                                                     int minor_version, bool keep_alive)
 {
-  char buffer[BUFSIZ];
-  int n = 1;
-  buffer[0] = 'A';
-  buffer[1] = '\0';
-  while(n > 0 && strcmp(buffer, "\n"))//get and discard headers
-  {
-    get_line(client_fd, buffer, sizeof(buffer));
-    DEBUG("%s\n", buffer);
-  }
-
-  std::string file = filename;
-  if(http_file_.find(filename) == http_file_.end())
-  {
-    WARN("can not open the file: %s\n", filename);
-    not_found(client_fd);
-    close_client(client_fd);
-    return;
-  }
-  else
-  {
-    DEBUG("Now send the file\n");
-    headers(client_fd);
-    send_file(client_fd, file);
-  }
+  DEBUG("Now send the file\n");
+  size_t content_length = static_cast<size_t>(file->size);
+  http::ConnectionBuffers *buffers = conn->buffers;
+  http::ResponseBuilder response(&buffers->arena, minor_version, 200, "OK");
+  response.add_header("Content-Type", http::mime_type(file->path.c_str()));
+  response.add_header("Content-Length", content_length);
+  response.add_keep_alive(keep_alive);  // Connection 首部之后紧跟结尾空行
+  buffers->output.append_arena(response.head(), response.head_len());
+  buffers->output.append_file(file, 0, content_length);
+  return keep_alive ? CONN_READ : CONN_CLOSE;
 }
 
 /**
- * @brief 发送 http header(200 OK) 给客户端.
+ * @brief 从内存发送缓存的文件内容
  * 
- * @param client 
+ * @param conn 
+ * @param content 
+ * @param minor_version 请求的http次版本号
+ * @param keep_alive 是否保持连接
+ * @return 保持连接返回CONN_READ，发完后关闭返回CONN_CLOSE
  */
-void TcpEpollServer::headers(int client)
+TcpEpollServer::ConnState TcpEpollServer::content_serve(http::HttpConnection *conn, const cache::ContentPtr &content,
+                                                        int minor_version, bool keep_alive)
 {
-  char buf[1024];
-
-  strcpy(buf, "HTTP/1.0 200 OK\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  strcpy(buf, "connection:keep-alive\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  strcpy(buf, SERVER_STRING);
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  sprintf(buf, "Content-Type: text/html\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
-  strcpy(buf, "\r\n");
-  send(client, buf, strlen(buf), MSG_NOSIGNAL);
+  http::ConnectionBuffers *buffers = conn->buffers;
+  http::ResponseBuilder response(&buffers->arena, minor_version, 200, "OK");
+  response.add_header("Content-Type", content->content_type);
+  response.add_header("Content-Length", content->data.size());
+  response.add_keep_alive(keep_alive);
+  buffers->output.append_arena(response.head(), response.head_len());
+  buffers->output.append_content(content, 0, content->data.size());
+  return keep_alive ? CONN_READ : CONN_CLOSE;
 }
 
 /**
- * @brief 从mmap发送文件的内容
+ * @brief 发送预先生成的错误响应
  * 
- * @param client 
- * @param filename 
+ * @param conn 
+ * @param status_code 
+ * @param keep_alive 是否保持连接
+ * @return 保持连接返回CONN_READ，否则返回CONN_CLOSE，响应发完后由 linger_client() 关闭连接
  */
-void TcpEpollServer::send_file(int client, std::string filename)
+TcpEpollServer::ConnState TcpEpollServer::send_error(http::HttpConnection *conn, int status_code, bool keep_alive)
 {
-  send(client, http_file_[filename], strlen(http_file_[filename]), MSG_NOSIGNAL);
+  http::append_canned_response(&conn->buffers->output, status_code, keep_alive);
+  if(keep_alive)
+    return CONN_READ;
+  conn->linger = true;
+  return CONN_CLOSE;
 }
 
 /**
- * @brief 客户端超时回调函数 
+ * @brief 客户端超时回调函数。连接记录由所有 reactor 共享，转移成功说明定时器属于当前的连接，
+ *        由接受它的 reactor（正在执行 expire() 的线程）关闭
  * 
+ * @param conn 
  * @param overtime_timer 
  */
-void TcpEpollServer::client_overtime_cb(timer_tick::Timer* overtime_timer)
+void TcpEpollServer::client_overtime_cb(http::HttpConnection *conn, timer_tick::Timer* overtime_timer)
 {
-  close_client(overtime_timer->fd());
+  if(!conn->transfer(overtime_timer->fired_tag(), http::HttpConnection::STAGE_RUNNING))
+    return;  // 到期后工作线程已经取走了连接，或者连接已经重新设置了定时器
+  static_cast<TcpEpollServer*>(conn->reactor)->close_client(conn->fd);
 }
 
 } // namespace http_server
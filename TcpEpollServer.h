@@ -13,12 +13,19 @@
 #include "TcpServer.h"
 #include "parameters.h"
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <sys/stat.h>
 #include <map>
 #include <string>
 #include <queue>
+#include <vector>
+#include <my_mutex.h>
 #include <timer_tick.h>
 #include <timer_queue.h>
+#include <http_connection.h>
+#include <connection_table.h>
+#include <open_file_cache.h>
+#include <content_cache.h>
+#include <negative_cache.h>
 
 namespace http_server
 {
@@ -28,7 +35,14 @@ class ThreadPool;
 class TcpEpollServer : public TcpServer
 {
 public:
-  TcpEpollServer(ThreadPool* pool, parameters::Parameters* parameters);
+  // 连接处理完一次事件后的下一步。CONN_DEFER：当前请求转交给了线程池中较慢的通道，连接由那个工作继续处理；
+  // CONN_PAUSE：接收缓冲区池已用完，暂停读取，reactor 在池中有空闲的缓冲区后重新激活
+  enum ConnState { CONN_CLOSE, CONN_READ, CONN_WRITE, CONN_DEFER, CONN_PAUSE };
+
+  typedef http::ConnectionTable<http::HttpConnection> ConnectionTable;
+
+  TcpEpollServer(ThreadPool* pool, parameters::Parameters* parameters, cache::ContentCache* content_cache,
+                 cache::OpenFileCache* open_files, cache::NegativeCache* negative_cache, ConnectionTable* connections);
 
   virtual void handle_request() override;
 
@@ -36,46 +50,84 @@ public:
 
   virtual void del_event(int fd, int event_type) override;
 
+  virtual void mod_event(int fd, int event_type) override;
+
   static void sig_int_handle(int sig);
 
   virtual void client_service(int client_fd) override;
 
+  void serve_client(int client_fd, uint64_t queued);
+
+  void resume_client(int client_fd);
+
+  void run_client(http::HttpConnection *conn, ConnState state);
+
   virtual ~TcpEpollServer();
 
   void close_client(int fd);
 
-  void file_mmap();
+  void reject_client(int fd);
+
+  void linger_client(http::HttpConnection *conn);
+
+  void rearm_client(http::HttpConnection *conn, ConnState state);
+
+  void pause_client(int fd, uint64_t tag);
+
+  bool resume_paused_clients();
+
+  void wake_up();
+
+  ConnState process_requests(http::HttpConnection *conn);
+
+  ConnState queue_responses(http::HttpConnection *conn);
+
+  ConnState serve_request(http::HttpConnection *conn, const http::HttpRequest &request);
+
+  void finish_request(http::HttpConnection *conn);
+
+  ConnState defer_request(http::HttpConnection *conn, work_lane lane, bool keep_alive);
 
-  int get_line(int sock, char *buf, int size);
-  void unimplemented(int client);
-  void not_found(int client);
   void execute_cgi(int client, const char *path, const char *method, const char *query_string);
-  void doGetMethod(int client_fd, char *url, char *version);
-  void file_serve(int client_fd, char * filename);
-  void headers(int client);
-  void send_file(int client, std::string filename);
-  void client_overtime_cb(timer_tick::Timer* overtime_timer);
+  ConnState doGetMethod(http::HttpConnection *conn, const http::HttpRequest &request, bool keep_alive);
+  ConnState file_serve(http::HttpConnection *conn, const cache::OpenFilePtr &file, int minor_version, bool keep_alive);
+  ConnState content_serve(http::HttpConnection *conn, const cache::ContentPtr &content, int minor_version, bool keep_alive);
+  ConnState send_error(http::HttpConnection *conn, int status_code, bool keep_alive);
+  static void client_overtime_cb(http::HttpConnection *conn, timer_tick::Timer* overtime_timer);
 
   static const int MAXEVENTS = 255;
-  static const int METHOD_LEN = 255;
-  static const int URL_LEN = 255;
-  static const int VERSION_LEN = 50;
-  static const int CLIENT_LIFE_TIME = 5;
-  static const int MAX_FD = 10000;
+  static const int PAUSE_RETRY_MS = 10;  // 有暂停读取的连接时检查接收缓冲区池的间隔，毫秒
+  static const int LINGER_TIMEOUT = 2000;  // 错误响应后等待客户端停止发送的最长时间，毫秒
 
 private:
   int epoll_fd_;
   char *document_root_;
   char *default_file_;
   parameters::Parameters *http_parameters_;
+  int keep_alive_timeout_;  // 长连接空闲超时时间，毫秒
+  int header_timeout_;  // 读取请求头的超时时间，毫秒
+  int body_timeout_;  // 读取请求体的超时时间，毫秒
+  int send_timeout_;  // 等待套接字可写的超时时间，毫秒
+  int keep_alive_requests_;  // 每个长连接最多处理的请求数
 
-  std::map<std::string, char*> http_file_;  // http文件路径和相应的mmap addr.
-  std::vector<int> file_fd_lists_; // http文件描述符数组.
+  cache::ContentCache *content_cache_;  // 所有reactor共享的静态内容缓存
+  cache::OpenFileCache *open_files_;  // 所有reactor共享的打开文件和元数据缓存，sendfile 的数据源
+  cache::NegativeCache *negative_cache_;  // 所有reactor共享的不存在路径缓存
 
   static int efd_; // 事件文件描述符(event_fd）
-
-  timer_tick::TimerQueue client_timers_queue_;  // 客户端定时器队列 client timer queue
-  timer_tick::Timer* client_fd_array_[MAX_FD];  // 客户端套接字对应的定时器 client fd and its timer
+  int wake_fd_;  // 唤醒本 reactor 的 eventfd
+
+  timer_tick::TimerQueue client_timers_queue_;  // 客户端定时器队列（时间轮） client timer wheel
+  ConnectionTable *connections_;  // 所有reactor共享、按fd索引的连接记录表。fd 在进程内唯一，各 reactor 接受的连接不会冲突
+
+  // 因接收缓冲区池用完而暂停读取的连接和暂停时的代数
+  struct PausedClient
+  {
+    int fd;
+    uint64_t tag;
+  };
+  my_mutex::MutexLock paused_mutex_;
+  std::vector<PausedClient> paused_;  // 由 paused_mutex_ 保护，工作线程加入，reactor 取出
 
 };
 
@@ -21,20 +21,11 @@ TcpServer::TcpServer(ThreadPool* thread_pool, int listen_port)
     socket_(new Socket(listen_port))
 {
   socket_->set_reuseaddr();
+  socket_->set_reuseport();
   socket_->bind();
   socket_->listen();
 }
 
-/**
- * @brief 添加新的工作任务进线程池的工作队列
- * 
- * @param std::function<void ()> new_job 
- */
-status TcpServer::add_task_to_pool(std::function<void ()> new_job)
-{
-  thread_pool_->add_task_to_pool(new_job);
-}
-
 /**
  * @brief 设置套接字fd为非阻塞
  * 
@@ -13,12 +13,11 @@
 
 #include <memory>
 #include "parameters.h"
+#include "thread_pool.h"
 
 namespace http_server
 {
 
-class ThreadPool;
-
 class Socket;
 
 /*
@@ -39,7 +38,33 @@ public:
 
   virtual void del_event(int fd, int event_type) = 0;
 
-  status add_task_to_pool(std::function<void ()> new_job);
+  virtual void mod_event(int fd, int event_type) = 0;
+
+  /*
+  *@brief 添加任务到线程池
+  *@param new_job 可调用对象
+  *@param lane 线程池通道
+  */
+  template <class F>
+  status add_task_to_pool(F &&new_job, work_lane lane = LANE_FAST)
+  {
+    return thread_pool_->add_task_to_pool(std::forward<F>(new_job), lane);
+  }
+
+  /*
+  *@brief 添加属于某个连接的任务到线程池，连接在任务排队期间关闭时任务被丢弃
+  *@param new_job 可调用对象
+  *@param owner 连接的代数
+  *@param expected 提交时的代数
+  *@param lane 线程池通道
+  *@param admitted 任务属于已经接受的请求，不经过准入控制
+  */
+  template <class F>
+  status add_task_to_pool(F &&new_job, const std::atomic<uint64_t> *owner, uint64_t expected,
+                          work_lane lane = LANE_FAST, bool admitted = false)
+  {
+    return thread_pool_->add_task_to_pool(std::forward<F>(new_job), owner, expected, lane, admitted);
+  }
 
   virtual void client_service(int client_fd) = 0;
 
@@ -0,0 +1,1305 @@
+/**
+ * @file TcpUringServer.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "TcpUringServer.h"
+#include "parameters.h"
+#include <algorithm>
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+//#define LOGGER_DEBUG
+#define LOGGER_WARN
+#include <logger.h>
+
+#include "Socket.h"
+#include <http_response.h>
+
+namespace http_server
+{
+
+static const uint16_t BUFFER_GROUP = 0;  // 提供的接收缓冲区组编号
+static const uint64_t SLOT_MASK = 0xffffffffULL;
+
+/**
+ * @brief 固定文件表的大小：内核要求不超过打开文件数的软限制，main 启动时已经把软限制提高到硬限制
+ */
+static int file_table_limit()
+{
+  struct rlimit nofile;
+  if(getrlimit(RLIMIT_NOFILE, &nofile) != 0)
+    return 1024;
+  if(nofile.rlim_cur > static_cast<rlim_t>(TcpUringServer::MAX_FILE_TABLE))
+    return TcpUringServer::MAX_FILE_TABLE;
+  return static_cast<int>(nofile.rlim_cur);
+}
+
+TcpUringServer::Slot::Slot(int id)
+  : conn(id),
+    file_index(-1),
+    pending(0),
+    recv_armed(false),
+    recv_paused(false),
+    buffer_wait(false),
+    send_armed(false),
+    read_armed(false),
+    deferred(false),
+    peer_closed(false),
+    closing(false),
+    close_submitted(false),
+    close_done(false),
+    defer_status(0),
+    defer_url(nullptr),
+    defer_url_len(0),
+    piped(0),
+    send_piped(false)
+{
+  pipe.read_fd = pipe.write_fd = -1;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+}
+
+TcpUringServer::Slot::~Slot()
+{
+  if(pipe.read_fd != -1)
+  {
+    close(pipe.read_fd);
+    close(pipe.write_fd);
+  }
+}
+
+TcpUringServer::TcpUringServer(ThreadPool *pool, parameters::Parameters *parameters, cache::ContentCache *content_cache,
+                               cache::OpenFileCache *open_files, cache::NegativeCache *negative_cache)
+  : TcpServer(pool, parameters->getListenPort()),
+    accept_armed_(false),
+    content_cache_(content_cache),
+    open_files_(open_files),
+    negative_cache_(negative_cache),
+    wake_value_(0),
+    file_table_size_(file_table_limit()),
+    slots_(file_table_size_),
+    slot_num_(0),
+    requests_(0)
+{
+  keep_alive_timeout_ = parameters->getKeepAliveTimeout();
+  keep_alive_requests_ = parameters->getKeepAliveRequests();
+  header_timeout_ = parameters->getHeaderTimeout();
+  body_timeout_ = parameters->getBodyTimeout();
+  send_timeout_ = parameters->getSendTimeout();
+  wake_fd_ = eventfd(0, EFD_CLOEXEC);  // 阻塞模式：io_uring 对非阻塞的fd直接返回 EAGAIN，不会等待
+  int nodelay = 1;
+  // 直接描述符不能 setsockopt，接受的连接从监听套接字继承 TCP_NODELAY 和 TCP_NOTSENT_LOWAT
+  setsockopt(socket_->fd(), IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  int lowat = http::OutputQueue::NOTSENT_LOWAT;
+  setsockopt(socket_->fd(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+}
+
+int TcpUringServer::efd_ = eventfd(0, 0);  // SIGINT 时写入，所有reactor上的 poll 都会完成
+
+TcpUringServer::~TcpUringServer()
+{
+  close(wake_fd_);
+  for(size_t i = 0; i < free_pipes_.size(); ++i)
+  {
+    close(free_pipes_[i].read_fd);
+    close(free_pipes_[i].write_fd);
+  }
+}
+
+/**
+ * @brief SIGINT 信号回调函数. 事件文件描述符 efd 被用来通知主循环退出
+ *
+ * @param sig
+ */
+void TcpUringServer::sig_int_handle(int sig)
+{
+  uint64_t u = 1;
+  ssize_t rc = write(efd_, &u, sizeof(uint64_t));
+  if(rc != sizeof(uint64_t))
+    WARN("sig int eventfd write error");
+}
+
+/**
+ * @brief 用一个小的 io_uring 检查内核功能。提供的缓冲区环和直接描述符与多次触发的 accept 同时加入内核（5.19），
+ *        多次触发的 recv 需要 6.0，没有单独的探测方法，由 handle_request() 中第一次 recv 的结果体现
+ *
+ * @return 支持返回true
+ */
+bool TcpUringServer::supported()
+{
+  my_uring::Ring ring;
+  if(ring.init(8, 2, 0) < 0 || !(ring.features() & IORING_FEAT_EXT_ARG))
+    return false;
+  if(ring.register_sparse_files(1) < 0)
+    return false;
+  my_uring::BufferRing buffers;
+  return buffers.init(&ring, 1, 64, BUFFER_GROUP) == 0;
+}
+
+/**
+ * @brief 取一个 SQE 并填好 user_data
+ *
+ * @param op 操作类型
+ * @param id 连接槽位编号
+ * @return SQ 已满且无法提交时返回nullptr
+ */
+struct io_uring_sqe* TcpUringServer::get_sqe(Op op, int id)
+{
+  struct io_uring_sqe *sqe = ring_.get_sqe();
+  if(sqe == nullptr)
+  {
+    WARN("io_uring submission queue full\n");
+    return nullptr;
+  }
+  sqe->user_data = user_data(op, id);
+  return sqe;
+}
+
+/**
+ * @brief 在监听套接字上提交多次触发的 accept，每个新连接分配一个直接描述符
+ *
+ */
+void TcpUringServer::arm_accept()
+{
+  struct io_uring_sqe *sqe = get_sqe(OP_ACCEPT, 0);
+  if(sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = socket_->fd();
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->file_index = IORING_FILE_INDEX_ALLOC;
+  accept_armed_ = true;
+}
+
+/**
+ * @brief 提交多次触发的 recv，数据写入内核从缓冲区环中挑选的缓冲区
+ *
+ * @param slot
+ */
+void TcpUringServer::arm_recv(Slot *slot)
+{
+  struct io_uring_sqe *sqe = get_sqe(OP_RECV, slot->conn.fd);
+  if(sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = slot->file_index;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->buf_group = BUFFER_GROUP;
+  slot->recv_armed = true;
+  ++slot->pending;
+}
+
+/**
+ * @brief 在唤醒用的 eventfd 上提交 read，线程池交回连接时完成
+ *
+ */
+void TcpUringServer::arm_wake()
+{
+  struct io_uring_sqe *sqe = get_sqe(OP_WAKE, 0);
+  if(sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wake_fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&wake_value_);
+  sqe->len = sizeof(wake_value_);
+}
+
+/**
+ * @brief 监视文档根目录的 inotify fd，有文件创建时清空不存在路径的缓存
+ *
+ * @param watch_fd
+ */
+void TcpUringServer::arm_watch(int watch_fd)
+{
+  struct io_uring_sqe *sqe = get_sqe(OP_WATCH, watch_fd);
+  if(sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = watch_fd;
+  sqe->poll32_events = POLLIN;
+}
+
+/**
+ * @brief 按 user_data 取消连接上的一个在途请求，只会命中这个槽位自己的请求
+ *
+ * @param slot
+ * @param op
+ */
+void TcpUringServer::cancel_op(Slot *slot, Op op)
+{
+  struct io_uring_sqe *sqe = get_sqe(OP_CANCEL, slot->conn.fd);
+  if(sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = user_data(op, slot->conn.fd);
+  ++slot->pending;
+}
+
+/**
+ * @brief 采用 io_uring 处理请求循环。每轮只调用一次 io_uring_enter：提交上一轮处理完成事件时产生的所有 SQE，
+ *        同时等待新的完成事件或最近的定时器到期。
+ *
+ */
+void TcpUringServer::handle_request()
+{
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, sig_int_handle);
+
+  if(socket_->fd() == -1)
+  {
+    WARN("Create listen fd failed!\n");
+    return;
+  }
+  assert(efd_ != -1);
+  assert(wake_fd_ != -1);
+
+  // io_uring 在本线程中创建：SINGLE_ISSUER 要求以后只由创建它的线程提交，DEFER_TASKRUN 让完成事件只在等待时处理
+  int ret = ring_.init(RING_ENTRIES, 4, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+  if(ret < 0)
+  {
+    WARN("io_uring setup failed: %s\n", strerror(-ret));
+    return;
+  }
+  ret = ring_.register_sparse_files(file_table_size_);
+  if(ret < 0)
+  {
+    WARN("io_uring register files failed: %s\n", strerror(-ret));
+    return;
+  }
+  ret = buffers_.init(&ring_, BUFFER_NUM, BUFFER_SIZE, BUFFER_GROUP);
+  if(ret < 0)
+  {
+    WARN("io_uring register buffer ring failed: %s\n", strerror(-ret));
+    return;
+  }
+
+  arm_accept();
+  arm_wake();
+  struct io_uring_sqe *sqe = get_sqe(OP_SIGNAL, 0);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = efd_;
+  sqe->poll32_events = POLLIN;
+  int watch_fd = negative_cache_->watch_fd();
+  if(watch_fd != -1)
+    arm_watch(watch_fd);
+
+  bool run = true;
+  while(run)
+  {
+    int overtime_ms = client_timers_queue_.wait_timeout(timer_tick::now_ms());
+    if(!paused_.empty() && (overtime_ms < 0 || overtime_ms > PAUSE_RETRY_MS))
+      overtime_ms = PAUSE_RETRY_MS;
+    ret = ring_.submit_and_wait(1, overtime_ms);
+    if(ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EBUSY)
+    {
+      WARN("io_uring enter failed: %s\n", strerror(-ret));
+      break;
+    }
+
+    struct io_uring_cqe *cqe;
+    while((cqe = ring_.peek_cqe()) != nullptr)
+    {
+      if((cqe->user_data >> 56) == OP_SIGNAL)
+      {
+        INFO("Got a sigint signal. Exiting...\n");
+        run = false;
+      }
+      else
+        handle_cqe(cqe);
+      ring_.cqe_seen();
+    }
+
+    client_timers_queue_.expire(timer_tick::now_ms());
+    resume_paused();
+  }
+  socket_->close();
+  printf("uring reactor: %llu requests, %llu io_uring_enter calls\n",
+         static_cast<unsigned long long>(requests_), static_cast<unsigned long long>(ring_.enters()));
+}
+
+/**
+ * @brief 分发一个完成事件
+ *
+ * @param cqe
+ */
+void TcpUringServer::handle_cqe(struct io_uring_cqe *cqe)
+{
+  Op op = static_cast<Op>(cqe->user_data >> 56);
+  int id = static_cast<int>(cqe->user_data & SLOT_MASK);
+  switch(op)
+  {
+  case OP_ACCEPT:
+    on_accept(cqe);
+    break;
+  case OP_WAKE:
+    on_wake();
+    break;
+  case OP_WATCH:
+    negative_cache_->handle_events();
+    arm_watch(id);
+    break;
+  case OP_RECV:
+    on_recv(slots_.get(id), cqe);
+    break;
+  case OP_SEND:
+    on_send(slots_.get(id), cqe->res);
+    break;
+  case OP_READ:
+    on_read(slots_.get(id), cqe->res);
+    break;
+  case OP_CLOSE:
+    if(cqe->res == -ECANCELED)  // 链接在前面的 send 上断开，等在途请求结束后单独关闭
+      slots_.get(id)->close_submitted = false;
+    else
+      slots_.get(id)->close_done = true;
+    op_done(slots_.get(id));
+    break;
+  case OP_CANCEL:
+  case OP_POLL:  // 链接的 splice 单独完成
+    op_done(slots_.get(id));
+    break;
+  case OP_DROP:
+    break;
+  default:
+    WARN("unexpected things happened! \n");
+    break;
+  }
+}
+
+/**
+ * @brief 新连接：取一个空闲的槽位，提交 recv 并开始计算请求头超时
+ *
+ * @param cqe
+ */
+void TcpUringServer::on_accept(struct io_uring_cqe *cqe)
+{
+  if(!(cqe->flags & IORING_CQE_F_MORE))  // 多次触发的 accept 已经结束（出错或被取消），需要重新提交
+    accept_armed_ = false;
+  if(cqe->res >= 0)
+  {
+    Slot *slot = acquire_slot();
+    if(slot == nullptr)  // 正在关闭的连接还占着槽位，固定文件表却已经有了空位
+    {
+      WARN("no free connection slot, drop client\n");
+      struct io_uring_sqe *sqe = get_sqe(OP_DROP, 0);
+      if(sqe != nullptr)
+      {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = static_cast<uint32_t>(cqe->res) + 1;
+      }
+      if(!accept_armed_)
+        arm_accept();
+      return;
+    }
+    slot->file_index = cqe->res;
+    http::HttpConnection *conn = &slot->conn;
+    conn->header_deadline = timer_tick::now_ms() + header_timeout_;  // 新连接在请求头超时时间内必须发送完请求头
+    conn->timer.set_overtime(conn->header_deadline);
+    client_timers_queue_.add_timer(&conn->timer);
+    arm_recv(slot);
+    DEBUG("accept a new client[%d]\n", slot->file_index);
+  }
+  else
+    WARN("accept failed: %s\n", strerror(-cqe->res));
+  if(!accept_armed_)
+    arm_accept();
+}
+
+/**
+ * @brief 收到数据：从提供的缓冲区复制到连接后立即归还缓冲区，再处理完整的请求
+ *
+ * @param slot
+ * @param cqe
+ */
+void TcpUringServer::on_recv(Slot *slot, struct io_uring_cqe *cqe)
+{
+  int res = cqe->res;
+  bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+  if(cqe->flags & IORING_CQE_F_BUFFER)
+  {
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    if(res > 0 && !slot->closing)
+      append_input(slot, buffers_.buffer(bid), res);
+    buffers_.recycle(bid);
+  }
+  if(!more)
+    slot->recv_armed = false;
+
+  if(!slot->closing)
+  {
+    if(res == 0)  // 对端关闭了写方向
+      slot->peer_closed = true;
+    else if(res < 0 && res != -ENOBUFS && res != -ECANCELED)
+      close_client(slot);
+    // 缓冲区环暂时用完（ENOBUFS）时多次触发的 recv 会结束，重新提交
+    if(!more && !slot->closing && !slot->peer_closed && !slot->recv_paused)
+      arm_recv(slot);
+    if(res >= 0 && !slot->closing)
+      process(slot);
+  }
+  if(!more)
+    op_done(slot);
+}
+
+/**
+ * @brief 把收到的数据放入连接。直接写入读缓冲区，放不下的部分和请求转交期间收到的数据放入 backlog；
+ *        backlog 过大时暂停接收，避免客户端不读响应、只发送流水线请求时占用无限的内存。
+ *        接收缓冲区池用完时数据也放入 backlog 并暂停接收，等到缓冲区后再处理
+ *
+ * @param slot
+ * @param data
+ * @param len
+ */
+void TcpUringServer::append_input(Slot *slot, const char *data, size_t len)
+{
+  if(!slot->deferred && slot->backlog.empty() && slot->conn.acquire_read_buffer())
+  {
+    http::ConnectionBuffers *buffers = slot->conn.buffers;
+    size_t n = std::min(len, buffers->read_space());
+    memcpy(buffers->read_buffer + buffers->read_end, data, n);
+    buffers->read_end += n;
+    data += n;
+    len -= n;
+  }
+  if(len == 0)
+    return;
+  slot->backlog.append(data, len);
+  if(!slot->deferred && !slot->conn.acquire_read_buffer())
+    wait_for_buffer(slot);
+  else if(slot->backlog.size() > BACKLOG_LIMIT && slot->recv_armed && !slot->recv_paused)
+  {
+    slot->recv_paused = true;
+    cancel_op(slot, OP_RECV);
+  }
+}
+
+/**
+ * @brief 接收缓冲区池已用完：暂停接收，已收到的数据留在 backlog 中，连接加入 paused_ 等待缓冲区
+ *
+ * @param slot
+ */
+void TcpUringServer::wait_for_buffer(Slot *slot)
+{
+  if(!slot->recv_paused)
+  {
+    slot->recv_paused = true;
+    if(slot->recv_armed)
+      cancel_op(slot, OP_RECV);
+  }
+  if(!slot->buffer_wait)
+  {
+    slot->buffer_wait = true;
+    paused_.push_back(slot->conn.fd);
+  }
+}
+
+/**
+ * @brief 按池中空闲的缓冲区个数依次恢复等待接收缓冲区的连接，先暂停的先恢复。
+ *        process() 把 backlog 移入读缓冲区，backlog 处理完后重新提交 recv
+ *
+ */
+void TcpUringServer::resume_paused()
+{
+  if(paused_.empty())
+    return;
+  size_t n = std::min(paused_.size(), my_recv_pool::RecvBufferPool::instance().available());
+  std::vector<int> resumed(paused_.begin(), paused_.begin() + n);
+  paused_.erase(paused_.begin(), paused_.begin() + n);
+  for(size_t i = 0; i < resumed.size(); ++i)
+  {
+    Slot *slot = slots_.get(resumed[i]);
+    if(!slot->buffer_wait)  // 已经关闭（槽位可能已被新连接复用）
+      continue;
+    slot->buffer_wait = false;
+    if(!slot->closing)
+      process(slot);
+  }
+}
+
+/**
+ * @brief 发送队列的一部分发送完成，从队列中移除已发送的数据后继续处理
+ *
+ * @param slot
+ * @param res 发送的字节数或 -errno
+ */
+void TcpUringServer::on_send(Slot *slot, int res)
+{
+  slot->send_armed = false;
+  if(res > 0 && slot->closing && slot->send_piped)
+    slot->piped -= static_cast<size_t>(res);  // 管道中剩余的字节数决定关闭时能否复用管道
+  if(!slot->closing)
+  {
+    if(res <= 0)  // 出错，或者管道中的数据没有发出（管道意外为空），重试只会空转
+      close_client(slot);
+    else
+    {
+      size_t n = static_cast<size_t>(res);
+      slot->conn.buffers->output.consume(n);
+      if(slot->send_piped)
+      {
+        slot->piped -= n;
+        if(slot->piped == 0)  // 管道已经发空，交还给 reactor
+          release_pipe(slot);
+      }
+      process(slot);
+    }
+  }
+  slot->send_piped = false;
+  op_done(slot);
+}
+
+/**
+ * @brief 文件区间的一部分 splice 进管道完成
+ *
+ * @param slot
+ * @param res 进入管道的字节数或 -errno
+ */
+void TcpUringServer::on_read(Slot *slot, int res)
+{
+  slot->read_armed = false;
+  if(res > 0)
+    slot->piped = static_cast<size_t>(res);
+  if(!slot->closing)
+  {
+    if(res <= 0)  // 读出错，或文件在发送过程中被截断，已经无法满足 Content-Length
+      close_client(slot);
+    else
+      process(slot);
+  }
+  op_done(slot);
+}
+
+/**
+ * @brief 给连接取一个管道，先用空闲的，没有时新建
+ *
+ * @param slot
+ * @return 无法创建管道（打开文件数用完）返回false
+ */
+bool TcpUringServer::acquire_pipe(Slot *slot)
+{
+  if(!free_pipes_.empty())
+  {
+    slot->pipe = free_pipes_.back();
+    free_pipes_.pop_back();
+    return true;
+  }
+  int fds[2];
+  if(pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+  {
+    WARN("pipe2 failed: %s\n", strerror(errno));
+    return false;
+  }
+  slot->pipe.read_fd = fds[0];
+  slot->pipe.write_fd = fds[1];
+  return true;
+}
+
+/**
+ * @brief 连接不再需要管道时交还。管道中还有没发出的数据（连接在发送过程中关闭）时不能复用，直接关闭
+ *
+ * @param slot
+ */
+void TcpUringServer::release_pipe(Slot *slot)
+{
+  if(slot->pipe.read_fd == -1)
+    return;
+  if(slot->piped == 0 && free_pipes_.size() < MAX_FREE_PIPES)
+    free_pipes_.push_back(slot->pipe);
+  else
+  {
+    close(slot->pipe.read_fd);
+    close(slot->pipe.write_fd);
+  }
+  slot->pipe.read_fd = slot->pipe.write_fd = -1;
+  slot->piped = 0;
+}
+
+/**
+ * @brief 把队首文件区间的下一部分（最多 PIPE_SIZE 字节）从文件 splice 进管道，在内核的页缓存和管道之间只传递页的引用
+ *
+ * @param slot
+ * @param file 发送队列中的文件区间
+ * @return 无法提交、连接已经关闭返回false
+ */
+bool TcpUringServer::fill_pipe(Slot *slot, const http::OutputQueue::Segment *file)
+{
+  if(slot->pipe.read_fd == -1 && !acquire_pipe(slot))
+  {
+    close_client(slot);
+    return false;
+  }
+  struct io_uring_sqe *sqe = get_sqe(OP_READ, slot->conn.fd);
+  if(sqe == nullptr)
+  {
+    close_client(slot);
+    return false;
+  }
+  sqe->opcode = IORING_OP_SPLICE;
+  sqe->fd = slot->pipe.write_fd;
+  sqe->off = static_cast<uint64_t>(-1);  // 管道没有偏移
+  sqe->splice_fd_in = file->file->fd;
+  sqe->splice_off_in = static_cast<uint64_t>(file->offset);  // 按偏移读取，不改变共享的文件描述符的位置
+  sqe->len = static_cast<uint32_t>(std::min(file->len, static_cast<size_t>(PIPE_SIZE)));
+  slot->read_armed = true;
+  ++slot->pending;
+  return true;
+}
+
+/**
+ * @brief 等套接字可写后把管道中的数据 splice 到套接字。poll 和 splice 链接在一起，
+ *        splice 在内核的工作线程中执行，套接字可写之后才开始，只占用工作线程到管道中的数据发完为止
+ *
+ * @param slot
+ * @return 无法提交、连接已经关闭返回false
+ */
+bool TcpUringServer::drain_pipe(Slot *slot)
+{
+  http::HttpConnection *conn = &slot->conn;
+  struct io_uring_sqe *poll_sqe = get_sqe(OP_POLL, conn->fd);
+  if(poll_sqe == nullptr)
+  {
+    close_client(slot);
+    return false;
+  }
+  poll_sqe->opcode = IORING_OP_POLL_ADD;
+  poll_sqe->fd = slot->file_index;
+  poll_sqe->flags = IOSQE_FIXED_FILE;
+  poll_sqe->poll32_events = POLLOUT;
+  ++slot->pending;
+  struct io_uring_sqe *sqe = get_sqe(OP_SEND, conn->fd);
+  if(sqe == nullptr)
+  {
+    close_client(slot);
+    return false;
+  }
+  poll_sqe->flags |= IOSQE_IO_LINK;  // 取第二个 SQE 时可能已经提交了 poll，这时两者各自执行，splice 直接开始
+  sqe->opcode = IORING_OP_SPLICE;
+  sqe->fd = slot->file_index;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->off = static_cast<uint64_t>(-1);
+  sqe->splice_fd_in = slot->pipe.read_fd;
+  sqe->splice_off_in = static_cast<uint64_t>(-1);
+  sqe->len = static_cast<uint32_t>(slot->piped);
+  if(conn->buffers->output.bytes() > slot->piped)
+    sqe->splice_flags = SPLICE_F_MORE;  // 后面还有数据，不必立即发出不满的报文段
+  slot->send_armed = true;
+  slot->send_piped = true;
+  ++slot->pending;
+  return true;
+}
+
+/**
+ * @brief 线程池交回了连接：把准备好的响应加入发送队列，继续处理后面的请求。
+ *        转交的结果在 process() 之前清空，否则 process() 再次转交后工作线程写入的新结果会被清掉
+ *
+ */
+void TcpUringServer::on_wake()
+{
+  std::vector<int> ready;
+  {
+    my_mutex::MutexLockGuard lock(ready_mutex_);
+    ready.swap(ready_);
+  }
+  for(size_t i = 0; i < ready.size(); ++i)
+  {
+    Slot *slot = slots_.get(ready[i]);
+    slot->deferred = false;
+    if(!slot->closing)
+    {
+      http::HttpConnection *conn = &slot->conn;
+      http::ConnectionBuffers *buffers = conn->buffers;
+      int minor_version = buffers->parser.request().minor_version;
+      finish_request(conn);
+      if(slot->defer_status < 0)
+        conn->close_after_output = true;
+      else
+      {
+        if(slot->defer_status > 0)
+          http::append_canned_response(&buffers->output, slot->defer_status, conn->defer_keep_alive);
+        else if(slot->defer_content)
+          set_content(conn, slot->defer_content, minor_version, conn->defer_keep_alive);
+        else
+          set_file(conn, slot->defer_file, minor_version, conn->defer_keep_alive);
+        if(!conn->defer_keep_alive)
+          conn->close_after_output = true;
+      }
+    }
+    // 先清除结果再继续处理：process() 可能把下一个流水线请求再次转交，工作线程随时会写入新的结果
+    slot->defer_content.reset();
+    slot->defer_file.reset();
+    if(!slot->closing)
+      process(slot);
+    op_done(slot);
+  }
+  arm_wake();
+}
+
+/**
+ * @brief 连接上的一个请求完成（或转交的工作交回）。正在关闭的连接在最后一个请求完成后关闭
+ *
+ * @param slot
+ */
+void TcpUringServer::op_done(Slot *slot)
+{
+  --slot->pending;
+  if(slot->closing)
+    try_close(slot);
+}
+
+/**
+ * @brief 连接在等待请求、没有需要保留的数据时把缓冲区还给池，释放文件块，空闲的长连接只占用槽位
+ *
+ * @param slot
+ */
+void TcpUringServer::release_idle(Slot *slot)
+{
+  if(!slot->backlog.empty())
+    return;
+  slot->conn.release_idle_buffers();
+  if(slot->conn.buffers == nullptr && !slot->read_armed && !slot->send_armed)
+    release_pipe(slot);
+}
+
+/**
+ * @brief 取一个空闲的连接槽位，没有时使用下一个编号，所在的页第一次使用时分配
+ *
+ * @return 编号用完返回nullptr
+ */
+TcpUringServer::Slot* TcpUringServer::acquire_slot()
+{
+  Slot *slot;
+  if(free_slots_.empty())
+  {
+    slot = slots_.create(slot_num_);
+    if(slot == nullptr)
+      return nullptr;
+    ++slot_num_;
+    slot->conn.timer.set_callback_func([this](timer_tick::Timer *timer) { client_overtime_cb(timer); });
+  }
+  else
+  {
+    slot = slots_.get(free_slots_.back());
+    free_slots_.pop_back();
+  }
+  return slot;
+}
+
+/**
+ * @brief 槽位上的连接已关闭且没有在途的请求，恢复初始状态后放回空闲链表。
+ *        定时器必须先从队列中删除：复用槽位的新连接会再次加入同一个定时器，重复插入会破坏时间轮的链表
+ *
+ * @param slot
+ */
+void TcpUringServer::release_slot(Slot *slot)
+{
+  client_timers_queue_.del_timer(&slot->conn.timer);  // 链接了 close 的最后一次发送仍然计算发送超时，定时器可能还在队列中
+  slot->conn.reset();
+  slot->file_index = -1;
+  slot->recv_paused = false;
+  slot->buffer_wait = false;
+  slot->peer_closed = false;
+  slot->closing = false;
+  slot->close_submitted = false;
+  slot->close_done = false;
+  release_pipe(slot);
+  std::string().swap(slot->backlog);
+  free_slots_.push_back(slot->conn.fd);
+}
+
+/**
+ * @brief TcpServer 要求实现的按fd处理客户端，保留它是为了实现基类的纯虚接口。
+ *        本后端的“fd”是连接槽位编号，reactor 内部直接调用 process()，不经过这里
+ *
+ * @param client_fd
+ */
+void TcpUringServer::client_service(int client_fd)
+{
+  process(slots_.get(client_fd));
+}
+
+/**
+ * @brief 解析读缓冲区中完整的请求，把响应依次加入发送队列，再发送队列中的数据。
+ *        sendmsg 在途时不修改发送队列（内核引用着队列中的内存），发送完成后再继续处理后面的流水线请求；
+ *        队列积累到上限或请求转交给线程池时也先停止解析。没有待发送的数据时按连接所处的阶段设置超时，等待 recv
+ *
+ * @param slot
+ */
+void TcpUringServer::process(Slot *slot)
+{
+  http::HttpConnection *conn = &slot->conn;
+  if(conn->buffers == nullptr && !slot->backlog.empty() && !conn->acquire_read_buffer())
+  {
+    wait_for_buffer(slot);  // 没有发送中的响应，等到缓冲区后再处理
+    return;
+  }
+  http::ConnectionBuffers *buffers = conn->acquire_buffers();
+  if(buffers->output.empty() && !slot->deferred)
+    buffers->arena.reset();  // 响应都已发出，没有正在处理的请求
+  while(!slot->closing && !slot->deferred && !slot->send_armed && !conn->close_after_output && !buffers->output.full())
+  {
+    if(!slot->backlog.empty() && !conn->acquire_read_buffer())
+    {
+      wait_for_buffer(slot);
+      break;
+    }
+    if(!slot->backlog.empty() && buffers->read_space() > 0)
+    {
+      size_t n = std::min(slot->backlog.size(), buffers->read_space());
+      memcpy(buffers->read_buffer + buffers->read_end, slot->backlog.data(), n);
+      buffers->read_end += n;
+      slot->backlog.erase(0, n);
+    }
+
+    if(conn->body_remaining > 0)  // 丢弃上一个请求未读取的请求体
+    {
+      size_t skip = std::min(conn->body_remaining, buffers->read_end - buffers->read_start);
+      buffers->read_start += skip;
+      conn->body_remaining -= skip;
+      if(conn->body_remaining > 0)
+      {
+        buffers->read_start = buffers->read_end = 0;
+        if(slot->backlog.empty())
+          break;
+        continue;
+      }
+    }
+
+    if(buffers->read_buffer == nullptr)  // 读缓冲区已经还给池，没有未处理的数据
+      break;
+    http::HttpParser::ParseResult r =
+      buffers->parser.parse(buffers->read_buffer + buffers->read_start, buffers->read_end - buffers->read_start);
+    if(r == http::HttpParser::PARSE_AGAIN)
+    {
+      buffers->compact();
+      if(buffers->read_space() == 0)  // 请求头填满了读缓冲区
+      {
+        send_error(slot, 431, false);
+        conn->close_after_output = true;
+        break;
+      }
+      if(slot->backlog.empty())
+        break;
+      continue;
+    }
+    if(r == http::HttpParser::PARSE_ERROR)
+    {
+      DEBUG("bad request: %d\n", buffers->parser.error_code());
+      send_error(slot, buffers->parser.error_code(), false);
+      conn->close_after_output = true;
+      break;
+    }
+
+    ConnState state = serve_request(slot, buffers->parser.request());
+    if(state == CONN_DEFER)  // 解析结果和缓冲区留给线程池中的工作，前面的响应继续发送
+      break;
+    finish_request(conn);
+    if(state == CONN_CLOSE)
+      conn->close_after_output = true;
+  }
+  if(slot->closing)
+    return;
+
+  if(!buffers->output.empty())
+  {
+    if(!slot->send_armed && !slot->read_armed)
+      pump_output(slot);
+    if(!slot->deferred)
+      release_idle(slot);  // 只剩响应要发送，读缓冲区先还给池
+    return;
+  }
+  if(slot->deferred)
+    return;
+  if(conn->close_after_output || slot->peer_closed)
+  {
+    close_client(slot);
+    return;
+  }
+  if(slot->recv_paused && slot->backlog.empty())
+  {
+    slot->recv_paused = false;
+    if(!slot->recv_armed)
+      arm_recv(slot);
+  }
+  release_idle(slot);
+  rearm_timer(slot);
+}
+
+/**
+ * @brief 等待请求时按连接所处的阶段设置超时：请求头、请求体或空闲长连接
+ *
+ * @param slot
+ */
+void TcpUringServer::rearm_timer(Slot *slot)
+{
+  http::HttpConnection *conn = &slot->conn;
+  int64_t now = timer_tick::now_ms();
+  int64_t deadline;
+  if(conn->body_remaining > 0)
+    deadline = now + body_timeout_;
+  else if(conn->input_pending() || conn->requests == 0)
+  {
+    if(conn->header_deadline == 0)
+      conn->header_deadline = now + header_timeout_;
+    deadline = conn->header_deadline;
+  }
+  else
+    deadline = now + keep_alive_timeout_;
+  client_timers_queue_.del_timer(&conn->timer);
+  conn->timer.set_overtime(deadline);
+  client_timers_queue_.add_timer(&conn->timer);
+}
+
+/**
+ * @brief 应答完一个请求后从读缓冲区中移除它，准备解析下一个请求
+ *
+ * @param conn
+ */
+void TcpUringServer::finish_request(http::HttpConnection *conn)
+{
+  http::ConnectionBuffers *buffers = conn->buffers;
+  buffers->read_start += buffers->parser.consumed();
+  conn->header_deadline = 0;
+  conn->body_remaining = buffers->parser.request().content_length;
+  buffers->parser.reset();
+  if(buffers->read_start == buffers->read_end)
+    buffers->read_start = buffers->read_end = 0;
+}
+
+/**
+ * @brief 应答一个请求。内容缓存命中时直接加入发送队列；否则转交给线程池的 IO 通道打开、读取文件，reactor 线程不阻塞在磁盘上
+ *
+ * @param slot
+ * @param request
+ * @return CONN_READ 响应已加入队列；CONN_DEFER 已转交；CONN_CLOSE 队列发完后关闭
+ */
+TcpUringServer::ConnState TcpUringServer::serve_request(Slot *slot, const http::HttpRequest &request)
+{
+  http::HttpConnection *conn = &slot->conn;
+  ++requests_;
+  bool keep_alive = request.keep_alive && !request.chunked;  // 不支持分块编码的请求体，应答后关闭连接
+  if(++conn->requests >= keep_alive_requests_)
+    keep_alive = false;
+
+  if(!request.method.equals("GET"))
+  {
+    if(!request.method.equals("POST"))
+      return send_error(slot, 501, false);
+    return CONN_CLOSE;  // POST method is not supported yet
+  }
+
+  char *url;
+  size_t url_len = request_path(conn, request, &url);
+  if(url_len == 0)
+    return send_error(slot, 400, false);
+  if(url_len == static_cast<size_t>(-1))
+    return send_error(slot, 414, false);
+
+  time_t now = time(NULL);
+  if(negative_cache_->contains(url, url_len, now))
+    return send_error(slot, 404, keep_alive);
+
+  bool stale = false;
+  cache::ContentPtr content = content_cache_->find(url, url_len, now, &stale);
+  if(content && !stale)
+    return content_serve(slot, content, request.minor_version, keep_alive);
+
+  client_timers_queue_.del_timer(&conn->timer);  // 处理期间不计超时
+  conn->defer_keep_alive = keep_alive;
+  slot->defer_url = url;  // 在 arena 中，转交期间 arena 不会 reset
+  slot->defer_url_len = url_len;
+  slot->deferred = true;
+  ++slot->pending;  // 工作交回之前槽位不能复用
+  if(add_task_to_pool(std::bind(&TcpUringServer::resolve_request, this, slot), LANE_IO) == FAILED)
+  {
+    slot->deferred = false;
+    --slot->pending;
+    return send_error(slot, 503, false);
+  }
+  return CONN_DEFER;
+}
+
+/**
+ * @brief 从请求目标中取出路径，规范化到从连接 arena 分配的缓冲区中
+ *
+ * @param conn
+ * @param request
+ * @param url 输出，规范化后的路径
+ * @return 路径长度；".." 越过文档根目录返回0；路径过长返回 (size_t)-1
+ */
+size_t TcpUringServer::request_path(http::HttpConnection *conn, const http::HttpRequest &request, char **url)
+{
+  const char *target = request.target.data;
+  const char *query = static_cast<const char*>(memchr(target, '?', request.target.len));
+  size_t url_len = query ? query - target : request.target.len;
+  if(url_len >= BUFSIZ)
+    return static_cast<size_t>(-1);
+  size_t url_size = url_len + 3;  // 规范化可能在开头补一个'/'，每段之后先写'/'，最后是'\0'
+  *url = static_cast<char*>(conn->buffers->arena.allocate(url_size));
+  return http::normalize_path(target, url_len, *url, url_size);
+}
+
+/**
+ * @brief 线程池 IO 通道中执行的工作：打开文件、校验或载入内容缓存，把结果留在槽位中，连接交回 reactor 后再加入发送队列。
+ *        转交期间 reactor 不访问连接的解析器和读缓冲区中的请求
+ *
+ * @param slot
+ */
+void TcpUringServer::resolve_request(Slot *slot)
+{
+  const char *url = slot->defer_url;
+  size_t url_len = slot->defer_url_len;
+  time_t now = time(NULL);
+
+  slot->defer_status = 0;
+  uint64_t generation = negative_cache_->generation();
+  cache::OpenFilePtr file = open_files_->open(url, url_len, now);
+  if(!file)
+  {
+    negative_cache_->insert(url, url_len, now, generation);
+    slot->defer_status = 404;
+  }
+  else
+  {
+    bool stale = false;
+    cache::ContentPtr content = content_cache_->find(url, url_len, now, &stale);
+    if(content && !content->same_file(*file))
+    {
+      content_cache_->erase(url, url_len);
+      content.reset();
+    }
+    else if(content)
+      content->validated.store(now, std::memory_order_relaxed);
+
+    if(!content && file->executable())
+      slot->defer_status = -1;  // CGI 还没有实现，与 epoll 后端一样直接关闭
+    else if(!content && content_cache_->cacheable(file->size))
+    {
+      content = cache::CachedContent::load(*file, http::mime_type(file->path.c_str()));
+      if(content)
+        content_cache_->insert(url, url_len, content);
+    }
+
+    if(slot->defer_status == 0)
+    {
+      if(content)
+        slot->defer_content = content;
+      else
+        slot->defer_file = file;
+    }
+  }
+
+  {
+    my_mutex::MutexLockGuard lock(ready_mutex_);
+    ready_.push_back(slot->conn.fd);
+  }
+  uint64_t u = 1;
+  if(write(wake_fd_, &u, sizeof(uint64_t)) != sizeof(uint64_t))
+    WARN("wake eventfd write error");
+}
+
+/**
+ * @brief 把响应加入发送队列：首部和缓存的文件内容
+ */
+void TcpUringServer::set_content(http::HttpConnection *conn, const cache::ContentPtr &content, int minor_version, bool keep_alive)
+{
+  http::ConnectionBuffers *buffers = conn->buffers;
+  http::ResponseBuilder response(&buffers->arena, minor_version, 200, "OK");
+  response.add_header("Content-Type", content->content_type);
+  response.add_header("Content-Length", content->data.size());
+  response.add_keep_alive(keep_alive);
+  buffers->output.append_arena(response.head(), response.head_len());
+  buffers->output.append_content(content, 0, content->data.size());
+}
+
+/**
+ * @brief 把响应加入发送队列：首部和整个文件，文件内容按块读入后发送
+ */
+void TcpUringServer::set_file(http::HttpConnection *conn, const cache::OpenFilePtr &file, int minor_version, bool keep_alive)
+{
+  size_t content_length = static_cast<size_t>(file->size);
+  http::ConnectionBuffers *buffers = conn->buffers;
+  http::ResponseBuilder response(&buffers->arena, minor_version, 200, "OK");
+  response.add_header("Content-Type", http::mime_type(file->path.c_str()));
+  response.add_header("Content-Length", content_length);
+  response.add_keep_alive(keep_alive);
+  buffers->output.append_arena(response.head(), response.head_len());
+  buffers->output.append_file(file, 0, content_length);
+}
+
+/**
+ * @brief 从内存发送缓存的文件内容
+ *
+ * @return 保持连接返回CONN_READ，否则返回CONN_CLOSE
+ */
+TcpUringServer::ConnState TcpUringServer::content_serve(Slot *slot, const cache::ContentPtr &content,
+                                                        int minor_version, bool keep_alive)
+{
+  set_content(&slot->conn, content, minor_version, keep_alive);
+  return keep_alive ? CONN_READ : CONN_CLOSE;
+}
+
+/**
+ * @brief 发送预先生成的错误响应
+ *
+ * @return 保持连接返回CONN_READ，否则返回CONN_CLOSE
+ */
+TcpUringServer::ConnState TcpUringServer::send_error(Slot *slot, int status_code, bool keep_alive)
+{
+  http::append_canned_response(&slot->conn.buffers->output, status_code, keep_alive);
+  return keep_alive ? CONN_READ : CONN_CLOSE;
+}
+
+/**
+ * @brief 发送队列中的数据：队首连续的内存段（首部、缓存的内容、错误响应）合并成一个 sendmsg，
+ *        MSG_WAITALL 让内核在套接字缓冲区满时自己重试，不返回部分发送。紧跟的文件区间同时开始 splice 进管道，
+ *        内存段发完后再从管道 splice 到套接字（见 fill_pipe()、drain_pipe()）。
+ *        队列的最后一次发送如果之后关闭连接，链接一个 close，发送完成后直接关闭固定文件；
+ *        文件区间可能只发出一部分，最后是文件时发完后由 process() 关闭
+ *
+ * @param slot
+ */
+void TcpUringServer::pump_output(Slot *slot)
+{
+  http::HttpConnection *conn = &slot->conn;
+  http::OutputQueue *output = &conn->buffers->output;
+  size_t bytes;
+  const http::OutputQueue::Segment *file;
+  int iovcnt = output->fill_iov(slot->iov, http::OutputQueue::MAX_IOV, &bytes, &file);
+  bool sent;
+  if(iovcnt == 0 && file != nullptr)  // 队首是文件区间
+    sent = slot->piped == 0 ? fill_pipe(slot, file) : drain_pipe(slot);
+  else
+  {
+    sent = send_output(slot, iovcnt, bytes);
+    if(sent && file != nullptr && slot->piped == 0)  // 首部发送的同时把文件的第一部分 splice 进管道
+      sent = fill_pipe(slot, file);
+  }
+  if(!sent)  // 已经关闭
+    return;
+
+  client_timers_queue_.del_timer(&conn->timer);  // 每次发送都重新计算发送超时，慢速但一直在读的客户端不会被关闭
+  conn->timer.set_overtime(timer_tick::now_ms() + send_timeout_);
+  client_timers_queue_.add_timer(&conn->timer);
+}
+
+/**
+ * @brief 用一个 sendmsg 发送队首的内存段
+ *
+ * @param slot
+ * @param iovcnt slot->iov 中填好的段数
+ * @param bytes 这些段的总字节数
+ * @return 无法提交、连接已经关闭返回false
+ */
+bool TcpUringServer::send_output(Slot *slot, int iovcnt, size_t bytes)
+{
+  http::HttpConnection *conn = &slot->conn;
+  http::OutputQueue *output = &conn->buffers->output;
+  bool link_close = conn->close_after_output && bytes == output->bytes();
+  if(link_close && slot->recv_armed)
+    cancel_op(slot, OP_RECV);  // recv 持有文件引用，不取消的话 close 之后套接字也不会真正关闭
+  struct io_uring_sqe *sqe = get_sqe(OP_SEND, conn->fd);
+  if(sqe == nullptr)
+  {
+    close_client(slot);
+    return false;
+  }
+  slot->msg.msg_iovlen = iovcnt;
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = slot->file_index;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->addr = reinterpret_cast<uint64_t>(&slot->msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+  slot->send_armed = true;
+  ++slot->pending;
+  if(link_close)
+  {
+    struct io_uring_sqe *close_sqe = get_sqe(OP_CLOSE, conn->fd);
+    if(close_sqe != nullptr)
+    {
+      sqe->flags |= IOSQE_IO_LINK;  // send 成功后才执行 close；send 失败时 close 以 ECANCELED 完成
+      close_sqe->opcode = IORING_OP_CLOSE;
+      close_sqe->file_index = static_cast<uint32_t>(slot->file_index) + 1;
+      ++slot->pending;
+      slot->close_submitted = true;
+    }
+    slot->closing = true;
+  }
+  return true;
+}
+
+/**
+ * @brief 关闭连接：取消连接上在途的 recv 和 send，全部完成后关闭固定文件，close 完成后槽位放回空闲链表
+ *
+ * @param slot
+ */
+void TcpUringServer::close_client(Slot *slot)
+{
+  client_timers_queue_.del_timer(&slot->conn.timer);
+  if(slot->close_done)
+    return;
+  if(slot->recv_armed)
+    cancel_op(slot, OP_RECV);
+  if(slot->send_armed)
+  {
+    if(slot->send_piped)
+      cancel_op(slot, OP_POLL);  // 取消 poll，链接的 splice 随之以 ECANCELED 完成
+    cancel_op(slot, OP_SEND);
+  }
+  slot->closing = true;
+  try_close(slot);
+}
+
+/**
+ * @brief 正在关闭的连接：没有在途的请求时提交 close；close 已完成时释放槽位
+ *
+ * @param slot
+ */
+void TcpUringServer::try_close(Slot *slot)
+{
+  if(slot->pending > 0)
+    return;
+  if(slot->close_done)
+  {
+    release_slot(slot);
+    return;
+  }
+  if(slot->close_submitted)
+    return;
+  struct io_uring_sqe *sqe = get_sqe(OP_CLOSE, slot->conn.fd);
+  if(sqe == nullptr)
+    return;
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = static_cast<uint32_t>(slot->file_index) + 1;  // 关闭固定文件表中的槽位
+  ++slot->pending;
+  slot->close_submitted = true;
+}
+
+/**
+ * @brief 客户端超时回调函数
+ *
+ * @param overtime_timer
+ */
+void TcpUringServer::client_overtime_cb(timer_tick::Timer* overtime_timer)
+{
+  Slot *slot = slots_.get(overtime_timer->fd());
+  if(slot->deferred)  // 转交期间不计超时，定时器应该已经删除
+    return;
+  close_client(slot);
+}
+
+} // namespace http_server
@@ -0,0 +1,210 @@
+/**
+ * @file TcpUringServer.h
+ * @author zX
+ * @brief Use io_uring to handle client request.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef TCPURINGSERVER_H_
+#define TCPURINGSERVER_H_
+#include "TcpServer.h"
+#include "parameters.h"
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include <my_mutex.h>
+#include <my_uring.h>
+#include <timer_tick.h>
+#include <timer_queue.h>
+#include <http_connection.h>
+#include <connection_table.h>
+#include <open_file_cache.h>
+#include <content_cache.h>
+#include <negative_cache.h>
+
+namespace http_server
+{
+
+class ThreadPool;
+
+/**
+ * @brief io_uring 后端。每个reactor一个 io_uring：监听套接字上一个多次触发的 accept 直接分配固定文件（直接描述符），
+ *        每个连接一个多次触发的 recv 从提供的缓冲区环中取缓冲区，响应用 sendmsg 发送，最后一个响应和 close 链接在一起。
+ *        缓存未命中的大文件用 splice 经过管道发送：文件到管道、等套接字可写后管道到套接字，数据不经过用户空间。
+ *        一轮循环只调用一次 io_uring_enter：提交上一轮产生的所有 SQE 并等待完成事件，连接越多每个请求分摊的系统调用越少。
+ *        内容缓存命中的请求在 reactor 线程中直接应答；需要打开、读取文件的请求交给线程池的 IO 通道，完成后通过 eventfd 交回。
+ */
+class TcpUringServer : public TcpServer
+{
+public:
+  TcpUringServer(ThreadPool* pool, parameters::Parameters* parameters, cache::ContentCache* content_cache,
+                 cache::OpenFileCache* open_files, cache::NegativeCache* negative_cache);
+
+  virtual ~TcpUringServer();
+
+  /*
+  *@brief 内核是否支持本后端需要的 io_uring 功能（多次触发的 recv、提供的缓冲区环、直接描述符）
+  */
+  static bool supported();
+
+  virtual void handle_request() override;
+
+  // 连接的事件由 io_uring 上的请求表示，没有单独的注册步骤
+  virtual void add_event(int /*fd*/, int /*event_type*/) override {}
+
+  virtual void del_event(int /*fd*/, int /*event_type*/) override {}
+
+  virtual void mod_event(int /*fd*/, int /*event_type*/) override {}
+
+  // 实现 TcpServer 的纯虚接口，reactor 内部直接调用 process()
+  virtual void client_service(int client_fd) override;
+
+  static void sig_int_handle(int sig);
+
+  static const int MAX_FILE_TABLE = 1 << 20;  // 内核允许的固定文件表大小上限（IORING_MAX_FIXED_FILES）
+  static const unsigned RING_ENTRIES = 4096;
+  static const unsigned BUFFER_NUM = 1024;  // 提供的接收缓冲区个数，必须是2的幂
+  static const unsigned BUFFER_SIZE = 4096;
+  static const size_t PIPE_SIZE = 64 * 1024;  // 大文件每次 splice 进管道的字节数，不超过管道的默认容量
+  static const size_t MAX_FREE_PIPES = 64;  // 空闲管道最多保留的个数，多出的关闭
+  static const size_t BACKLOG_LIMIT = 64 * 1024;  // 读缓冲区放不下的数据超过它时暂停接收
+  static const int PAUSE_RETRY_MS = 10;  // 有等待接收缓冲区的连接时检查接收缓冲区池的间隔，毫秒
+
+private:
+  // user_data 的高8位是操作类型，低位是连接槽位编号
+  // OP_DROP：没有空闲槽位时直接关闭新连接的直接描述符，完成事件不需要处理
+  // OP_READ：文件 splice 进管道；OP_POLL：管道 splice 到套接字之前等待可写，和 OP_SEND 链接在一起
+  enum Op { OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_READ, OP_CLOSE, OP_CANCEL, OP_WAKE, OP_SIGNAL, OP_WATCH, OP_DROP, OP_POLL };
+
+  enum ConnState { CONN_CLOSE, CONN_READ, CONN_WRITE, CONN_DEFER };
+
+  /**
+   * @brief splice 用的管道，由 reactor 复用：连接发送文件区间时取一个，管道中的数据发完后放回
+   */
+  struct Pipe
+  {
+    int read_fd;
+    int write_fd;
+  };
+
+  /**
+   * @brief 连接槽位。HttpConnection 的 fd 字段是槽位编号，file_index 是内核分配的直接描述符。
+   *        槽位上所有在途的请求完成（pending 为0）并且 close 完成后才放回空闲链表，
+   *        所以迟到的完成事件不会落到新连接上。
+   */
+  struct Slot : public boost::noncopyable
+  {
+    explicit Slot(int id);
+    ~Slot();
+
+    http::HttpConnection conn;
+    int file_index;
+    int pending;  // 在途的请求数（多次触发的 recv 算一个）和转交给线程池的工作
+    bool recv_armed;  // 多次触发的 recv 在途
+    bool recv_paused;  // backlog 超过上限或接收缓冲区池用完，暂停接收
+    bool buffer_wait;  // 在 paused_ 中等待接收缓冲区
+    bool send_armed;
+    bool read_armed;
+    bool deferred;  // 请求在线程池中打开、读取文件，后面的流水线请求等它交回
+    bool peer_closed;  // 对端已经关闭写方向，处理完已收到的请求后关闭
+    bool closing;
+    bool close_submitted;
+    bool close_done;
+    int defer_status;  // 线程池的处理结果：0 响应数据在 defer_content 或 defer_file 中，>0 错误状态码，<0 关闭连接
+    const char *defer_url;  // 转交的请求规范化后的路径
+    size_t defer_url_len;
+    cache::ContentPtr defer_content;  // 线程池不直接修改发送队列（reactor 可能正在发送），由 reactor 交回时加入
+    cache::OpenFilePtr defer_file;  // on_wake() 取走结果后、调用 process() 之前清空，process() 可能再次转交
+    std::string backlog;  // 读缓冲区放不下、或转交期间收到的数据
+    Pipe pipe;  // 发送文件区间时持有的管道，没有时 read_fd 为-1
+    size_t piped;  // 已经 splice 进管道、还没有发到套接字的字节数
+    bool send_piped;  // 在途的发送是从管道 splice 到套接字，而不是 sendmsg
+    struct iovec iov[http::OutputQueue::MAX_IOV + 1];
+    struct msghdr msg;
+  };
+
+  static uint64_t user_data(Op op, int id) { return (static_cast<uint64_t>(op) << 56) | static_cast<uint32_t>(id); }
+
+  struct io_uring_sqe* get_sqe(Op op, int id);
+
+  void arm_accept();
+  void arm_recv(Slot *slot);
+  void arm_wake();
+  void arm_watch(int watch_fd);
+  void cancel_op(Slot *slot, Op op);
+
+  void handle_cqe(struct io_uring_cqe *cqe);
+  void on_accept(struct io_uring_cqe *cqe);
+  void on_recv(Slot *slot, struct io_uring_cqe *cqe);
+  void append_input(Slot *slot, const char *data, size_t len);
+  void on_send(Slot *slot, int res);
+  void on_read(Slot *slot, int res);
+  bool acquire_pipe(Slot *slot);
+  void release_pipe(Slot *slot);
+  bool fill_pipe(Slot *slot, const http::OutputQueue::Segment *file);
+  bool drain_pipe(Slot *slot);
+  void on_wake();
+  void op_done(Slot *slot);
+  void release_idle(Slot *slot);
+  void wait_for_buffer(Slot *slot);
+  void resume_paused();
+
+  Slot* acquire_slot();
+  void release_slot(Slot *slot);
+
+  void process(Slot *slot);
+  void rearm_timer(Slot *slot);
+  void finish_request(http::HttpConnection *conn);
+  ConnState serve_request(Slot *slot, const http::HttpRequest &request);
+  static size_t request_path(http::HttpConnection *conn, const http::HttpRequest &request, char **url);
+  void resolve_request(Slot *slot);
+  static void set_content(http::HttpConnection *conn, const cache::ContentPtr &content, int minor_version, bool keep_alive);
+  static void set_file(http::HttpConnection *conn, const cache::OpenFilePtr &file, int minor_version, bool keep_alive);
+  ConnState content_serve(Slot *slot, const cache::ContentPtr &content, int minor_version, bool keep_alive);
+  ConnState send_error(Slot *slot, int status_code, bool keep_alive);
+  void pump_output(Slot *slot);
+  bool send_output(Slot *slot, int iovcnt, size_t bytes);
+  void close_client(Slot *slot);
+  void try_close(Slot *slot);
+  void client_overtime_cb(timer_tick::Timer* overtime_timer);
+
+  my_uring::BufferRing buffers_;  // 在 ring_ 之后析构，ring_ 关闭前缓冲区一直有效
+  my_uring::Ring ring_;
+  bool accept_armed_;
+
+  int keep_alive_timeout_;  // 长连接空闲超时时间，毫秒
+  int header_timeout_;  // 读取请求头的超时时间，毫秒
+  int body_timeout_;  // 读取请求体的超时时间，毫秒
+  int send_timeout_;  // 发送一个响应的超时时间，毫秒
+  int keep_alive_requests_;  // 每个长连接最多处理的请求数
+
+  cache::ContentCache *content_cache_;  // 所有reactor共享的静态内容缓存
+  cache::OpenFileCache *open_files_;  // 所有reactor共享的打开文件和元数据缓存
+  cache::NegativeCache *negative_cache_;  // 所有reactor共享的不存在路径缓存
+
+  static int efd_;  // SIGINT 通知退出的 eventfd
+  int wake_fd_;  // 线程池交回连接时唤醒本 reactor 的 eventfd
+  uint64_t wake_value_;  // wake_fd_ 上 read 的目标
+
+  my_mutex::MutexLock ready_mutex_;
+  std::vector<int> ready_;  // 线程池处理完、等待 reactor 发送响应的连接槽位，由 ready_mutex_ 保护
+
+  timer_tick::TimerQueue client_timers_queue_;  // 客户端定时器队列（时间轮）
+  int file_table_size_;  // 固定文件表的大小，即本reactor的最大连接数，按打开文件数的限制确定
+  http::ConnectionTable<Slot> slots_;  // 连接槽位，按编号索引，按页分配
+  int slot_num_;  // 已经使用过的编号个数，新槽位取下一个编号
+  std::vector<int> free_slots_;
+  std::vector<int> paused_;  // 因接收缓冲区池用完而暂停接收的连接槽位，按暂停的先后
+  std::vector<Pipe> free_pipes_;  // 空的管道，最多 MAX_FREE_PIPES 个
+
+  uint64_t requests_;  // 处理的请求数，退出时与 io_uring_enter 的次数一起输出
+};
+
+} // namespace http_server
+
+
+#endif // TCPURINGSERVER_H_
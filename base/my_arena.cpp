@@ -0,0 +1,204 @@
+/**
+ * @file my_arena.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "my_arena.h"
+#include <stdlib.h>
+#include <atomic>
+
+namespace my_arena
+{
+
+static std::atomic<size_t> arena_large_allocs(0);
+static std::atomic<size_t> arena_high_water(0);
+
+ChunkPool& ChunkPool::instance()
+{
+  static ChunkPool pool;
+  return pool;
+}
+
+ChunkPool::ChunkPool()
+  : free_(nullptr),
+    chunks_(0),
+    free_num_(0)
+{
+}
+
+ChunkPool::~ChunkPool()
+{
+  for(size_t i = 0; i < slabs_.size(); ++i)
+    delete[] slabs_[i];
+}
+
+/**
+ * @brief 取一个块，空闲链表为空时申请一个新的 slab
+ *
+ * @return CHUNK_SIZE 字节、按 Arena::ALIGN 对齐的块
+ */
+void* ChunkPool::get()
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  if(free_ == nullptr)
+  {
+    char *slab = new char[CHUNK_SIZE * SLAB_CHUNKS];  // new char[] 按 max_align_t 对齐，块大小是对齐的倍数
+    slabs_.push_back(slab);
+    for(int i = SLAB_CHUNKS - 1; i >= 0; --i)
+      put_locked(slab + i * CHUNK_SIZE);
+    chunks_ += SLAB_CHUNKS;
+  }
+  FreeChunk *chunk = free_;
+  free_ = chunk->next;
+  --free_num_;
+  return chunk;
+}
+
+void ChunkPool::put(void *chunk)
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  put_locked(chunk);
+}
+
+void ChunkPool::put_locked(void *chunk)
+{
+  FreeChunk *free_chunk = static_cast<FreeChunk*>(chunk);
+  free_chunk->next = free_;
+  free_ = free_chunk;
+  ++free_num_;
+}
+
+size_t ChunkPool::chunks()
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  return chunks_;
+}
+
+size_t ChunkPool::free_chunks()
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  return free_num_;
+}
+
+Arena::Arena()
+  : chunks_(nullptr),
+    current_(nullptr),
+    ptr_(nullptr),
+    end_(nullptr),
+    large_(nullptr),
+    used_(0),
+    high_water_(0)
+{
+}
+
+Arena::~Arena()
+{
+  release();
+}
+
+void* Arena::allocate(size_t size)
+{
+  size = (size + ALIGN - 1) & ~(ALIGN - 1);
+  if(size > static_cast<size_t>(end_ - ptr_))
+  {
+    if(size > ChunkPool::CHUNK_SIZE - HEADER_SIZE)
+      return allocate_large(size);
+    Block *block = static_cast<Block*>(ChunkPool::instance().get());
+    block->next = nullptr;
+    if(current_ == nullptr)
+      chunks_ = block;
+    else
+      current_->next = block;
+    current_ = block;
+    ptr_ = reinterpret_cast<char*>(block) + HEADER_SIZE;
+    end_ = reinterpret_cast<char*>(block) + ChunkPool::CHUNK_SIZE;
+  }
+  void *p = ptr_;
+  ptr_ += size;
+  used_ += size;
+  return p;
+}
+
+void* Arena::allocate_large(size_t size)
+{
+  Block *block = static_cast<Block*>(malloc(HEADER_SIZE + size));
+  if(block == nullptr)
+    return nullptr;
+  block->next = large_;
+  large_ = block;
+  used_ += size;
+  arena_large_allocs.fetch_add(1, std::memory_order_relaxed);
+  return reinterpret_cast<char*>(block) + HEADER_SIZE;
+}
+
+void Arena::shrink(void *last, size_t size)
+{
+  char *p = static_cast<char*>(last);
+  if(current_ == nullptr || p < reinterpret_cast<char*>(current_) + HEADER_SIZE || p > ptr_)
+    return;  // 不是当前块中的分配（malloc 的大块）
+  char *new_end = p + ((size + ALIGN - 1) & ~(ALIGN - 1));
+  if(new_end >= ptr_)
+    return;
+  used_ -= ptr_ - new_end;
+  ptr_ = new_end;
+}
+
+void Arena::reset()
+{
+  if(used_ > high_water_)
+  {
+    high_water_ = used_;
+    size_t global = arena_high_water.load(std::memory_order_relaxed);
+    while(used_ > global && !arena_high_water.compare_exchange_weak(global, used_, std::memory_order_relaxed))
+    {
+    }
+  }
+  used_ = 0;
+
+  while(large_ != nullptr)
+  {
+    Block *next = large_->next;
+    free(large_);
+    large_ = next;
+  }
+  if(chunks_ == nullptr)
+    return;
+  Block *block = chunks_->next;
+  while(block != nullptr)
+  {
+    Block *next = block->next;
+    ChunkPool::instance().put(block);
+    block = next;
+  }
+  chunks_->next = nullptr;
+  current_ = chunks_;
+  ptr_ = reinterpret_cast<char*>(chunks_) + HEADER_SIZE;
+  end_ = reinterpret_cast<char*>(chunks_) + ChunkPool::CHUNK_SIZE;
+}
+
+void Arena::release()
+{
+  reset();
+  if(chunks_ == nullptr)
+    return;
+  ChunkPool::instance().put(chunks_);
+  chunks_ = current_ = nullptr;
+  ptr_ = end_ = nullptr;
+}
+
+Arena::Stats Arena::stats()
+{
+  Stats stats;
+  stats.chunks = ChunkPool::instance().chunks();
+  stats.free_chunks = ChunkPool::instance().free_chunks();
+  stats.large_allocs = arena_large_allocs.load(std::memory_order_relaxed);
+  stats.high_water = arena_high_water.load(std::memory_order_relaxed);
+  return stats;
+}
+
+} // namespace my_arena
@@ -0,0 +1,131 @@
+/**
+ * @file my_arena.h
+ * @author zX
+ * @brief per connection bump allocator backed by a global chunk pool
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef MY_ARENA_H_
+#define MY_ARENA_H_
+
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <vector>
+#include <my_mutex.h>
+
+namespace my_arena
+{
+
+/**
+ * @brief 全局的固定大小内存块池。块从一次申请 SLAB_CHUNKS 个块的大块（slab）中切出，放回后进入空闲链表，不还给系统。
+ *        连接的 Arena 只在第一次分配、用完一个块和连接关闭时访问块池，每个请求都不需要 malloc
+ */
+class ChunkPool : public boost::noncopyable
+{
+public:
+  static const size_t CHUNK_SIZE = 4096;
+  static const int SLAB_CHUNKS = 64;
+
+  static ChunkPool& instance();
+
+  void* get();
+
+  void put(void *chunk);
+
+  size_t chunks();  // 已切出的块数
+
+  size_t free_chunks();  // 空闲链表中的块数
+
+private:
+  ChunkPool();
+  ~ChunkPool();
+
+  void put_locked(void *chunk);
+
+  struct FreeChunk
+  {
+    FreeChunk *next;
+  };
+
+  my_mutex::MutexLock mutex_;
+  FreeChunk *free_;
+  size_t chunks_;
+  size_t free_num_;
+  std::vector<char*> slabs_;
+};
+
+/**
+ * @brief 连接的请求/响应临时内存。分配只移动当前块中的指针，不单独释放；请求处理完、发送队列发空时 reset() 整体回收，
+ *        只保留第一个块，下一个请求直接复用。超过一个块的分配用 malloc，reset() 时释放，计入 large_allocs。
+ *        同一时刻只能由持有连接的线程使用
+ */
+class Arena : public boost::noncopyable
+{
+public:
+  static const size_t ALIGN = 16;
+
+  /*
+  *@brief 所有连接共享的统计，只在慢路径上更新
+  */
+  struct Stats
+  {
+    size_t chunks;  // 块池切出的块数
+    size_t free_chunks;  // 块池中空闲的块数
+    size_t large_allocs;  // 超过一个块、用 malloc 分配的次数
+    size_t high_water;  // 所有连接中两次 reset 之间用到的最多字节数
+  };
+
+  Arena();
+  ~Arena();
+
+  /*
+  *@brief 分配 size 字节，按 ALIGN 对齐
+  */
+  void* allocate(size_t size);
+
+  /*
+  *@brief 最近一次分配只用到前 size 字节，把剩余部分还给当前块
+  */
+  void shrink(void *last, size_t size);
+
+  /*
+  *@brief 回收所有分配，保留第一个块。之前分配的内存全部失效
+  */
+  void reset();
+
+  /*
+  *@brief 回收所有分配，所有块放回块池（连接关闭）
+  */
+  void release();
+
+  size_t used() const { return used_; }
+
+  size_t high_water() const { return high_water_; }
+
+  static Stats stats();
+
+private:
+  struct Block
+  {
+    Block *next;
+  };
+
+  static const size_t HEADER_SIZE = (sizeof(Block) + ALIGN - 1) & ~(ALIGN - 1);
+
+  void* allocate_large(size_t size);
+
+  Block *chunks_;  // 第一个块，块之间用块头中的 next 链接
+  Block *current_;
+  char *ptr_;
+  char *end_;
+  Block *large_;  // malloc 的大块
+  size_t used_;  // 本次 reset 之后分配的字节数
+  size_t high_water_;
+};
+
+} // namespace my_arena
+
+#endif // MY_ARENA_H_
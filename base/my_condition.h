@@ -58,6 +58,18 @@ public:
     pthread_cond_wait(&pcond_, mutex_.getPthreadMutex());
   }
 
+  /*
+  *@brief 阻塞直到 pred() 为真。在持有互斥锁时检查条件，notify() 也要获取同一把锁，
+  *       所以检查条件与开始等待之间不会错过通知；虚假唤醒后重新检查
+  */
+  template <class Predicate>
+  void wait(Predicate pred)
+  {
+    MutexLockGuard lg(mutex_);
+    while(!pred())
+      pthread_cond_wait(&pcond_, mutex_.getPthreadMutex());
+  }
+
   /* 
    * @brief 判断等待超时函数。
    * @param 当前线程阻塞条件变量等待时间参数double seconds
@@ -0,0 +1,163 @@
+/**
+ * @file my_eventcount.h
+ * @author zX
+ * @brief futex based event count for parking idle threads
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef MY_EVENTCOUNT_H_
+#define MY_EVENTCOUNT_H_
+
+#include <boost/noncopyable.hpp>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+
+namespace my_eventcount
+{
+
+/*@brief 自旋等待时降低CPU占用，让出流水线给同一核心上的另一个超线程*/
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * @brief 事件计数（eventcount），用于在“队列为空”这一条件上睡眠，不会丢失唤醒。
+ *        等待方：key = prepare_wait(); 再检查一次条件；条件满足则 cancel_wait()，否则 wait(key)。
+ *        通知方：先让条件成立（例如放入工作），再 notify_one()。
+ *        没有线程在等待时 notify_one() 只读一个原子变量，不进入内核。
+ */
+class EventCount : public boost::noncopyable
+{
+public:
+  EventCount() : epoch_(0), waiters_(0) {}
+
+  /*
+  *@brief 宣布准备睡眠，返回当前的事件序号。之后必须再检查一次条件
+  */
+  uint32_t prepare_wait()
+  {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);  // 与通知方的栅栏配对：要么通知方看到等待者，要么这里看到条件成立
+    return epoch_.load(std::memory_order_acquire);
+  }
+
+  /*
+  *@brief 检查发现条件已经成立，取消睡眠
+  */
+  void cancel_wait()
+  {
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  /*
+  *@brief 睡眠直到 prepare_wait() 之后有通知
+  */
+  void wait(uint32_t key)
+  {
+    while(epoch_.load(std::memory_order_acquire) == key)
+      futex(FUTEX_WAIT_PRIVATE, key);  // 序号已变化时内核立即返回EAGAIN
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  /*
+  *@brief 最多睡眠 timeout_ms 毫秒
+  *@return 被通知返回true，超时返回false（超时后 waiters() 已经减去本线程）
+  */
+  bool wait_for(uint32_t key, int timeout_ms)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    bool notified = true;
+    while(epoch_.load(std::memory_order_acquire) == key)
+    {
+      struct timespec now, left;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      left.tv_sec = deadline.tv_sec - now.tv_sec;
+      left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+      if(left.tv_nsec < 0)
+      {
+        left.tv_sec -= 1;
+        left.tv_nsec += 1000000000L;
+      }
+      if(left.tv_sec < 0)
+      {
+        notified = false;
+        break;
+      }
+      futex(FUTEX_WAIT_PRIVATE, key, &left);  // FUTEX_WAIT 的超时是相对时间
+    }
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+    return notified;
+  }
+
+  /*
+  *@brief 唤醒一个等待者
+  *@return 进行了唤醒（系统调用）返回true，没有等待者返回false
+  */
+  bool notify_one()
+  {
+    return notify(1);
+  }
+
+  /*
+  *@brief 唤醒所有等待者
+  */
+  bool notify_all()
+  {
+    return notify(INT_MAX);
+  }
+
+  /*
+  *@brief 已宣布睡眠、还没有醒来的线程数
+  */
+  int waiters() const
+  {
+    return waiters_.load(std::memory_order_relaxed);
+  }
+
+private:
+  bool notify(int count)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiters_.load(std::memory_order_relaxed) == 0)
+      return false;
+    epoch_.fetch_add(1, std::memory_order_release);  // 还没进入内核的等待者看到序号变化后不再睡眠
+    futex(FUTEX_WAKE_PRIVATE, count);
+    return true;
+  }
+
+  long futex(int op, uint32_t val, const struct timespec *timeout = nullptr)
+  {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), op, val, timeout, nullptr, 0);
+  }
+
+  std::atomic<uint32_t> epoch_;  // 每次通知加1，futex 在它上面等待
+  std::atomic<int> waiters_;
+};
+
+} // namespace my_eventcount
+
+#endif // MY_EVENTCOUNT_H_
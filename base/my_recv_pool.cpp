@@ -0,0 +1,203 @@
+/**
+ * @file my_recv_pool.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "my_recv_pool.h"
+#include <sys/mman.h>
+
+namespace my_recv_pool
+{
+
+/**
+ * @brief 线程的缓冲区缓存。线程退出时把缓存的缓冲区还给全局链表
+ */
+struct RecvBufferPool::ThreadCache
+{
+  ThreadCache() : count(0)
+  {
+    RecvBufferPool::instance();  // 先构造池，线程缓存在池之前析构
+  }
+
+  ~ThreadCache()
+  {
+    RecvBufferPool::instance().flush(this, 0);
+  }
+
+  char *buffers[THREAD_CACHE_SIZE];
+  int count;
+};
+
+RecvBufferPool& RecvBufferPool::instance()
+{
+  static RecvBufferPool pool;
+  return pool;
+}
+
+RecvBufferPool::ThreadCache& RecvBufferPool::thread_cache()
+{
+  static thread_local ThreadCache cache;
+  return cache;
+}
+
+RecvBufferPool::RecvBufferPool()
+  : free_(nullptr),
+    free_num_(0),
+    carve_(nullptr),
+    carve_end_(nullptr),
+    buffers_(0),
+    max_slabs_(0),
+    huge_pages_(false),
+    huge_slabs_(0),
+    peak_(0),
+    exhausted_(0),
+    pressure_(false)
+{
+}
+
+RecvBufferPool::~RecvBufferPool()
+{
+  for(size_t i = 0; i < slabs_.size(); ++i)
+    munmap(slabs_[i], SLAB_SIZE);
+}
+
+void RecvBufferPool::configure(size_t max_buffers, bool huge_pages)
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  max_slabs_ = (max_buffers + SLAB_BUFFERS - 1) / SLAB_BUFFERS;
+  huge_pages_ = huge_pages;
+}
+
+char* RecvBufferPool::get()
+{
+  ThreadCache &cache = thread_cache();
+  if(cache.count == 0 && refill(&cache) == 0)
+    return nullptr;
+  return cache.buffers[--cache.count];
+}
+
+void RecvBufferPool::put(char *buffer)
+{
+  ThreadCache &cache = thread_cache();
+  if(cache.count == THREAD_CACHE_SIZE)
+    flush(&cache, THREAD_CACHE_SIZE / 2);
+  cache.buffers[cache.count++] = buffer;
+  if(pressure_.load(std::memory_order_relaxed))
+    flush(&cache, 0);  // 有连接在等待缓冲区
+}
+
+size_t RecvBufferPool::available()
+{
+  size_t n = thread_cache().count;
+  my_mutex::MutexLockGuard lock(mutex_);
+  n += free_num_ + (carve_end_ - carve_) / BUFFER_SIZE;
+  if(max_slabs_ == 0)
+    n += SLAB_BUFFERS;
+  else if(slabs_.size() < max_slabs_)
+    n += (max_slabs_ - slabs_.size()) * SLAB_BUFFERS;
+  return n;
+}
+
+/**
+ * @brief 取最多 THREAD_CACHE_SIZE / 2 个缓冲区放入线程缓存：先取全局链表中放回的，再从当前 slab 中切出，slab 用完时映射新的。
+ *        有连接在等待缓冲区时只取一个，放回的缓冲区不会积在某个线程的缓存里
+ *
+ * @return 取到的个数，0 表示池已用完
+ */
+int RecvBufferPool::refill(ThreadCache *cache)
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  int batch = pressure_.load(std::memory_order_relaxed) ? 1 : THREAD_CACHE_SIZE / 2;
+  int n = 0;
+  while(n < batch && free_ != nullptr)
+  {
+    cache->buffers[n++] = reinterpret_cast<char*>(free_);
+    free_ = free_->next;
+    --free_num_;
+  }
+  while(n < batch && (carve_ != carve_end_ || grow_locked()))
+  {
+    cache->buffers[n++] = carve_;
+    carve_ += BUFFER_SIZE;
+    ++buffers_;
+  }
+  cache->count = n;
+  if(n == 0)
+  {
+    ++exhausted_;
+    pressure_.store(true, std::memory_order_relaxed);
+    return 0;
+  }
+  if(buffers_ - free_num_ > peak_)
+    peak_ = buffers_ - free_num_;
+  return n;
+}
+
+/**
+ * @brief 线程缓存中超过 keep 个的缓冲区放回全局链表
+ */
+void RecvBufferPool::flush(ThreadCache *cache, int keep)
+{
+  if(cache->count <= keep)
+    return;
+  my_mutex::MutexLockGuard lock(mutex_);
+  while(cache->count > keep)
+  {
+    FreeBuffer *buffer = reinterpret_cast<FreeBuffer*>(cache->buffers[--cache->count]);
+    buffer->next = free_;
+    free_ = buffer;
+    ++free_num_;
+  }
+  if(free_num_ >= static_cast<size_t>(THREAD_CACHE_SIZE))
+    pressure_.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 映射一个新的 slab，之后按需从中切出缓冲区。页在第一次写入时才分配，常驻内存随实际用到的缓冲区增长
+ *
+ * @return 已达到上限或映射失败返回false
+ */
+bool RecvBufferPool::grow_locked()
+{
+  if(max_slabs_ != 0 && slabs_.size() >= max_slabs_)
+    return false;
+  void *mem = MAP_FAILED;
+  if(huge_pages_)
+  {
+    mem = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(mem != MAP_FAILED)
+      ++huge_slabs_;
+  }
+  if(mem == MAP_FAILED)
+  {
+    mem = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED)
+      return false;
+    if(huge_pages_)
+      madvise(mem, SLAB_SIZE, MADV_HUGEPAGE);  // 没有预留的大页，退回透明大页
+  }
+  slabs_.push_back(static_cast<char*>(mem));
+  carve_ = slabs_.back();
+  carve_end_ = carve_ + SLAB_SIZE;
+  return true;
+}
+
+RecvBufferPool::Stats RecvBufferPool::stats()
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  Stats stats;
+  stats.buffers = buffers_;
+  stats.in_use = buffers_ - free_num_;
+  stats.peak = peak_;
+  stats.slabs = slabs_.size();
+  stats.huge_slabs = huge_slabs_;
+  stats.exhausted = exhausted_;
+  return stats;
+}
+
+} // namespace my_recv_pool
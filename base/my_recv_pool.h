@@ -0,0 +1,109 @@
+/**
+ * @file my_recv_pool.h
+ * @author zX
+ * @brief bounded pool of fixed size recv buffers shared by all connections, with per thread caches
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef MY_RECV_POOL_H_
+#define MY_RECV_POOL_H_
+
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include <my_mutex.h>
+
+namespace my_recv_pool
+{
+
+/**
+ * @brief 所有连接共享的接收缓冲区池。缓冲区大小固定，从 SLAB_SIZE（一个2MB大页）的 slab 中切出，
+ *        可以用大页（MAP_HUGETLB）映射，没有预留大页时退回普通页并建议内核使用透明大页。
+ *        总数有上限：用完时 get() 返回nullptr，由 reactor 暂停该连接的读取、等有缓冲区放回后再继续，内存不会随连接数增长。
+ *        每个线程缓存最多 THREAD_CACHE_SIZE 个缓冲区，取放都不加锁，缓存空了或满了才批量访问全局空闲链表；
+ *        池用完（有连接在等待）时放回的缓冲区直接进入全局链表，不滞留在线程缓存中
+ */
+class RecvBufferPool : public boost::noncopyable
+{
+public:
+  static const size_t BUFFER_SIZE = 8192;
+  static const size_t SLAB_SIZE = 2 * 1024 * 1024;
+  static const int SLAB_BUFFERS = SLAB_SIZE / BUFFER_SIZE;
+  static const int THREAD_CACHE_SIZE = 32;
+
+  /*
+  *@brief 统计，main 退出时输出
+  */
+  struct Stats
+  {
+    size_t buffers;  // 已切出的缓冲区数
+    size_t in_use;  // 已切出、不在全局空闲链表中的个数（连接持有的和线程缓存中的）
+    size_t peak;  // in_use 的最大值
+    size_t slabs;
+    size_t huge_slabs;  // 用大页映射的 slab 数
+    size_t exhausted;  // get() 因为池用完而失败的次数
+  };
+
+  static RecvBufferPool& instance();
+
+  /*
+  *@brief 设置上限，在 reactor 启动前调用。不调用时没有上限、不使用大页
+  *@param max_buffers 缓冲区个数的上限，向上取整到 SLAB_BUFFERS 的倍数，0 表示没有上限
+  *@param huge_pages 是否用大页映射 slab
+  */
+  void configure(size_t max_buffers, bool huge_pages);
+
+  /*
+  *@brief 取一个 BUFFER_SIZE 字节的缓冲区
+  *@return 池已用完返回nullptr
+  */
+  char* get();
+
+  void put(char *buffer);
+
+  /*
+  *@brief 现在还能取到的缓冲区个数（近似值），reactor 据此决定恢复多少个暂停的连接
+  */
+  size_t available();
+
+  Stats stats();
+
+private:
+  struct ThreadCache;
+
+  RecvBufferPool();
+  ~RecvBufferPool();
+
+  static ThreadCache& thread_cache();
+
+  int refill(ThreadCache *cache);
+  void flush(ThreadCache *cache, int keep);
+  bool grow_locked();
+
+  struct FreeBuffer
+  {
+    FreeBuffer *next;
+  };
+
+  my_mutex::MutexLock mutex_;
+  FreeBuffer *free_;  // 放回的缓冲区
+  size_t free_num_;
+  char *carve_;  // 最新的 slab 中还没有切出的部分 [carve_, carve_end_)
+  char *carve_end_;
+  size_t buffers_;
+  size_t max_slabs_;  // 0 表示没有上限
+  bool huge_pages_;
+  size_t huge_slabs_;
+  size_t peak_;
+  size_t exhausted_;
+  std::atomic<bool> pressure_;  // 有 get() 因为池用完而失败，放回的缓冲区直接进入全局链表
+  std::vector<char*> slabs_;
+};
+
+} // namespace my_recv_pool
+
+#endif // MY_RECV_POOL_H_
@@ -0,0 +1,364 @@
+/**
+ * @file my_uring.h
+ * @author zX
+ * @brief thin io_uring wrapper on raw syscalls
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef MY_URING_H_
+#define MY_URING_H_
+
+#include <boost/noncopyable.hpp>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+
+namespace my_uring
+{
+
+/**
+ * @brief 一个 io_uring 实例：提交队列（SQ）、完成队列（CQ）和 SQE 数组都映射到用户空间。
+ *        get_sqe() 只在用户空间填写，submit_and_wait() 用一次 io_uring_enter 提交全部 SQE 并等待完成，
+ *        之后用 peek_cqe()/cqe_seen() 逐个取出完成事件。只能由创建它的线程使用。
+ */
+class Ring : public boost::noncopyable
+{
+public:
+  Ring()
+    : ring_fd_(-1),
+      features_(0),
+      sq_ptr_(nullptr),
+      sq_size_(0),
+      cq_ptr_(nullptr),
+      cq_size_(0),
+      sqes_(nullptr),
+      sqes_size_(0),
+      sq_tail_local_(0),
+      sq_submitted_(0),
+      enters_(0)
+  {
+  }
+
+  ~Ring()
+  {
+    if(sqes_ != nullptr)
+      munmap(sqes_, sqes_size_);
+    if(cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_)
+      munmap(cq_ptr_, cq_size_);
+    if(sq_ptr_ != nullptr)
+      munmap(sq_ptr_, sq_size_);
+    if(ring_fd_ != -1)
+      close(ring_fd_);
+  }
+
+  /*
+  *@brief 创建 io_uring 并映射队列
+  *@param entries SQ 大小，CQ 为它的 cq_factor 倍
+  *@param flags IORING_SETUP_* 标志，内核不支持时依次去掉可选的标志重试
+  *@return 成功返回0，否则返回 -errno
+  */
+  int init(unsigned entries, unsigned cq_factor, unsigned flags)
+  {
+    struct io_uring_params params;
+    int fd = -1;
+    while(true)
+    {
+      memset(&params, 0, sizeof(params));
+      params.flags = flags | IORING_SETUP_CQSIZE;
+      params.cq_entries = entries * cq_factor;
+      fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+      if(fd >= 0 || errno != EINVAL || flags == 0)
+        break;
+      // 旧内核不认识的标志：DEFER_TASKRUN 依赖 SINGLE_ISSUER，先去掉它，再去掉 SINGLE_ISSUER/COOP_TASKRUN
+      if(flags & IORING_SETUP_DEFER_TASKRUN)
+        flags = (flags & ~IORING_SETUP_DEFER_TASKRUN) | IORING_SETUP_COOP_TASKRUN;
+      else
+        flags = 0;
+    }
+    if(fd < 0)
+      return -errno;
+    ring_fd_ = fd;
+    features_ = params.features;
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(features_ & IORING_FEAT_SINGLE_MMAP)  // SQ 和 CQ 在同一块映射里
+      sq_size_ = cq_size_ = sq_size_ > cq_size_ ? sq_size_ : cq_size_;
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if(sq_ptr_ == MAP_FAILED)
+    {
+      sq_ptr_ = nullptr;
+      return -errno;
+    }
+    if(features_ & IORING_FEAT_SINGLE_MMAP)
+      cq_ptr_ = sq_ptr_;
+    else
+    {
+      cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+      if(cq_ptr_ == MAP_FAILED)
+      {
+        cq_ptr_ = nullptr;
+        return -errno;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+      return -errno;
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<std::atomic<uint32_t>*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<std::atomic<uint32_t>*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    uint32_t *array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    for(uint32_t i = 0; i < sq_entries_; ++i)
+      array[i] = i;  // SQ 数组固定为恒等映射，SQE 按顺序使用
+    sq_tail_local_ = sq_submitted_ = sq_tail_->load(std::memory_order_relaxed);
+
+    char *cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<std::atomic<uint32_t>*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<std::atomic<uint32_t>*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return 0;
+  }
+
+  int fd() const { return ring_fd_; }
+
+  uint32_t features() const { return features_; }
+
+  /*
+  *@brief 取一个空闲的 SQE 并清零。SQ 满时先把已填写的提交给内核
+  *@return 提交失败时返回nullptr
+  */
+  struct io_uring_sqe* get_sqe()
+  {
+    if(sq_tail_local_ - sq_head_->load(std::memory_order_acquire) >= sq_entries_)
+    {
+      if(enter(0, -1) < 0 || sq_tail_local_ - sq_head_->load(std::memory_order_acquire) >= sq_entries_)
+        return nullptr;
+    }
+    struct io_uring_sqe *sqe = &sqes_[sq_tail_local_ & sq_mask_];
+    ++sq_tail_local_;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  /*
+  *@brief 一次系统调用提交所有已填写的 SQE，并等待至少 wait_nr 个完成事件
+  *@param wait_nr 等待的完成事件数，0 表示只提交
+  *@param timeout_ms 等待超时，-1 表示一直等待
+  *@return 成功返回提交的 SQE 数，超时返回 -ETIME，出错返回 -errno
+  */
+  int submit_and_wait(unsigned wait_nr, int timeout_ms)
+  {
+    if(wait_nr > 0 && cq_ready() > 0)
+      wait_nr = 0;  // 已经有完成事件，不需要睡眠
+    if(wait_nr == 0 && sq_tail_local_ == sq_submitted_)
+      return 0;
+    return enter(wait_nr, timeout_ms);
+  }
+
+  /*
+  *@brief 取出最早的完成事件，没有时返回nullptr。处理完后调用 cqe_seen()
+  */
+  struct io_uring_cqe* peek_cqe()
+  {
+    uint32_t head = cq_head_->load(std::memory_order_relaxed);
+    if(head == cq_tail_->load(std::memory_order_acquire))
+      return nullptr;
+    return &cqes_[head & cq_mask_];
+  }
+
+  void cqe_seen()
+  {
+    cq_head_->store(cq_head_->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /*
+  *@brief 完成队列中未处理的事件数
+  */
+  uint32_t cq_ready() const
+  {
+    return cq_tail_->load(std::memory_order_acquire) - cq_head_->load(std::memory_order_relaxed);
+  }
+
+  /*
+  *@brief 调用 io_uring_register
+  *@return 成功返回非负数，失败返回 -errno
+  */
+  int register_op(unsigned opcode, const void *arg, unsigned nr_args)
+  {
+    int ret = static_cast<int>(syscall(__NR_io_uring_register, ring_fd_, opcode, arg, nr_args));
+    return ret < 0 ? -errno : ret;
+  }
+
+  /*
+  *@brief 注册 nr 个空的固定文件槽位，供 IORING_FILE_INDEX_ALLOC 分配直接描述符
+  */
+  int register_sparse_files(unsigned nr)
+  {
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = nr;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    return register_op(IORING_REGISTER_FILES2, &reg, sizeof(reg));
+  }
+
+  /*
+  *@brief io_uring_enter 调用次数
+  */
+  uint64_t enters() const { return enters_; }
+
+private:
+  int enter(unsigned wait_nr, int timeout_ms)
+  {
+    unsigned to_submit = sq_tail_local_ - sq_submitted_;
+    sq_tail_->store(sq_tail_local_, std::memory_order_release);  // 内核读到新的尾指针之前，SQE 的内容必须已经写好
+    sq_submitted_ = sq_tail_local_;
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    const void *argp = nullptr;
+    size_t argsz = 0;
+    if(wait_nr > 0 && timeout_ms >= 0 && (features_ & IORING_FEAT_EXT_ARG))
+    {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      memset(&arg, 0, sizeof(arg));
+      arg.ts = reinterpret_cast<uint64_t>(&ts);
+      argp = &arg;
+      argsz = sizeof(arg);
+      flags |= IORING_ENTER_EXT_ARG;
+    }
+    ++enters_;
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, argp, argsz));
+    if(ret < 0)
+      return -errno;
+    return ret;
+  }
+
+  int ring_fd_;
+  uint32_t features_;
+  void *sq_ptr_;
+  size_t sq_size_;
+  void *cq_ptr_;
+  size_t cq_size_;
+  struct io_uring_sqe *sqes_;
+  size_t sqes_size_;
+
+  std::atomic<uint32_t> *sq_head_;  // 内核消费到的位置
+  std::atomic<uint32_t> *sq_tail_;
+  uint32_t sq_mask_;
+  uint32_t sq_entries_;
+  uint32_t sq_tail_local_;  // 已填写的 SQE，提交时才写回 sq_tail_
+  uint32_t sq_submitted_;
+
+  std::atomic<uint32_t> *cq_head_;
+  std::atomic<uint32_t> *cq_tail_;  // 内核写入完成事件的位置
+  uint32_t cq_mask_;
+  struct io_uring_cqe *cqes_;
+
+  uint64_t enters_;
+};
+
+/**
+ * @brief 提供给内核的接收缓冲区环（IORING_REGISTER_PBUF_RING）。多次触发的 recv 完成时由内核从环中挑选缓冲区，
+ *        完成事件里带回缓冲区编号；用户处理完数据后用 recycle() 把缓冲区放回环中。
+ */
+class BufferRing : public boost::noncopyable
+{
+public:
+  BufferRing() : ring_(nullptr), ring_size_(0), buffers_(nullptr), entries_(0), buffer_size_(0), tail_(0) {}
+
+  ~BufferRing()
+  {
+    if(ring_ != nullptr)
+      munmap(ring_, ring_size_);
+    delete[] buffers_;
+  }
+
+  /*
+  *@brief 分配缓冲区并注册到 io_uring
+  *@param entries 缓冲区个数，必须是2的幂
+  *@param buffer_size 每个缓冲区的字节数
+  *@param group 缓冲区组编号，SQE 的 buf_group 引用它
+  *@return 成功返回0，否则返回 -errno
+  */
+  int init(Ring *ring, unsigned entries, unsigned buffer_size, uint16_t group)
+  {
+    entries_ = entries;
+    buffer_size_ = buffer_size;
+    ring_size_ = entries * sizeof(struct io_uring_buf);
+    void *mem = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);  // 环必须按页对齐
+    if(mem == MAP_FAILED)
+      return -errno;
+    ring_ = static_cast<struct io_uring_buf_ring*>(mem);
+    buffers_ = new char[static_cast<size_t>(entries) * buffer_size];
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring_);
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    int ret = ring->register_op(IORING_REGISTER_PBUF_RING, &reg, 1);
+    if(ret < 0)
+      return ret;
+    for(unsigned bid = 0; bid < entries; ++bid)
+      add(bid);
+    publish();
+    return 0;
+  }
+
+  char* buffer(unsigned bid) { return buffers_ + static_cast<size_t>(bid) * buffer_size_; }
+
+  unsigned buffer_size() const { return buffer_size_; }
+
+  /*
+  *@brief 把缓冲区放回环中并立即对内核可见
+  */
+  void recycle(unsigned bid)
+  {
+    add(bid);
+    publish();
+  }
+
+private:
+  void add(unsigned bid)
+  {
+    // 不用 ring_->bufs：C++ 中 __DECLARE_FLEX_ARRAY 里的空结构体占1字节，bufs 的偏移变成8，与内核的布局不一致
+    struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf*>(ring_) + (tail_ & (entries_ - 1));
+    buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf->len = buffer_size_;
+    buf->bid = static_cast<uint16_t>(bid);
+    ++tail_;
+  }
+
+  void publish()
+  {
+    // 尾指针与第0项的 resv 字段重叠，内核用 acquire 读取它
+    reinterpret_cast<std::atomic<uint16_t>*>(&ring_->tail)->store(tail_, std::memory_order_release);
+  }
+
+  struct io_uring_buf_ring *ring_;
+  size_t ring_size_;
+  char *buffers_;
+  unsigned entries_;
+  unsigned buffer_size_;
+  uint16_t tail_;
+};
+
+} // namespace my_uring
+
+#endif // MY_URING_H_
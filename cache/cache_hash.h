@@ -0,0 +1,41 @@
+/**
+ * @file cache_hash.h
+ * @author zX
+ * @brief Hash function shared by the caches.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef CACHE_HASH_H_
+#define CACHE_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace http_server
+{
+
+namespace cache
+{
+
+/*
+*@brief FNV-1a 哈希
+*/
+inline uint64_t hash_key(const char *key, size_t len)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for(size_t i = 0; i < len; ++i)
+  {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+} // namespace cache
+
+} // namespace http_server
+
+#endif // CACHE_HASH_H_
@@ -0,0 +1,282 @@
+/**
+ * @file content_cache.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "content_cache.h"
+#include "cache_hash.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace http_server
+{
+
+namespace cache
+{
+
+static const size_t INIT_SLOTS = 1024;
+
+CachedContent::CachedContent(const OpenFile &file, const char *type)
+  : content_type(type),
+    size(file.size),
+    mtime(file.mtime),
+    ino(file.ino),
+    dev(file.dev),
+    mode(file.mode),
+    validated(0)
+{
+}
+
+/**
+ * @brief 从已打开的文件读入全部内容
+ *
+ * @param file 打开文件缓存中的条目
+ * @param type Content-Type
+ * @return 读取失败或文件被截断返回nullptr
+ */
+ContentPtr CachedContent::load(const OpenFile &file, const char *type)
+{
+  ContentPtr content = std::make_shared<CachedContent>(file, type);
+  content->data.resize(file.size);
+  size_t got = 0;
+  while(got < content->data.size())
+  {
+    ssize_t n = pread(file.fd, &content->data[got], content->data.size() - got, got);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)  // 出错或文件被截断
+      return ContentPtr();
+    got += n;
+  }
+  return content;
+}
+
+ContentCache::ContentCache(size_t max_bytes, int valid_time)
+  : max_bytes_(max_bytes),
+    max_entry_size_(max_bytes / 16),
+    valid_time_(valid_time),
+    bytes_(0),
+    entries_(0),
+    slots_(INIT_SLOTS),
+    free_list_(EMPTY),
+    lru_head_(EMPTY),
+    lru_tail_(EMPTY)
+{
+  for(size_t i = 0; i < slots_.size(); ++i)
+    slots_[i].node = EMPTY;
+}
+
+/**
+ * @brief 查找缓存的内容，命中时移到LRU头部
+ *
+ * @param key 规范化后的url路径
+ * @param len
+ * @param now 当前时间
+ * @param stale 输出：条目超过有效期，调用者需要通过打开文件缓存确认文件未变化后再使用
+ * @return 未命中返回nullptr
+ */
+ContentPtr ContentCache::find(const char *key, size_t len, time_t now, bool *stale)
+{
+  uint64_t hash = hash_key(key, len);
+  ContentPtr content;
+  {
+    my_mutex::MutexLockGuard mlg(mutex_);
+    size_t slot = find_slot(hash, key, len);
+    if(slot == slots_.size())
+      return content;
+    int32_t node = slots_[slot].node;
+    if(node != lru_head_)
+    {
+      unlink(node);
+      link_front(node);
+    }
+    content = nodes_[node].content;
+  }
+  *stale = now - content->validated.load(std::memory_order_relaxed) >= valid_time_;
+  return content;
+}
+
+/**
+ * @brief 插入（或替换）一个条目，超出字节预算时从LRU尾部淘汰
+ *
+ * @param key 规范化后的url路径
+ * @param len
+ * @param content 已载入的内容，validated 视为当前时间
+ */
+void ContentCache::insert(const char *key, size_t len, const ContentPtr &content)
+{
+  if(!cacheable(content->size))
+    return;
+  content->validated.store(time(NULL), std::memory_order_relaxed);
+  uint64_t hash = hash_key(key, len);
+
+  my_mutex::MutexLockGuard mlg(mutex_);
+  size_t slot = find_slot(hash, key, len);
+  if(slot != slots_.size())
+    remove(slot);
+  while(bytes_ + content->data.size() > max_bytes_ && lru_tail_ != EMPTY)
+  {
+    Node &victim = nodes_[lru_tail_];
+    remove(find_slot(victim.hash, victim.key.data(), victim.key.size()));
+  }
+
+  int32_t node;
+  if(free_list_ != EMPTY)
+  {
+    node = free_list_;
+    free_list_ = nodes_[node].next;
+  }
+  else
+  {
+    node = static_cast<int32_t>(nodes_.size());
+    nodes_.push_back(Node());
+  }
+  nodes_[node].key.assign(key, len);
+  nodes_[node].hash = hash;
+  nodes_[node].content = content;
+  link_front(node);
+  if((entries_ + 1) * 2 > slots_.size())
+    grow();
+  insert_slot(hash, node);
+  ++entries_;
+  bytes_ += content->data.size();
+}
+
+void ContentCache::erase(const char *key, size_t len)
+{
+  uint64_t hash = hash_key(key, len);
+  my_mutex::MutexLockGuard mlg(mutex_);
+  size_t slot = find_slot(hash, key, len);
+  if(slot != slots_.size())
+    remove(slot);
+}
+
+size_t ContentCache::bytes()
+{
+  my_mutex::MutexLockGuard mlg(mutex_);
+  return bytes_;
+}
+
+size_t ContentCache::size()
+{
+  my_mutex::MutexLockGuard mlg(mutex_);
+  return entries_;
+}
+
+/**
+ * @brief 线性探测查找
+ *
+ * @return 槽位下标，未找到返回 slots_.size()
+ */
+size_t ContentCache::find_slot(uint64_t hash, const char *key, size_t len) const
+{
+  size_t mask = slots_.size() - 1;
+  uint32_t tag = static_cast<uint32_t>(hash >> 32);
+  for(size_t i = hash & mask; ; i = (i + 1) & mask)
+  {
+    const Slot &slot = slots_[i];
+    if(slot.node == EMPTY)
+      return slots_.size();
+    if(slot.tag == tag)
+    {
+      const Node &node = nodes_[slot.node];
+      if(node.hash == hash && node.key.size() == len && memcmp(node.key.data(), key, len) == 0)
+        return i;
+    }
+  }
+}
+
+void ContentCache::insert_slot(uint64_t hash, int32_t node)
+{
+  size_t mask = slots_.size() - 1;
+  size_t i = hash & mask;
+  while(slots_[i].node != EMPTY)
+    i = (i + 1) & mask;
+  slots_[i].tag = static_cast<uint32_t>(hash >> 32);
+  slots_[i].node = node;
+}
+
+/**
+ * @brief 删除槽位，后继的同簇元素向前移动（backward shift），不需要墓碑标记
+ */
+void ContentCache::erase_slot(size_t slot)
+{
+  size_t mask = slots_.size() - 1;
+  size_t hole = slot;
+  for(size_t i = (slot + 1) & mask; slots_[i].node != EMPTY; i = (i + 1) & mask)
+  {
+    size_t home = nodes_[slots_[i].node].hash & mask;
+    // home 不在 (hole, i] 区间内时，元素可以移到空洞处
+    bool movable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+    if(movable)
+    {
+      slots_[hole] = slots_[i];
+      hole = i;
+    }
+  }
+  slots_[hole].node = EMPTY;
+}
+
+void ContentCache::grow()
+{
+  std::vector<Slot> old;
+  old.swap(slots_);
+  slots_.resize(old.size() * 2);
+  for(size_t i = 0; i < slots_.size(); ++i)
+    slots_[i].node = EMPTY;
+  for(size_t i = 0; i < old.size(); ++i)
+  {
+    if(old[i].node != EMPTY)
+      insert_slot(nodes_[old[i].node].hash, old[i].node);
+  }
+}
+
+void ContentCache::link_front(int32_t node)
+{
+  nodes_[node].prev = EMPTY;
+  nodes_[node].next = lru_head_;
+  if(lru_head_ != EMPTY)
+    nodes_[lru_head_].prev = node;
+  lru_head_ = node;
+  if(lru_tail_ == EMPTY)
+    lru_tail_ = node;
+}
+
+void ContentCache::unlink(int32_t node)
+{
+  Node &n = nodes_[node];
+  if(n.prev != EMPTY)
+    nodes_[n.prev].next = n.next;
+  else
+    lru_head_ = n.next;
+  if(n.next != EMPTY)
+    nodes_[n.next].prev = n.prev;
+  else
+    lru_tail_ = n.prev;
+}
+
+/**
+ * @brief 删除槽位对应的条目，节点放回空闲链表
+ */
+void ContentCache::remove(size_t slot)
+{
+  int32_t node = slots_[slot].node;
+  erase_slot(slot);
+  unlink(node);
+  bytes_ -= nodes_[node].content->data.size();
+  --entries_;
+  nodes_[node].content.reset();
+  nodes_[node].key.clear();
+  nodes_[node].next = free_list_;
+  free_list_ = node;
+}
+
+} // namespace cache
+
+} // namespace http_server
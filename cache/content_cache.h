@@ -0,0 +1,130 @@
+/**
+ * @file content_cache.h
+ * @author zX
+ * @brief In-memory static content cache keyed by normalized url path.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef CONTENT_CACHE_H_
+#define CONTENT_CACHE_H_
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <my_mutex.h>
+#include "open_file_cache.h"
+
+namespace http_server
+{
+
+namespace cache
+{
+
+/*
+*@brief 缓存的文件内容。连接发送期间持有引用，被淘汰后内存在最后一个引用释放时回收
+*/
+struct CachedContent : public boost::noncopyable
+{
+  CachedContent(const OpenFile &file, const char *type);
+
+  static std::shared_ptr<CachedContent> load(const OpenFile &file, const char *type);
+
+  /*
+  *@brief 是否与缓存时的文件相同
+  */
+  bool same_file(const OpenFile &file) const
+  {
+    return file.ino == ino && file.dev == dev && file.size == size && file.mtime == mtime && file.mode == mode;
+  }
+
+  std::string data;
+  const char *content_type;
+  off_t size;
+  time_t mtime;
+  ino_t ino;
+  dev_t dev;
+  mode_t mode;
+  std::atomic<time_t> validated;  // 最近一次确认文件未变化的时间
+};
+
+typedef std::shared_ptr<CachedContent> ContentPtr;
+
+/*
+*@brief 静态文件内容缓存。首次请求时载入，总字节数不超过预算，超出时按LRU淘汰。
+*       以规范化后的url路径为键，查找使用开放寻址（线性探测）的扁平哈希表。
+*       命中且在有效期(valid_time秒)内的条目直接从内存发送，不需要 open/stat/read；
+*       过期的条目与打开文件缓存中的元数据比较，文件没有变化时继续使用。
+*/
+class ContentCache : public boost::noncopyable
+{
+public:
+  ContentCache(size_t max_bytes, int valid_time);
+
+  ContentPtr find(const char *key, size_t len, time_t now, bool *stale);
+
+  void insert(const char *key, size_t len, const ContentPtr &content);
+
+  void erase(const char *key, size_t len);
+
+  /*
+  *@brief 单个文件不超过预算的1/16才缓存，避免一个大文件挤掉整个热点集合
+  */
+  bool cacheable(off_t size) const { return size >= 0 && static_cast<size_t>(size) <= max_entry_size_; }
+
+  size_t bytes();
+
+  size_t size();
+
+private:
+  static const int32_t EMPTY = -1;
+
+  struct Slot
+  {
+    uint32_t tag;  // 哈希值高32位，探测时先比较它，避免访问节点
+    int32_t node;
+  };
+
+  struct Node
+  {
+    std::string key;
+    uint64_t hash;
+    ContentPtr content;
+    int32_t prev;
+    int32_t next;
+  };
+
+  size_t find_slot(uint64_t hash, const char *key, size_t len) const;
+  void insert_slot(uint64_t hash, int32_t node);
+  void erase_slot(size_t slot);
+  void grow();
+  void link_front(int32_t node);
+  void unlink(int32_t node);
+  void remove(size_t slot);
+
+  size_t max_bytes_;
+  size_t max_entry_size_;
+  int valid_time_;
+  size_t bytes_;
+  size_t entries_;
+  std::vector<Slot> slots_;  // 容量为2的幂，装载因子不超过1/2
+  std::vector<Node> nodes_;
+  int32_t free_list_;  // 空闲节点链表，用 next 连接
+  int32_t lru_head_;  // 最近使用
+  int32_t lru_tail_;  // 最久未使用
+  my_mutex::MutexLock mutex_;
+};
+
+} // namespace cache
+
+} // namespace http_server
+
+#endif // CONTENT_CACHE_H_
@@ -0,0 +1,246 @@
+/**
+ * @file negative_cache.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "negative_cache.h"
+#include "cache_hash.h"
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace http_server
+{
+
+namespace cache
+{
+
+static const int BLOOM_HASHES = 4;
+static const size_t BLOOM_BITS_PER_ENTRY = 16;  // 4个哈希函数时误判率约0.2%
+static const uint32_t WATCH_EVENTS = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+
+NegativeCache::NegativeCache(const char *document_root, int valid_time, size_t max_entries)
+  : valid_time_(valid_time),
+    max_entries_(max_entries),
+    bloom_added_(0),
+    generation_(0),
+    inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+  size_t bits = 1024;
+  while(bits < max_entries * BLOOM_BITS_PER_ENTRY)
+    bits <<= 1;
+  bloom_mask_ = bits - 1;
+  bloom_.reset(new std::atomic<uint64_t>[bits / 64]);
+  for(size_t i = 0; i < bits / 64; ++i)
+    bloom_[i].store(0, std::memory_order_relaxed);
+
+  if(inotify_fd_ != -1)
+    watch_tree(document_root);
+}
+
+NegativeCache::~NegativeCache()
+{
+  if(inotify_fd_ != -1)
+    ::close(inotify_fd_);
+}
+
+/**
+ * @brief 路径最近是否不存在
+ *
+ * @param key 规范化后的url路径
+ * @param len
+ * @param now 当前时间
+ * @return
+ */
+bool NegativeCache::contains(const char *key, size_t len, time_t now)
+{
+  uint64_t hash = hash_key(key, len);
+  if(!bloom_maybe(hash))
+    return false;
+
+  static thread_local std::string lookup_key;  // 复用查找用的键，长路径也不在请求路径上分配内存
+  lookup_key.assign(key, len);
+  my_mutex::MutexLockGuard mlg(mutex_);
+  auto iter = entries_.find(lookup_key);
+  if(iter == entries_.end())
+    return false;
+  if(now - iter->second->second >= valid_time_)
+  {
+    lru_.erase(iter->second);
+    entries_.erase(iter);
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, iter->second);
+  return true;
+}
+
+/**
+ * @brief 记录一个不存在的路径，超出容量时淘汰最久未使用的条目
+ *
+ * @param key 规范化后的url路径
+ * @param len
+ * @param now 当前时间
+ * @param generation 查找文件之前 generation() 的返回值
+ */
+void NegativeCache::insert(const char *key, size_t len, time_t now, uint64_t generation)
+{
+  std::string k(key, len);
+  my_mutex::MutexLockGuard mlg(mutex_);
+  if(generation != generation_.load(std::memory_order_relaxed))  // 查找期间有文件被创建，结果可能已经过时
+    return;
+  auto iter = entries_.find(k);
+  if(iter != entries_.end())
+  {
+    iter->second->second = now;
+    lru_.splice(lru_.begin(), lru_, iter->second);
+    return;
+  }
+  lru_.push_front(std::make_pair(k, now));
+  entries_[k] = lru_.begin();
+  bloom_add(hash_key(key, len));
+  if(entries_.size() > max_entries_)
+  {
+    entries_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  if(++bloom_added_ > max_entries_ * 2)
+    bloom_rebuild();
+}
+
+/**
+ * @brief 清空缓存
+ *
+ */
+void NegativeCache::clear()
+{
+  my_mutex::MutexLockGuard mlg(mutex_);
+  generation_.fetch_add(1, std::memory_order_release);
+  lru_.clear();
+  entries_.clear();
+  for(size_t i = 0; i <= bloom_mask_ / 64; ++i)
+    bloom_[i].store(0, std::memory_order_relaxed);
+  bloom_added_ = 0;
+}
+
+/**
+ * @brief 读取 inotify 事件。有文件或目录被创建、移入时清空缓存，新目录加入监视
+ *
+ */
+void NegativeCache::handle_events()
+{
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  my_mutex::MutexLockGuard mlg(watch_mutex_);
+  while(true)
+  {
+    ssize_t n = read(inotify_fd_, buffer, sizeof(buffer));
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      break;
+    for(char *p = buffer; p < buffer + n; )
+    {
+      const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+      if(event->mask & IN_Q_OVERFLOW)  // 丢失了事件
+        changed = true;
+      if(event->mask & IN_IGNORED)  // 目录已被删除
+        watches_.erase(event->wd);
+      if(event->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+        changed = true;
+        std::map<int, std::string>::iterator iter = watches_.find(event->wd);
+        if((event->mask & IN_ISDIR) && event->len > 0 && iter != watches_.end())
+          watch_tree(iter->second + "/" + event->name);
+      }
+    }
+  }
+  if(changed)
+    clear();
+}
+
+size_t NegativeCache::size()
+{
+  my_mutex::MutexLockGuard mlg(mutex_);
+  return entries_.size();
+}
+
+bool NegativeCache::bloom_maybe(uint64_t hash) const
+{
+  uint64_t h2 = (hash >> 32) | 1;
+  for(int i = 0; i < BLOOM_HASHES; ++i)
+  {
+    size_t bit = (hash + i * h2) & bloom_mask_;
+    if(!(bloom_[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64))))
+      return false;
+  }
+  return true;
+}
+
+void NegativeCache::bloom_add(uint64_t hash)
+{
+  uint64_t h2 = (hash >> 32) | 1;
+  for(int i = 0; i < BLOOM_HASHES; ++i)
+  {
+    size_t bit = (hash + i * h2) & bloom_mask_;
+    bloom_[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief 用当前的条目重建Bloom过滤器，清除已淘汰键留下的位。调用者持有 mutex_
+ *
+ */
+void NegativeCache::bloom_rebuild()
+{
+  for(size_t i = 0; i <= bloom_mask_ / 64; ++i)
+    bloom_[i].store(0, std::memory_order_relaxed);
+  for(LruList::iterator iter = lru_.begin(); iter != lru_.end(); ++iter)
+    bloom_add(hash_key(iter->first.data(), iter->first.size()));
+  bloom_added_ = lru_.size();
+}
+
+/**
+ * @brief 递归监视目录及其子目录（inotify 不会递归监视）
+ *
+ * @param dir
+ */
+void NegativeCache::watch_tree(const std::string &dir)
+{
+  int wd = inotify_add_watch(inotify_fd_, dir.c_str(), WATCH_EVENTS);
+  if(wd == -1)
+    return;
+  watches_[wd] = dir;
+
+  DIR *dp = opendir(dir.c_str());
+  if(dp == nullptr)
+    return;
+  struct dirent *entry;
+  while((entry = readdir(dp)) != nullptr)
+  {
+    if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    std::string path = dir + "/" + entry->d_name;
+    bool is_dir = entry->d_type == DT_DIR;
+    if(entry->d_type == DT_UNKNOWN)
+    {
+      struct stat st;
+      is_dir = lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    if(is_dir)
+      watch_tree(path);
+  }
+  closedir(dp);
+}
+
+} // namespace cache
+
+} // namespace http_server
@@ -0,0 +1,91 @@
+/**
+ * @file negative_cache.h
+ * @author zX
+ * @brief Cache of url paths that recently did not exist.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef NEGATIVE_CACHE_H_
+#define NEGATIVE_CACHE_H_
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <my_mutex.h>
+
+namespace http_server
+{
+
+namespace cache
+{
+
+/*
+*@brief 不存在路径的缓存，避免扫描器的大量404请求变成大量文件系统元数据查询。
+*       前面是无锁的Bloom过滤器，绝大多数存在的路径在这里就被排除；可能命中时再查有锁的精确LRU。
+*       条目在有效期(valid_time秒)后失效；文档根目录下新建或移入文件时（inotify）清空整个缓存。
+*/
+class NegativeCache : public boost::noncopyable
+{
+public:
+  NegativeCache(const char *document_root, int valid_time, size_t max_entries);
+
+  ~NegativeCache();
+
+  bool contains(const char *key, size_t len, time_t now);
+
+  /*
+  *@brief 查找文件之前记录当前代数，插入时代数已变化（期间有文件被创建）则不插入
+  */
+  uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+  void insert(const char *key, size_t len, time_t now, uint64_t generation);
+
+  void clear();
+
+  /*
+  *@brief inotify 文件描述符（非阻塞），可读时调用 handle_events()；不可用时为-1，只靠有效期失效
+  */
+  int watch_fd() const { return inotify_fd_; }
+
+  void handle_events();
+
+  size_t size();
+
+private:
+  typedef std::list<std::pair<std::string, time_t>> LruList;
+
+  bool bloom_maybe(uint64_t hash) const;
+  void bloom_add(uint64_t hash);
+  void bloom_rebuild();
+  void watch_tree(const std::string &dir);
+
+  int valid_time_;
+  size_t max_entries_;
+  size_t bloom_mask_;  // 位数-1，位数为2的幂
+  std::unique_ptr<std::atomic<uint64_t>[]> bloom_;
+  size_t bloom_added_;  // 上次重建后加入的键数，淘汰的键仍占着位，过多时重建
+  std::atomic<uint64_t> generation_;
+
+  LruList lru_;  // 头部为最近插入
+  std::unordered_map<std::string, LruList::iterator> entries_;
+  my_mutex::MutexLock mutex_;
+
+  int inotify_fd_;
+  std::map<int, std::string> watches_;  // inotify watch descriptor -> 目录路径
+  my_mutex::MutexLock watch_mutex_;
+};
+
+} // namespace cache
+
+} // namespace http_server
+
+#endif // NEGATIVE_CACHE_H_
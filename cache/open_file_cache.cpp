@@ -0,0 +1,142 @@
+/**
+ * @file open_file_cache.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "open_file_cache.h"
+#include <fcntl.h>
+
+namespace http_server
+{
+
+namespace cache
+{
+
+OpenFileCache::OpenFileCache(const char *document_root, const char *default_file, int valid_time, size_t max_files)
+  : root_fd_(::open(document_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+    default_file_(default_file),
+    valid_time_(valid_time),
+    max_files_(max_files)
+{
+}
+
+OpenFileCache::~OpenFileCache()
+{
+  if(root_fd_ != -1)
+    ::close(root_fd_);
+}
+
+/**
+ * @brief 获取url对应的文件。条目在有效期内不做任何系统调用，过期后 fstatat 校验，文件变化时重新打开
+ *
+ * @param url 规范化后的url路径，以'/'开头，以'\0'结尾
+ * @param len
+ * @param now 当前时间
+ * @return 文件不存在、不是普通文件或打开失败返回nullptr
+ */
+OpenFilePtr OpenFileCache::open(const char *url, size_t len, time_t now)
+{
+  static thread_local std::string key;  // 复用查找用的键，长路径也不在请求路径上分配内存
+  key.assign(url, len);
+  OpenFilePtr file;
+  {
+    my_mutex::MutexLockGuard mlg(mutex_);
+    auto iter = files_.find(key);
+    if(iter != files_.end())
+    {
+      lru_.splice(lru_.begin(), lru_, iter->second);
+      file = iter->second->second;
+    }
+  }
+
+  if(file)
+  {
+    if(now - file->validated.load(std::memory_order_relaxed) < valid_time_)
+      return file;
+    struct stat st;
+    if(fstatat(root_fd_, file->path.c_str(), &st, 0) == 0 && file->same_file(st))
+    {
+      file->validated.store(now, std::memory_order_relaxed);
+      return file;
+    }
+  }
+
+  file = open_file(url);  // 首次访问，或文件已被修改、替换、删除
+  if(file)
+    file->validated.store(now, std::memory_order_relaxed);
+
+  my_mutex::MutexLockGuard mlg(mutex_);
+  auto iter = files_.find(key);
+  if(iter != files_.end())
+  {
+    lru_.erase(iter->second);
+    files_.erase(iter);
+  }
+  if(file)
+  {
+    lru_.push_front(std::make_pair(key, file));
+    files_[key] = lru_.begin();
+    if(files_.size() > max_files_)
+    {
+      files_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+  }
+  return file;
+}
+
+size_t OpenFileCache::size()
+{
+  my_mutex::MutexLockGuard mlg(mutex_);
+  return files_.size();
+}
+
+/**
+ * @brief 相对文档根目录打开url对应的文件，目录则打开其下的默认文件
+ *
+ * @param url
+ * @return
+ */
+OpenFilePtr OpenFileCache::open_file(const char *url)
+{
+  std::string path(url + 1);  // 去掉开头的'/'，相对 root_fd_
+  if(path.empty() || path[path.size() - 1] == '/')
+    path += default_file_;
+
+  // O_NONBLOCK：打开FIFO等特殊文件时不阻塞，普通文件的读取不受影响
+  int fd = openat(root_fd_, path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+  if(fd == -1)
+    return OpenFilePtr();
+  struct stat st;
+  if(fstat(fd, &st) == -1)
+  {
+    ::close(fd);
+    return OpenFilePtr();
+  }
+  if(S_ISDIR(st.st_mode))
+  {
+    ::close(fd);
+    path += "/";
+    path += default_file_;
+    fd = openat(root_fd_, path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if(fd == -1)
+      return OpenFilePtr();
+    if(fstat(fd, &st) == -1)
+      st.st_mode = 0;  // 按非普通文件处理
+  }
+  if(!S_ISREG(st.st_mode))
+  {
+    ::close(fd);
+    return OpenFilePtr();
+  }
+  return std::make_shared<OpenFile>(fd, path, st);
+}
+
+} // namespace cache
+
+} // namespace http_server
@@ -0,0 +1,108 @@
+/**
+ * @file open_file_cache.h
+ * @author zX
+ * @brief Cache of open file descriptors and stat() metadata, keyed by url path.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef OPEN_FILE_CACHE_H_
+#define OPEN_FILE_CACHE_H_
+
+#include <boost/noncopyable.hpp>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <my_mutex.h>
+
+namespace http_server
+{
+
+namespace cache
+{
+
+/*
+*@brief 已打开的文件及其元数据。最后一个引用释放时关闭fd，所以缓存淘汰不会影响正在发送该文件的连接
+*/
+struct OpenFile : public boost::noncopyable
+{
+  OpenFile(int file_fd, const std::string &file_path, const struct stat &st)
+    : fd(file_fd),
+      path(file_path),
+      size(st.st_size),
+      mtime(st.st_mtime),
+      ino(st.st_ino),
+      dev(st.st_dev),
+      mode(st.st_mode),
+      validated(0)
+  {
+  }
+
+  ~OpenFile()
+  {
+    if(fd != -1)
+      ::close(fd);
+  }
+
+  bool same_file(const struct stat &st) const
+  {
+    return st.st_ino == ino && st.st_dev == dev && st.st_size == size && st.st_mtime == mtime && st.st_mode == mode;
+  }
+
+  bool executable() const { return (mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0; }
+
+  int fd;
+  std::string path;  // 相对文档根目录的路径，目录已替换为其下的默认文件
+  off_t size;
+  time_t mtime;
+  ino_t ino;
+  dev_t dev;
+  mode_t mode;
+  std::atomic<time_t> validated;  // 最近一次确认文件未变化的时间
+};
+
+typedef std::shared_ptr<OpenFile> OpenFilePtr;
+
+/*
+*@brief 按规范化的url路径缓存打开的文件描述符和 stat 元数据（参考nginx的open_file_cache）。
+*       路径用 openat 相对文档根目录的fd解析；条目在有效期(valid_time秒)内直接使用，
+*       过期后用一次 fstatat 校验，文件没有变化时继续复用fd。稳定状态下请求路径上没有元数据系统调用。
+*/
+class OpenFileCache : public boost::noncopyable
+{
+public:
+  OpenFileCache(const char *document_root, const char *default_file, int valid_time, size_t max_files);
+
+  ~OpenFileCache();
+
+  OpenFilePtr open(const char *url, size_t len, time_t now);
+
+  size_t size();
+
+private:
+  typedef std::list<std::pair<std::string, OpenFilePtr>> LruList;
+
+  OpenFilePtr open_file(const char *url);
+
+  int root_fd_;  // 文档根目录
+  std::string default_file_;
+  int valid_time_;
+  size_t max_files_;
+  LruList lru_;  // 头部为最近使用
+  std::unordered_map<std::string, LruList::iterator> files_;
+  my_mutex::MutexLock mutex_;
+};
+
+} // namespace cache
+
+} // namespace http_server
+
+#endif // OPEN_FILE_CACHE_H_
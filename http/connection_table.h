@@ -0,0 +1,128 @@
+/**
+ * @file connection_table.h
+ * @author zX
+ * @brief table of fixed size connection records indexed by fd (or slot id), grown page by page
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef CONNECTION_TABLE_H_
+#define CONNECTION_TABLE_H_
+
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <new>
+#include <atomic>
+
+namespace http_server
+{
+
+namespace http
+{
+
+/**
+ * @brief 按编号（fd 或连接槽位）索引的连接记录表。记录按页分配，每页 PAGE_SIZE 个记录连续存放，
+ *        第一次用到某个编号时才分配它所在的页；页表在构造时按容量一次分配，之后不再移动，
+ *        所以已经取到的记录指针一直有效，其他线程用 get() 查找不需要加锁。
+ *        记录在页分配时用 T(id) 构造，关闭的连接留在表中等待同一个编号的下一个连接复用，表析构时才释放
+ */
+template <typename T>
+class ConnectionTable : public boost::noncopyable
+{
+public:
+  static const int PAGE_BITS = 8;
+  static const int PAGE_SIZE = 1 << PAGE_BITS;
+  static const int MAX_CAPACITY = 1 << 24;  // 页表最多 64K 个指针
+
+  /*
+  *@param capacity 编号的上限，通常是打开文件数的限制
+  */
+  explicit ConnectionTable(int capacity)
+    : capacity_(capacity < MAX_CAPACITY ? capacity : MAX_CAPACITY),
+      page_num_((capacity_ + PAGE_SIZE - 1) >> PAGE_BITS),
+      pages_(new std::atomic<T*>[page_num_]),
+      allocated_(0)
+  {
+    for(int i = 0; i < page_num_; ++i)
+      pages_[i].store(nullptr, std::memory_order_relaxed);
+  }
+
+  ~ConnectionTable()
+  {
+    for(int i = 0; i < page_num_; ++i)
+    {
+      T *page = pages_[i].load(std::memory_order_relaxed);
+      if(page != nullptr)
+        delete_page(page);
+    }
+    delete[] pages_;
+  }
+
+  int capacity() const { return capacity_; }
+
+  /*
+  *@brief 已分配的页数
+  */
+  int pages() const { return allocated_.load(std::memory_order_relaxed); }
+
+  /*
+  *@brief 取记录。id 所在的页必须已经由 create() 分配（连接被接受之后）
+  */
+  T* get(int id) const
+  {
+    return pages_[id >> PAGE_BITS].load(std::memory_order_acquire) + (id & (PAGE_SIZE - 1));
+  }
+
+  /*
+  *@brief 取记录，所在的页还没有分配时分配。多个 reactor 可以同时调用，同时分配同一页时只有一个发布成功
+  *@return 超出容量返回nullptr
+  */
+  T* create(int id)
+  {
+    if(id < 0 || id >= capacity_)
+      return nullptr;
+    std::atomic<T*> &entry = pages_[id >> PAGE_BITS];
+    T *page = entry.load(std::memory_order_acquire);
+    if(page == nullptr)
+    {
+      T *fresh = new_page(id & ~(PAGE_SIZE - 1));
+      if(entry.compare_exchange_strong(page, fresh, std::memory_order_acq_rel))
+      {
+        page = fresh;
+        allocated_.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+        delete_page(fresh);  // page 是其他线程发布的页
+    }
+    return page + (id & (PAGE_SIZE - 1));
+  }
+
+private:
+  static T* new_page(int first_id)
+  {
+    T *page = static_cast<T*>(::operator new(sizeof(T) * PAGE_SIZE));
+    for(int i = 0; i < PAGE_SIZE; ++i)
+      new (page + i) T(first_id + i);
+    return page;
+  }
+
+  static void delete_page(T *page)
+  {
+    for(int i = 0; i < PAGE_SIZE; ++i)
+      page[i].~T();
+    ::operator delete(page);
+  }
+
+  int capacity_;
+  int page_num_;
+  std::atomic<T*> *pages_;
+  std::atomic<int> allocated_;
+};
+
+} // namespace http
+
+} // namespace http_server
+
+#endif // CONNECTION_TABLE_H_
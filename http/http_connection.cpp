@@ -0,0 +1,95 @@
+/**
+ * @file http_connection.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "http_connection.h"
+
+namespace http_server
+{
+
+namespace http
+{
+
+BufferPool& BufferPool::instance()
+{
+  static BufferPool pool;
+  return pool;
+}
+
+BufferPool::BufferPool()
+  : free_(nullptr),
+    free_num_(0),
+    in_use_(0),
+    peak_(0)
+{
+  my_arena::ChunkPool::instance();  // 先构造块池和接收缓冲区池，它们在缓冲区池之后析构，析构时放回的块仍然有效
+  my_recv_pool::RecvBufferPool::instance();
+}
+
+BufferPool::~BufferPool()
+{
+  while(free_ != nullptr)
+  {
+    ConnectionBuffers *next = free_->next_free;
+    delete free_;
+    free_ = next;
+  }
+}
+
+/**
+ * @brief 取一个缓冲区对象，空闲链表为空时新建
+ *
+ * @return
+ */
+ConnectionBuffers* BufferPool::get()
+{
+  {
+    my_mutex::MutexLockGuard lock(mutex_);
+    if(++in_use_ > peak_)
+      peak_ = in_use_;
+    if(free_ != nullptr)
+    {
+      ConnectionBuffers *buffers = free_;
+      free_ = buffers->next_free;
+      --free_num_;
+      return buffers;
+    }
+  }
+  return new ConnectionBuffers();  // 在锁外分配
+}
+
+void BufferPool::put(ConnectionBuffers *buffers)
+{
+  {
+    my_mutex::MutexLockGuard lock(mutex_);
+    --in_use_;
+    if(free_num_ < MAX_FREE)
+    {
+      buffers->next_free = free_;
+      free_ = buffers;
+      ++free_num_;
+      return;
+    }
+  }
+  delete buffers;
+}
+
+BufferPool::Stats BufferPool::stats()
+{
+  my_mutex::MutexLockGuard lock(mutex_);
+  Stats stats;
+  stats.in_use = in_use_;
+  stats.peak = peak_;
+  stats.free = free_num_;
+  return stats;
+}
+
+} // namespace http
+
+} // namespace http_server
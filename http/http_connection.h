@@ -0,0 +1,319 @@
+/**
+ * @file http_connection.h
+ * @author zX
+ * @brief Per-connection state: compact connection record and pooled request buffers.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef HTTP_CONNECTION_H_
+#define HTTP_CONNECTION_H_
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <my_arena.h>
+#include <my_mutex.h>
+#include <my_recv_pool.h>
+#include "http_parser.h"
+#include "http_response.h"
+#include "output_queue.h"
+#include <open_file_cache.h>
+#include <content_cache.h>
+#include <timer_tick.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+/*
+*@brief 连接处理请求时才需要的状态。读缓冲区 [read_start, read_end) 中是已接收但尚未处理的数据，
+*       一次 recv 可以读入多个流水线请求。读缓冲区从 RecvBufferPool 取，只在有数据要读入或未处理完时持有，
+*       只剩未发完的响应时先还回去，read_buffer 为nullptr。
+*       流水线请求的响应依次加入发送队列 output，套接字发送缓冲区满时未发完的部分留在队列中，等可写后继续发送。
+*       连接空闲（没有未处理的数据、没有未发完的响应）时整个对象还给 BufferPool，空闲的长连接只占用连接记录
+*/
+struct ConnectionBuffers : public boost::noncopyable
+{
+  static const size_t READ_BUFFER_SIZE = MAX_HEADER_SIZE;
+  static_assert(READ_BUFFER_SIZE <= my_recv_pool::RecvBufferPool::BUFFER_SIZE, "request header must fit in a recv buffer");
+
+  ConnectionBuffers()
+    : read_start(0),
+      read_end(0),
+      read_buffer(nullptr),
+      output(&arena),
+      next_free(nullptr)
+  {
+  }
+
+  ~ConnectionBuffers()
+  {
+    release_read_buffer();
+  }
+
+  /*
+  *@brief 没有需要保留的数据，可以还给缓冲区池
+  */
+  bool idle() const { return read_start == read_end && output.empty(); }
+
+  /*
+  *@brief 恢复初始状态。arena 保留第一个块，下一个取到它的连接不需要再访问块池
+  */
+  void clear()
+  {
+    read_start = read_end = 0;
+    release_read_buffer();
+    parser.reset();
+    output.clear();
+    arena.reset();
+  }
+
+  /*
+  *@brief 没有未处理的数据时把读缓冲区还给池
+  */
+  void release_read_buffer()
+  {
+    if(read_buffer == nullptr || read_start != read_end)
+      return;
+    my_recv_pool::RecvBufferPool::instance().put(read_buffer);
+    read_buffer = nullptr;
+    read_start = read_end = 0;
+  }
+
+  /*
+  *@brief 读缓冲区剩余空间，调用前必须已经取得读缓冲区
+  */
+  size_t read_space() const { return READ_BUFFER_SIZE - read_end; }
+
+  /*
+  *@brief 把未处理的数据移到读缓冲区开头
+  */
+  void compact()
+  {
+    if(read_start == 0)
+      return;
+    memmove(read_buffer, read_buffer + read_start, read_end - read_start);
+    read_end -= read_start;
+    read_start = 0;
+  }
+
+  size_t read_start;
+  size_t read_end;
+  char *read_buffer;  // READ_BUFFER_SIZE 字节，从 RecvBufferPool 取
+  HttpParser parser;
+  my_arena::Arena arena;  // 请求和响应的临时内存（url、响应首部），发送队列发空、没有正在处理的请求时 reset
+  OutputQueue output;  // 已生成但还没有发出的响应
+  ConnectionBuffers *next_free;  // 在缓冲区池的空闲链表中时使用
+};
+
+/**
+ * @brief 所有连接共享的 ConnectionBuffers 池（nginx 的空闲连接同样把缓冲区还给池）。
+ *        空闲链表最多保留 MAX_FREE 个对象，多出的直接释放，连接数回落后内存也能还给系统
+ */
+class BufferPool : public boost::noncopyable
+{
+public:
+  static const size_t MAX_FREE = 1024;
+
+  /*
+  *@brief 统计，main 退出时输出
+  */
+  struct Stats
+  {
+    size_t in_use;  // 连接正在使用的个数
+    size_t peak;  // in_use 的最大值
+    size_t free;  // 空闲链表中的个数
+  };
+
+  static BufferPool& instance();
+
+  ConnectionBuffers* get();
+
+  /*
+  *@brief 放回一个对象，调用前必须已经 clear()
+  */
+  void put(ConnectionBuffers *buffers);
+
+  Stats stats();
+
+private:
+  BufferPool();
+  ~BufferPool();
+
+  my_mutex::MutexLock mutex_;
+  ConnectionBuffers *free_;
+  size_t free_num_;
+  size_t in_use_;
+  size_t peak_;
+};
+
+/*
+*@brief 客户端连接记录。每个连接常驻的只有这个定长的小对象：fd、超时定时器、代数和阶段、请求计数，
+*       处理请求用的缓冲区 buffers 在有数据要处理时从 BufferPool 取，空闲时放回，空闲的长连接 buffers 为nullptr。
+*       读缓冲区总数有上限，取不到时连接暂停读取（见 acquire_read_buffer()）。
+*       owner 记录连接当前由谁处理（见 Stage）和代数，每次变化代数加1。持有连接的一方用 advance() 转移，
+*       其他线程（取出工作的工作线程、到期的定时器）只能用 compare_exchange 从自己看到的代数转移，
+*       同一次排队的工作和超时只有一方能成功；代数不同说明看到的是过时的状态。
+*/
+struct HttpConnection : public boost::noncopyable
+{
+  static const size_t READ_BUFFER_SIZE = ConnectionBuffers::READ_BUFFER_SIZE;
+
+  enum Stage
+  {
+    STAGE_CLOSED,  // 已关闭，对象等待同一个fd的下一个连接复用
+    STAGE_IDLE,  // 在 epoll 中等待事件，reactor 持有
+    STAGE_QUEUED,  // 工作在线程池中排队
+    STAGE_RUNNING  // 工作线程（或正在关闭它的 reactor）持有
+  };
+
+  explicit HttpConnection(int client_fd)
+    : fd(client_fd),
+      timer(client_fd, timer_tick::Timer::callback_func_()),
+      requests(0),
+      body_remaining(0),
+      header_deadline(0),
+      buffers(nullptr),
+      reactor(nullptr),
+      close_after_output(false),
+      linger(false),
+      linger_deadline(0),
+      defer_keep_alive(false),
+      lane(0),
+      owner(0)
+  {
+  }
+
+  ~HttpConnection()
+  {
+    release_buffers();
+  }
+
+  /*
+  *@brief 复用连接对象前恢复初始状态。代数保留，之前排队的工作和定时器看到的代数都会过时
+  */
+  void reset()
+  {
+    requests = 0;
+    body_remaining = 0;
+    header_deadline = 0;
+    release_buffers();
+    lane = 0;
+    defer_keep_alive = false;
+    linger = false;
+    linger_deadline = 0;
+  }
+
+  static Stage stage_of(uint64_t value) { return static_cast<Stage>(value & 3); }
+
+  static uint64_t next(uint64_t value, Stage stage) { return (((value >> 2) + 1) << 2) | stage; }
+
+  /*
+  *@brief 持有连接的一方转移到新的阶段
+  *@return 新的代数
+  */
+  uint64_t advance(Stage stage)
+  {
+    uint64_t value = next(owner.load(std::memory_order_relaxed), stage);
+    owner.store(value, std::memory_order_release);
+    return value;
+  }
+
+  /*
+  *@brief 连接仍是 expected 时转移到新的阶段
+  *@return 成功返回true；代数已经变化返回false
+  */
+  bool transfer(uint64_t expected, Stage stage)
+  {
+    return owner.compare_exchange_strong(expected, next(expected, stage), std::memory_order_acq_rel);
+  }
+
+  /*
+  *@brief 处理请求前取得缓冲区，已经有时直接返回
+  */
+  ConnectionBuffers* acquire_buffers()
+  {
+    if(buffers == nullptr)
+      buffers = BufferPool::instance().get();
+    return buffers;
+  }
+
+  /*
+  *@brief 读入数据前取得读缓冲区（和 buffers）。先取读缓冲区：池用完时暂停读取的连接不再占用 buffers
+  *@return 接收缓冲区池已用完返回false，连接应暂停读取，等池中有空闲的缓冲区后再读
+  */
+  bool acquire_read_buffer()
+  {
+    if(buffers != nullptr && buffers->read_buffer != nullptr)
+      return true;
+    char *read_buffer = my_recv_pool::RecvBufferPool::instance().get();
+    if(read_buffer == nullptr)
+      return false;
+    acquire_buffers()->read_buffer = read_buffer;
+    return true;
+  }
+
+  /*
+  *@brief 丢弃未处理的数据和未发完的响应，缓冲区还给池（连接关闭或复用）
+  */
+  void release_buffers()
+  {
+    close_after_output = false;
+    if(buffers == nullptr)
+      return;
+    buffers->clear();
+    BufferPool::instance().put(buffers);
+    buffers = nullptr;
+  }
+
+  /*
+  *@brief 连接空闲时把缓冲区还给池，等待下一个请求期间只占用连接记录；只剩未发完的响应时先还读缓冲区
+  */
+  void release_idle_buffers()
+  {
+    if(buffers == nullptr)
+      return;
+    if(buffers->idle())
+      release_buffers();
+    else
+      buffers->release_read_buffer();
+  }
+
+  /*
+  *@brief 是否有未发完的响应
+  */
+  bool output_pending() const { return buffers != nullptr && !buffers->output.empty(); }
+
+  /*
+  *@brief 读缓冲区中是否有未处理的数据（不完整的请求头）
+  */
+  bool input_pending() const { return buffers != nullptr && buffers->read_end > buffers->read_start; }
+
+  int fd;
+  timer_tick::Timer timer;  // 空闲超时定时器，嵌入在连接中
+  int requests;  // 已处理的请求数
+  size_t body_remaining;  // 当前请求尚未读取（需要丢弃）的请求体字节数
+  int64_t header_deadline;  // 当前请求头必须读完的时刻（单调时钟毫秒），0表示还没有开始读
+  ConnectionBuffers *buffers;  // 正在处理请求时持有的缓冲区，空闲时为nullptr
+  void *reactor;  // 接受该连接的 reactor，连接记录由多个 reactor 共享时使用
+
+  bool close_after_output;  // 队列发完后关闭连接（最后一个响应不保持连接）
+  bool linger;  // 关闭前先读走客户端还在发送的数据（错误响应后关闭），见 TcpEpollServer::linger_client()
+  int64_t linger_deadline;  // 已经关闭写方向、正在丢弃数据时停止等待的时刻，0表示没有开始
+  bool defer_keep_alive;  // 请求转交给较慢的通道时记下的是否保持连接
+  int lane;  // 正在处理该连接的工作所在的线程池通道（work_lane）
+
+  std::atomic<uint64_t> owner;  // (代数 << 2) | Stage
+};
+
+} // namespace http
+
+} // namespace http_server
+
+#endif // HTTP_CONNECTION_H_
@@ -0,0 +1,343 @@
+/**
+ * @file http_parser.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "http_parser.h"
+#include "http_scan.h"
+#include <string.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+/**
+ * @brief 按名字查找首部（忽略大小写）
+ *
+ * @param name
+ * @return 找到返回首部值，否则返回nullptr
+ */
+const StringPiece *HttpRequest::find_header(const char *name) const
+{
+  for(int i = 0; i < header_num; ++i)
+  {
+    if(headers[i].name.equals_nocase(name))
+      return &headers[i].value;
+  }
+  return nullptr;
+}
+
+/**
+ * @brief 重置解析器，准备解析下一个请求
+ *
+ */
+void HttpParser::reset()
+{
+  state_ = REQUEST_LINE;
+  pos_ = 0;
+  scan_pos_ = 0;
+  error_code_ = 0;
+  header_num_ = 0;
+}
+
+HttpParser::ParseResult HttpParser::fail(int code)
+{
+  error_code_ = code;
+  return PARSE_ERROR;
+}
+
+/**
+ * @brief 继续解析请求。data 指向请求起始处，len 为目前已接收的字节数。
+ *
+ * @param data
+ * @param len
+ * @return PARSE_DONE 请求头完整；PARSE_AGAIN 需要更多数据；PARSE_ERROR 请求非法
+ */
+HttpParser::ParseResult HttpParser::parse(const char *data, size_t len)
+{
+  while(state_ != DONE)
+  {
+    const char *nl = find_first_of(data + scan_pos_, data + len, "\n", 1);
+    if(nl == data + len)
+    {
+      scan_pos_ = len;
+      if(len >= MAX_HEADER_SIZE)
+        return fail(state_ == REQUEST_LINE ? 414 : 431);
+      return PARSE_AGAIN;
+    }
+
+    size_t line_end = nl - data;
+    size_t next = line_end + 1;
+    if(next > MAX_HEADER_SIZE)
+      return fail(state_ == REQUEST_LINE ? 414 : 431);
+    if(line_end > pos_ && data[line_end - 1] == '\r')  // 同时接受 "\r\n" 和 "\n" 作为行结束符
+      --line_end;
+
+    if(state_ == REQUEST_LINE)
+    {
+      if(line_end == pos_)  // 忽略请求行之前的空行
+      {
+        pos_ = scan_pos_ = next;
+        continue;
+      }
+      if(!parse_request_line(data, line_end))
+        return PARSE_ERROR;
+      state_ = HEADERS;
+    }
+    else if(line_end == pos_)  // 空行，首部结束
+    {
+      state_ = DONE;
+    }
+    else if(!parse_header_line(data, line_end))
+    {
+      return PARSE_ERROR;
+    }
+    pos_ = scan_pos_ = next;
+  }
+
+  finish(data);
+  return error_code_ == 0 ? PARSE_DONE : PARSE_ERROR;
+}
+
+/**
+ * @brief 解析请求行 "METHOD SP TARGET SP HTTP/1.x"
+ *
+ * @param data 请求起始处
+ * @param line_end 行结束偏移（不含行结束符）
+ * @return 成功返回true
+ */
+bool HttpParser::parse_request_line(const char *data, size_t line_end)
+{
+  const char *line = data + line_end;
+  size_t i = find_first_of(data + pos_, line, " ", 1) - data;
+  method_.begin = pos_;
+  method_.len = i - method_.begin;
+  for(size_t j = method_.begin; j < i; ++j)
+  {
+    if((data[j] < 'A' || data[j] > 'Z') && data[j] != '-' && data[j] != '_')
+    {
+      fail(400);
+      return false;
+    }
+  }
+
+  while(i < line_end && data[i] == ' ')
+    ++i;
+  target_.begin = i;
+  i = find_first_of(data + i, line, " ", 1) - data;
+  target_.len = i - target_.begin;
+
+  while(i < line_end && data[i] == ' ')
+    ++i;
+  version_.begin = i;
+  version_.len = line_end - i;
+
+  if(method_.len == 0 || target_.len == 0 || version_.len == 0)
+  {
+    fail(400);
+    return false;
+  }
+  // HTTP-version = "HTTP/" DIGIT "." DIGIT。格式不对是错误的请求（400），格式正确但不是 1.x 才是不支持的版本（505）
+  const char *version = data + version_.begin;
+  if(version_.len != 8 || memcmp(version, "HTTP/", 5) != 0 || version[5] < '0' || version[5] > '9' ||
+     version[6] != '.' || version[7] < '0' || version[7] > '9')
+  {
+    fail(400);
+    return false;
+  }
+  if(version[5] != '1')
+  {
+    fail(505);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief 解析首部行 "name: value"
+ *
+ * @param data 请求起始处
+ * @param line_end 行结束偏移（不含行结束符）
+ * @return 成功返回true
+ */
+bool HttpParser::parse_header_line(const char *data, size_t line_end)
+{
+  if(data[pos_] == ' ' || data[pos_] == '\t')  // 不支持已废弃的首部折行
+  {
+    fail(400);
+    return false;
+  }
+  if(header_num_ >= MAX_HEADERS)
+  {
+    fail(431);
+    return false;
+  }
+
+  // 首部名和冒号之间不允许空白，所以第一个命中的分隔符必须是冒号
+  const char *colon = find_first_of(data + pos_, data + line_end, ": \t", 3);
+  if(colon == data + line_end || *colon != ':' || colon == data + pos_)
+  {
+    fail(400);
+    return false;
+  }
+  size_t name_end = colon - data;
+
+  size_t value_begin = name_end + 1;
+  size_t value_end = line_end;
+  while(value_begin < value_end && (data[value_begin] == ' ' || data[value_begin] == '\t'))
+    ++value_begin;
+  while(value_end > value_begin && (data[value_end - 1] == ' ' || data[value_end - 1] == '\t'))
+    --value_end;
+
+  header_names_[header_num_].begin = pos_;
+  header_names_[header_num_].len = name_end - pos_;
+  header_values_[header_num_].begin = value_begin;
+  header_values_[header_num_].len = value_end - value_begin;
+  ++header_num_;
+  return true;
+}
+
+/**
+ * @brief 请求头解析完成，生成指向 data 的请求视图并解释 Connection/Content-Length/Transfer-Encoding
+ *
+ * @param data 请求起始处
+ */
+void HttpParser::finish(const char *data)
+{
+  request_.method = StringPiece(data + method_.begin, method_.len);
+  request_.target = StringPiece(data + target_.begin, target_.len);
+  request_.version = StringPiece(data + version_.begin, version_.len);
+  request_.minor_version = data[version_.begin + 7] - '0';
+  request_.header_num = header_num_;
+  request_.keep_alive = request_.minor_version >= 1;  // HTTP/1.1 默认保持连接，HTTP/1.0 默认关闭
+  request_.chunked = false;
+  request_.content_length = 0;
+  bool has_length = false;
+
+  for(int i = 0; i < header_num_; ++i)
+  {
+    HttpHeader &header = request_.headers[i];
+    header.name = StringPiece(data + header_names_[i].begin, header_names_[i].len);
+    header.value = StringPiece(data + header_values_[i].begin, header_values_[i].len);
+
+    if(header.name.equals_nocase("Connection"))
+    {
+      // Connection 的值是逗号分隔的选项列表
+      const char *p = header.value.data;
+      const char *end = p + header.value.len;
+      while(p < end)
+      {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ','))
+          ++p;
+        const char *token = p;
+        while(p < end && *p != ',' && *p != ' ' && *p != '\t')
+          ++p;
+        StringPiece option(token, p - token);
+        if(option.equals_nocase("close"))
+          request_.keep_alive = false;
+        else if(option.equals_nocase("keep-alive"))
+          request_.keep_alive = true;
+      }
+    }
+    else if(header.name.equals_nocase("Content-Length"))
+    {
+      size_t length = 0;
+      if(header.value.len == 0 || header.value.len > 18)
+      {
+        error_code_ = 400;
+        return;
+      }
+      for(size_t j = 0; j < header.value.len; ++j)
+      {
+        char c = header.value.data[j];
+        if(c < '0' || c > '9')
+        {
+          error_code_ = 400;
+          return;
+        }
+        length = length * 10 + (c - '0');
+      }
+      if(has_length && length != request_.content_length)  // 长度不一致时无法确定请求的边界（请求走私），RFC 9112 6.3
+      {
+        error_code_ = 400;
+        return;
+      }
+      has_length = true;
+      request_.content_length = length;
+    }
+    else if(header.name.equals_nocase("Transfer-Encoding"))
+    {
+      request_.chunked = !header.value.equals_nocase("identity");
+    }
+  }
+}
+
+/**
+ * @brief 规范化url路径
+ *
+ * @param path url中'?'之前的部分
+ * @param len
+ * @param out 输出缓冲区，结果以'\0'结尾
+ * @param out_size
+ * @return 结果长度，非法路径返回0
+ */
+size_t normalize_path(const char *path, size_t len, char *out, size_t out_size)
+{
+  if(out_size < 2)
+    return 0;
+  size_t n = 0;
+  out[n++] = '/';
+  bool trailing_slash = true;  // 结果是否以'/'结尾（目录）
+  size_t i = 0;
+  while(i < len)
+  {
+    while(i < len && path[i] == '/')
+      ++i;
+    size_t start = i;
+    while(i < len && path[i] != '/')
+    {
+      if(path[i] == '\0')
+        return 0;
+      ++i;
+    }
+    size_t seg = i - start;
+    if(seg == 0)
+      continue;
+    if(seg == 1 && path[start] == '.')
+    {
+      trailing_slash = true;
+      continue;
+    }
+    if(seg == 2 && path[start] == '.' && path[start + 1] == '.')
+    {
+      if(n == 1)  // 越过根目录
+        return 0;
+      --n;  // 回退到上一段之前的'/'之后
+      while(out[n - 1] != '/')
+        --n;
+      trailing_slash = true;
+      continue;
+    }
+    if(n + seg + 1 >= out_size)
+      return 0;
+    memcpy(out + n, path + start, seg);
+    n += seg;
+    out[n++] = '/';
+    trailing_slash = i < len;
+  }
+  if(!trailing_slash)
+    --n;
+  out[n] = '\0';
+  return n;
+}
+
+} // namespace http
+
+} // namespace http_server
@@ -0,0 +1,153 @@
+/**
+ * @file http_parser.h
+ * @author zX
+ * @brief Incremental http request parser. Parses the request line and headers in place.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef HTTP_PARSER_H_
+#define HTTP_PARSER_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+static const int MAX_HEADERS = 64;  // 单个请求最多的首部数
+static const size_t MAX_HEADER_SIZE = 8192;  // 请求行+首部的最大字节数
+
+/*
+*@brief 字符串视图，指向连接读缓冲区中的数据，不拥有内存
+*/
+struct StringPiece
+{
+  const char *data;
+  size_t len;
+
+  StringPiece() : data(nullptr), len(0) {}
+  StringPiece(const char *d, size_t l) : data(d), len(l) {}
+
+  bool empty() const { return len == 0; }
+
+  /*
+  *@brief 忽略大小写比较
+  */
+  bool equals_nocase(const char *s) const
+  {
+    size_t n = strlen(s);
+    return n == len && strncasecmp(data, s, len) == 0;
+  }
+
+  bool equals(const char *s) const
+  {
+    size_t n = strlen(s);
+    return n == len && memcmp(data, s, len) == 0;
+  }
+};
+
+/*
+*@brief http首部
+*/
+struct HttpHeader
+{
+  StringPiece name;
+  StringPiece value;
+};
+
+/*
+*@brief 解析完成的http请求。所有字段都指向读缓冲区，在下一个请求开始解析前有效
+*/
+struct HttpRequest
+{
+  StringPiece method;
+  StringPiece target;
+  StringPiece version;
+  HttpHeader headers[MAX_HEADERS];
+  int header_num;
+  int minor_version;  // HTTP/1.x 中的 x
+  bool keep_alive;  // 由版本和 Connection 首部决定
+  bool chunked;  // Transfer-Encoding: chunked
+  size_t content_length;
+
+  const StringPiece *find_header(const char *name) const;
+};
+
+/*
+*@brief 可恢复的http请求解析器。
+*       每次调用 parse() 传入从请求起始处开始的全部已接收数据，解析器从上次停止的位置继续，
+*       只处理完整的行；解析结果以相对请求起始处的偏移记录，因此调用者可以在两次调用之间移动缓冲区。
+*/
+class HttpParser
+{
+public:
+  enum ParseResult { PARSE_AGAIN, PARSE_DONE, PARSE_ERROR };
+
+  HttpParser() { reset(); }
+
+  void reset();
+
+  ParseResult parse(const char *data, size_t len);
+
+  /*
+  *@brief 请求头（请求行和首部，含结尾空行）的字节数，PARSE_DONE 后有效
+  */
+  size_t consumed() const { return pos_; }
+
+  /*
+  *@brief 解析失败时应答的状态码（400/431/505）
+  */
+  int error_code() const { return error_code_; }
+
+  /*
+  *@brief 获取解析结果，PARSE_DONE 后有效
+  */
+  const HttpRequest& request() const { return request_; }
+
+private:
+  enum State { REQUEST_LINE, HEADERS, DONE };
+
+  struct Range
+  {
+    size_t begin;
+    size_t len;
+  };
+
+  bool parse_request_line(const char *line, size_t len);
+  bool parse_header_line(const char *line, size_t len);
+  void finish(const char *data);
+  ParseResult fail(int code);
+
+  State state_;
+  size_t pos_;  // 下一行的起始偏移
+  size_t scan_pos_;  // 查找换行符时已扫描到的偏移，避免重复扫描
+  int error_code_;
+
+  Range method_;
+  Range target_;
+  Range version_;
+  Range header_names_[MAX_HEADERS];
+  Range header_values_[MAX_HEADERS];
+  int header_num_;
+
+  HttpRequest request_;
+};
+
+/*
+*@brief 规范化url路径：合并重复的'/'，去掉"."，处理".."。结果以'/'开头，保留结尾的'/'。
+*       ".."越过根目录、路径含NUL或输出缓冲区不足时返回0，否则返回结果长度。
+*/
+size_t normalize_path(const char *path, size_t len, char *out, size_t out_size);
+
+} // namespace http
+
+} // namespace http_server
+
+#endif // HTTP_PARSER_H_
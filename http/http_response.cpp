@@ -0,0 +1,192 @@
+/**
+ * @file http_response.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "http_response.h"
+#include "output_queue.h"
+#include "../parameters.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <map>
+
+namespace http_server
+{
+
+namespace http
+{
+
+static const char KEEP_ALIVE_LINE[] = "Connection: keep-alive\r\n\r\n";
+static const char CLOSE_LINE[] = "Connection: close\r\n\r\n";
+
+ResponseBuilder::ResponseBuilder(my_arena::Arena *arena, int minor_version, int status_code, const char *reason)
+  : arena_(arena),
+    head_(static_cast<char*>(arena->allocate(HEAD_BUFFER_SIZE))),
+    head_size_(HEAD_BUFFER_SIZE),
+    head_len_(0)
+{
+  head_len_ = snprintf(head_, head_size_, "HTTP/1.%d %d %s\r\n" SERVER_STRING,
+                       minor_version >= 1 ? 1 : 0, status_code, reason);
+}
+
+void ResponseBuilder::append(const char *data, size_t len)
+{
+  if(head_len_ + len > head_size_)
+    len = head_size_ - head_len_;
+  memcpy(head_ + head_len_, data, len);
+  head_len_ += len;
+}
+
+/**
+ * @brief 添加首部
+ *
+ * @param name
+ * @param value
+ */
+void ResponseBuilder::add_header(const char *name, const char *value)
+{
+  append(name, strlen(name));
+  append(": ", 2);
+  append(value, strlen(value));
+  append("\r\n", 2);
+}
+
+void ResponseBuilder::add_header(const char *name, size_t value)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%zu", value);
+  add_header(name, buf);
+}
+
+/**
+ * @brief 添加 Connection 首部。必须是最后一个首部，其后紧跟结尾空行。首部已经完整，缓冲区没用到的部分还给 arena
+ *
+ * @param keep_alive
+ */
+void ResponseBuilder::add_keep_alive(bool keep_alive)
+{
+  if(keep_alive)
+    append(KEEP_ALIVE_LINE, sizeof(KEEP_ALIVE_LINE) - 1);
+  else
+    append(CLOSE_LINE, sizeof(CLOSE_LINE) - 1);
+  arena_->shrink(head_, head_len_);
+  head_size_ = head_len_;
+}
+
+struct MimeType
+{
+  const char *extension;
+  const char *type;
+};
+
+static const MimeType mime_types[] = {
+  {"html", "text/html"},
+  {"htm", "text/html"},
+  {"css", "text/css"},
+  {"js", "application/javascript"},
+  {"json", "application/json"},
+  {"txt", "text/plain"},
+  {"xml", "text/xml"},
+  {"png", "image/png"},
+  {"jpg", "image/jpeg"},
+  {"jpeg", "image/jpeg"},
+  {"gif", "image/gif"},
+  {"svg", "image/svg+xml"},
+  {"ico", "image/x-icon"},
+  {"webp", "image/webp"},
+  {"woff", "font/woff"},
+  {"woff2", "font/woff2"},
+  {"pdf", "application/pdf"},
+  {"zip", "application/zip"},
+  {"gz", "application/gzip"},
+  {"mp4", "video/mp4"},
+};
+
+const char *mime_type(const char *path)
+{
+  const char *dot = strrchr(path, '.');
+  const char *slash = strrchr(path, '/');
+  if(dot == nullptr || (slash != nullptr && dot < slash))
+    return "application/octet-stream";
+  for(size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); ++i)
+  {
+    if(strcasecmp(dot + 1, mime_types[i].extension) == 0)
+      return mime_types[i].type;
+  }
+  return "application/octet-stream";
+}
+
+/**
+ * @brief 生成一个错误响应
+ *
+ */
+static CannedResponse render(int status_code, const char *reason, const char *message, const char *extra_headers)
+{
+  CannedResponse response;
+  response.status_code = status_code;
+  char buf[1024];
+  snprintf(buf, sizeof(buf),
+           "<HTML><HEAD><TITLE>%s</TITLE></HEAD>\r\n<BODY><P>%s\r\n</BODY></HTML>\r\n", reason, message);
+  response.body = buf;
+  snprintf(buf, sizeof(buf),
+           "HTTP/1.1 %d %s\r\n" SERVER_STRING "Content-Type: text/html\r\nContent-Length: %zu\r\n%s",
+           status_code, reason, response.body.size(), extra_headers);
+  response.head = buf;
+  return response;
+}
+
+/*
+*@brief 启动时生成全部错误响应
+*/
+static std::map<int, CannedResponse> render_all()
+{
+  std::map<int, CannedResponse> responses;
+  responses[400] = render(400, "Bad Request", "Your browser sent a request that this server could not understand.", "");
+  responses[404] = render(404, "Not Found",
+                          "The server could not fulfill your request because the resource specified is unavailable or nonexistent.", "");
+  responses[414] = render(414, "URI Too Long", "The requested URL is too long.", "");
+  responses[431] = render(431, "Request Header Fields Too Large", "The request header fields are too large.", "");
+  responses[500] = render(500, "Internal Server Error", "The server encountered an internal error.", "");
+  responses[501] = render(501, "Method Not Implemented", "HTTP request method not supported.", "");
+  responses[503] = render(503, "Service Unavailable", "The server is temporarily busy, try again later.", "Retry-After: 1\r\n");
+  responses[505] = render(505, "HTTP Version Not Supported", "The HTTP version is not supported.", "");
+  return responses;
+}
+
+static const std::map<int, CannedResponse> canned_responses = render_all();
+
+const CannedResponse &canned_response(int status_code)
+{
+  std::map<int, CannedResponse>::const_iterator iter = canned_responses.find(status_code);
+  if(iter == canned_responses.end())
+    iter = canned_responses.find(500);
+  return iter->second;
+}
+
+/**
+ * @brief 把预先生成的错误响应加入连接的发送队列。三部分都是静态数据，不复制
+ *
+ * @param out
+ * @param status_code
+ * @param keep_alive 发送后是否保持连接（决定 Connection 首部）
+ */
+void append_canned_response(OutputQueue *out, int status_code, bool keep_alive)
+{
+  const CannedResponse &response = canned_response(status_code);
+  out->append_static(response.head.data(), response.head.size());
+  if(keep_alive)
+    out->append_static(KEEP_ALIVE_LINE, sizeof(KEEP_ALIVE_LINE) - 1);
+  else
+    out->append_static(CLOSE_LINE, sizeof(CLOSE_LINE) - 1);
+  out->append_static(response.body.data(), response.body.size());
+}
+
+} // namespace http
+
+} // namespace http_server
@@ -0,0 +1,88 @@
+/**
+ * @file http_response.h
+ * @author zX
+ * @brief Http response builder. Status line and headers are built in the connection arena.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef HTTP_RESPONSE_H_
+#define HTTP_RESPONSE_H_
+
+#include <stddef.h>
+#include <string>
+#include <my_arena.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+/*
+*@brief 响应构建器。状态行和首部直接写入从连接 arena 分配的缓冲区（arena reset 之前一直有效，可以直接加入发送队列），
+*       响应体由调用者另外加入发送队列。
+*/
+class ResponseBuilder
+{
+public:
+  static const size_t HEAD_BUFFER_SIZE = 1024;
+
+  ResponseBuilder(my_arena::Arena *arena, int minor_version, int status_code, const char *reason);
+
+  void add_header(const char *name, const char *value);
+
+  void add_header(const char *name, size_t value);
+
+  void add_keep_alive(bool keep_alive);
+
+  /*
+  *@brief 状态行和首部，add_keep_alive() 之后完整
+  */
+  const char *head() const { return head_; }
+
+  size_t head_len() const { return head_len_; }
+
+private:
+  void append(const char *data, size_t len);
+
+  my_arena::Arena *arena_;
+  char *head_;
+  size_t head_size_;
+  size_t head_len_;
+};
+
+/*
+*@brief 根据文件扩展名得到 Content-Type
+*/
+const char *mime_type(const char *path);
+
+/*
+*@brief 启动时预先生成的错误响应。head 不含 Connection 首部和结尾空行，发送时再补上。
+*/
+struct CannedResponse
+{
+  int status_code;
+  std::string head;
+  std::string body;
+};
+
+/*
+*@brief 获取预先生成的错误响应（400/404/414/431/500/501/503/505），未知状态码返回500
+*/
+const CannedResponse &canned_response(int status_code);
+
+class OutputQueue;
+
+/*
+*@brief 把预先生成的错误响应加入发送队列
+*/
+void append_canned_response(OutputQueue *out, int status_code, bool keep_alive);
+
+} // namespace http
+
+} // namespace http_server
+
+#endif // HTTP_RESPONSE_H_
@@ -0,0 +1,199 @@
+/**
+ * @file http_scan.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "http_scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HTTP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace http_server
+{
+
+namespace http
+{
+
+/**
+ * @brief 逐字节查找，所有平台可用
+ *
+ */
+const char *scan_scalar(const char *p, const char *end, const char *delims, int ndelims)
+{
+  for(; p < end; ++p)
+  {
+    char c = *p;
+    for(int i = 0; i < ndelims; ++i)
+    {
+      if(c == delims[i])
+        return p;
+    }
+  }
+  return end;
+}
+
+#ifdef HTTP_SCAN_X86
+
+/**
+ * @brief SSE4.2：PCMPESTRI 一次比较16字节和最多16个分隔符
+ *
+ */
+__attribute__((target("sse4.2")))
+const char *scan_sse42(const char *p, const char *end, const char *delims, int ndelims)
+{
+  char set_bytes[16] = {0};
+  memcpy(set_bytes, delims, ndelims);
+  const __m128i set = _mm_loadu_si128(reinterpret_cast<const __m128i*>(set_bytes));
+  for(; end - p >= 16; p += 16)
+  {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int index = _mm_cmpestri(set, ndelims, chunk, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+    if(index < 16)
+      return p + index;
+  }
+  return scan_scalar(p, end, delims, ndelims);
+}
+
+/**
+ * @brief AVX2：每个分隔符广播后与32字节逐字节比较，合并后取最低位
+ *
+ */
+__attribute__((target("avx2")))
+const char *scan_avx2(const char *p, const char *end, const char *delims, int ndelims)
+{
+  // 不足4个分隔符时用第一个分隔符补齐，结果不变
+  const __m256i d0 = _mm256_set1_epi8(delims[0]);
+  const __m256i d1 = _mm256_set1_epi8(delims[ndelims > 1 ? 1 : 0]);
+  const __m256i d2 = _mm256_set1_epi8(delims[ndelims > 2 ? 2 : 0]);
+  const __m256i d3 = _mm256_set1_epi8(delims[ndelims > 3 ? 3 : 0]);
+  for(; end - p >= 32; p += 32)
+  {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hit = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, d0), _mm256_cmpeq_epi8(chunk, d1)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, d2), _mm256_cmpeq_epi8(chunk, d3)));
+    unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(hit));
+    if(mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  // 不足32字节的尾部在本函数内处理（VEX编码），避免调用SSE函数带来的AVX/SSE状态切换开销
+  const __m128i e0 = _mm256_castsi256_si128(d0);
+  const __m128i e1 = _mm256_castsi256_si128(d1);
+  const __m128i e2 = _mm256_castsi256_si128(d2);
+  const __m128i e3 = _mm256_castsi256_si128(d3);
+  for(; end - p >= 16; p += 16)
+  {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hit = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, e0), _mm_cmpeq_epi8(chunk, e1)),
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, e2), _mm_cmpeq_epi8(chunk, e3)));
+    unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+    if(mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return scan_scalar(p, end, delims, ndelims);
+}
+
+bool scan_supported(ScanImpl impl)
+{
+  __builtin_cpu_init();
+  switch(impl)
+  {
+  case SCAN_AVX2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+  case SCAN_SSE42:
+    return __builtin_cpu_supports("sse4.2");
+  default:
+    return true;
+  }
+}
+
+#else  // !HTTP_SCAN_X86
+
+const char *scan_sse42(const char *p, const char *end, const char *delims, int ndelims)
+{
+  return scan_scalar(p, end, delims, ndelims);
+}
+
+const char *scan_avx2(const char *p, const char *end, const char *delims, int ndelims)
+{
+  return scan_scalar(p, end, delims, ndelims);
+}
+
+bool scan_supported(ScanImpl impl)
+{
+  return impl == SCAN_SCALAR;
+}
+
+#endif  // HTTP_SCAN_X86
+
+static ScanImpl current_impl = SCAN_SCALAR;
+
+static ScanFunc impl_func(ScanImpl impl)
+{
+  switch(impl)
+  {
+  case SCAN_AVX2:
+    return scan_avx2;
+  case SCAN_SSE42:
+    return scan_sse42;
+  default:
+    return scan_scalar;
+  }
+}
+
+/**
+ * @brief 选择当前CPU支持的最快实现
+ *
+ */
+static ScanFunc select_scan_func()
+{
+  if(scan_supported(SCAN_AVX2))
+    current_impl = SCAN_AVX2;
+  else if(scan_supported(SCAN_SSE42))
+    current_impl = SCAN_SSE42;
+  else
+    current_impl = SCAN_SCALAR;
+  return impl_func(current_impl);
+}
+
+ScanFunc scan_func = select_scan_func();
+
+void set_scan_impl(ScanImpl impl)
+{
+  if(!scan_supported(impl))
+    return;
+  current_impl = impl;
+  scan_func = impl_func(impl);
+}
+
+ScanImpl scan_impl()
+{
+  return current_impl;
+}
+
+const char *scan_impl_name(ScanImpl impl)
+{
+  switch(impl)
+  {
+  case SCAN_AVX2:
+    return "avx2";
+  case SCAN_SSE42:
+    return "sse4.2";
+  default:
+    return "scalar";
+  }
+}
+
+} // namespace http
+
+} // namespace http_server
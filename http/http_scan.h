@@ -0,0 +1,66 @@
+/**
+ * @file http_scan.h
+ * @author zX
+ * @brief Delimiter scanning kernels (AVX2 / SSE4.2 / scalar) used by the request parser.
+ *        The fastest kernel supported by the running CPU is selected at startup.
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef HTTP_SCAN_H_
+#define HTTP_SCAN_H_
+
+#include <assert.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+static const int MAX_SCAN_DELIMS = 4;  // 一次最多查找的分隔符个数
+
+/*
+*@brief 查找函数：返回 [p, end) 中第一个等于 delims[0..ndelims) 之一的字符位置，找不到返回 end。
+*       ndelims 必须在 1 到 MAX_SCAN_DELIMS 之间：scan_avx2 只比较前4个分隔符，scan_sse42 把分隔符复制到16字节的向量里
+*/
+typedef const char *(*ScanFunc)(const char *p, const char *end, const char *delims, int ndelims);
+
+enum ScanImpl { SCAN_SCALAR, SCAN_SSE42, SCAN_AVX2 };
+
+const char *scan_scalar(const char *p, const char *end, const char *delims, int ndelims);
+const char *scan_sse42(const char *p, const char *end, const char *delims, int ndelims);
+const char *scan_avx2(const char *p, const char *end, const char *delims, int ndelims);
+
+/*
+*@brief 当前CPU是否支持该实现
+*/
+bool scan_supported(ScanImpl impl);
+
+/*
+*@brief 切换查找实现（用于基准测试），不支持的实现会被忽略
+*/
+void set_scan_impl(ScanImpl impl);
+
+ScanImpl scan_impl();
+
+const char *scan_impl_name(ScanImpl impl);
+
+extern ScanFunc scan_func;
+
+/*
+*@brief 使用运行时选择的实现查找分隔符
+*/
+inline const char *find_first_of(const char *p, const char *end, const char *delims, int ndelims)
+{
+  assert(ndelims > 0 && ndelims <= MAX_SCAN_DELIMS);
+  return scan_func(p, end, delims, ndelims);
+}
+
+} // namespace http
+
+} // namespace http_server
+
+#endif // HTTP_SCAN_H_
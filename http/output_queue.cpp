@@ -0,0 +1,232 @@
+/**
+ * @file output_queue.cpp
+ * @author zX
+ * @brief
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "output_queue.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+/*
+*@brief 在队尾加入一个段
+*/
+OutputQueue::Segment &OutputQueue::push(SegmentType type, size_t len)
+{
+  assert(count_ < MAX_SEGMENTS);  // 调用方在 full() 之后不再加入响应，一个响应最多3个段
+  Segment &segment = at(count_);
+  ++count_;
+  segment.type = type;
+  segment.len = len;
+  segment.pos = 0;
+  segment.offset = 0;
+  segment.data = nullptr;
+  bytes_ += len;
+  return segment;
+}
+
+/*
+*@brief 移除队首的段，释放它持有的引用
+*/
+void OutputQueue::pop()
+{
+  Segment &segment = at(0);
+  segment.content.reset();
+  segment.file.reset();
+  head_ = (head_ + 1) % MAX_SEGMENTS;
+  --count_;
+  if(count_ == 0)
+    head_ = 0;
+}
+
+const char *OutputQueue::memory(const Segment &segment) const
+{
+  switch(segment.type)
+  {
+  case SEG_ARENA:
+  case SEG_STATIC:
+    return segment.data + segment.pos;
+  case SEG_CONTENT:
+    return segment.content->data.data() + segment.pos;
+  default:
+    return nullptr;
+  }
+}
+
+/**
+ * @brief 加入 arena 中的数据。紧跟在上一个 arena 段之后（同一个块中连续分配）时合并成一个段
+ *
+ * @param data
+ * @param len
+ */
+void OutputQueue::append_arena(const char *data, size_t len)
+{
+  if(len == 0)
+    return;
+  if(count_ > 0)
+  {
+    Segment &last = at(count_ - 1);
+    if(last.type == SEG_ARENA && last.data + last.pos + last.len == data)
+    {
+      last.len += len;
+      bytes_ += len;
+      return;
+    }
+  }
+  Segment &segment = push(SEG_ARENA, len);
+  segment.data = data;
+}
+
+void OutputQueue::append_copy(const char *data, size_t len)
+{
+  if(len == 0)
+    return;
+  char *copy = static_cast<char*>(arena_->allocate(len));
+  memcpy(copy, data, len);
+  append_arena(copy, len);
+}
+
+void OutputQueue::append_static(const char *data, size_t len)
+{
+  if(len == 0)
+    return;
+  Segment &segment = push(SEG_STATIC, len);
+  segment.data = data;
+}
+
+void OutputQueue::append_content(const cache::ContentPtr &content, size_t pos, size_t len)
+{
+  if(len == 0)
+    return;
+  Segment &segment = push(SEG_CONTENT, len);
+  segment.pos = pos;
+  segment.content = content;
+}
+
+void OutputQueue::append_file(const cache::OpenFilePtr &file, off_t offset, size_t len)
+{
+  if(len == 0)
+    return;
+  Segment &segment = push(SEG_FILE, len);
+  segment.offset = offset;
+  segment.file = file;
+}
+
+int OutputQueue::fill_iov(struct iovec *iov, int max, size_t *bytes, const Segment **file) const
+{
+  int n = 0;
+  *bytes = 0;
+  *file = nullptr;
+  for(int i = 0; i < count_; ++i)
+  {
+    const Segment &segment = at(i);
+    if(segment.type == SEG_FILE)
+    {
+      *file = &segment;
+      break;
+    }
+    if(n == max)
+      break;
+    iov[n].iov_base = const_cast<char*>(memory(segment));
+    iov[n].iov_len = segment.len;
+    *bytes += segment.len;
+    ++n;
+  }
+  return n;
+}
+
+void OutputQueue::consume(size_t n)
+{
+  bytes_ -= n;
+  while(n > 0)
+  {
+    Segment &segment = at(0);
+    size_t part = n < segment.len ? n : segment.len;
+    segment.len -= part;
+    segment.pos += part;
+    segment.offset += part;
+    n -= part;
+    if(segment.len == 0)
+      pop();
+  }
+  while(count_ > 0 && at(0).len == 0)
+    pop();
+}
+
+void OutputQueue::clear()
+{
+  while(count_ > 0)
+    pop();
+  bytes_ = 0;
+}
+
+/**
+ * @brief 尽量发送队列中的数据。队首连续的内存段合并成一次 sendmsg，后面还有文件区间时加 MSG_MORE，
+ *        让首部和文件开头合并到同一个TCP报文段；文件区间用 sendfile 零拷贝发送。
+ *        一次没有发完说明套接字缓冲区（TCP_NOTSENT_LOWAT 限制的未发送量）已满，直接返回，不再多试一次 EAGAIN
+ *
+ * @param fd 非阻塞套接字
+ * @return FLUSH_DONE 发空；FLUSH_AGAIN 等待可写；FLUSH_ERROR 出错
+ */
+OutputQueue::FlushResult OutputQueue::flush(int fd)
+{
+  while(count_ > 0)
+  {
+    Segment &front = at(0);
+    if(front.type == SEG_FILE)
+    {
+      off_t offset = front.offset;
+      ssize_t n = sendfile(fd, front.file->fd, &offset, front.len);
+      if(n < 0)
+      {
+        if(errno == EINTR)
+          continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? FLUSH_AGAIN : FLUSH_ERROR;
+      }
+      if(n == 0)  // 文件在发送过程中被截断，已经无法满足 Content-Length
+        return FLUSH_ERROR;
+      bool partial = static_cast<size_t>(n) < front.len;
+      consume(n);
+      if(partial)
+        return FLUSH_AGAIN;
+      continue;
+    }
+
+    struct iovec iov[MAX_IOV];
+    size_t bytes;
+    const Segment *file;
+    int iovcnt = fill_iov(iov, MAX_IOV, &bytes, &file);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | (file != nullptr ? MSG_MORE : 0));
+    if(n < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? FLUSH_AGAIN : FLUSH_ERROR;
+    }
+    consume(n);
+    if(static_cast<size_t>(n) < bytes)
+      return FLUSH_AGAIN;
+  }
+  return FLUSH_DONE;
+}
+
+} // namespace http
+
+} // namespace http_server
@@ -0,0 +1,138 @@
+/**
+ * @file output_queue.h
+ * @author zX
+ * @brief per connection queue of unsent response segments
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef OUTPUT_QUEUE_H_
+#define OUTPUT_QUEUE_H_
+
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <my_arena.h>
+#include <open_file_cache.h>
+#include <content_cache.h>
+
+namespace http_server
+{
+
+namespace http
+{
+
+/**
+ * @brief 连接的待发送数据队列。流水线上的多个响应按顺序排队，一次 sendmsg 发送队首连续的内存段，
+ *        文件区间用 sendfile 发送。套接字缓冲区满时数据留在队列中，等可写后从断点继续，不会丢失。
+ *        段的种类：
+ *        SEG_ARENA   连接 arena 中的数据（在 arena 中生成的响应首部），队列发空之前连接不会 reset arena
+ *        SEG_STATIC  生命期比连接长的数据（预先生成的错误响应），只保存指针
+ *        SEG_CONTENT 内容缓存中的条目，段持有引用，缓存淘汰它也不影响发送
+ *        SEG_FILE    打开文件缓存中文件的 [offset, offset + len) 区间，段持有文件描述符的引用
+ */
+class OutputQueue : public boost::noncopyable
+{
+public:
+  enum SegmentType { SEG_ARENA, SEG_STATIC, SEG_CONTENT, SEG_FILE };
+
+  enum FlushResult
+  {
+    FLUSH_DONE,  // 队列已发空
+    FLUSH_AGAIN,  // 套接字缓冲区满，等待可写
+    FLUSH_ERROR  // 连接出错或文件被截断
+  };
+
+  struct Segment
+  {
+    SegmentType type;
+    size_t pos;  // 内存段：已发送的字节数
+    size_t len;  // 剩余未发送的字节数
+    off_t offset;  // SEG_FILE：下一个要发送的文件偏移
+    const char *data;  // SEG_ARENA/SEG_STATIC 的数据
+    cache::ContentPtr content;
+    cache::OpenFilePtr file;
+  };
+
+  static const int MAX_SEGMENTS = 32;
+  static const int MAX_IOV = 16;  // 一次 sendmsg 最多合并的内存段
+  static const size_t HIGH_WATER = 64 * 1024;  // 排队的字节数超过它时暂停处理后面的流水线请求
+  // 连接套接字的 TCP_NOTSENT_LOWAT：尚未发出的数据超过它时套接字不再可写。内核只缓冲少量待发数据，
+  // 其余留在队列中（引用缓存和文件，不复制），慢速客户端占用的内核内存有上限，可写事件也只在确实能继续发送时触发
+  static const int NOTSENT_LOWAT = 64 * 1024;
+
+  explicit OutputQueue(my_arena::Arena *arena) : arena_(arena), head_(0), count_(0), bytes_(0) {}
+
+  /*
+  *@brief 加入已经在连接 arena 中的数据
+  */
+  void append_arena(const char *data, size_t len);
+
+  /*
+  *@brief 把数据复制到连接 arena 后加入
+  */
+  void append_copy(const char *data, size_t len);
+
+  void append_static(const char *data, size_t len);
+
+  void append_content(const cache::ContentPtr &content, size_t pos, size_t len);
+
+  void append_file(const cache::OpenFilePtr &file, off_t offset, size_t len);
+
+  bool empty() const { return count_ == 0; }
+
+  /*
+  *@brief 排队的字节数（文件区间按长度计）
+  */
+  size_t bytes() const { return bytes_; }
+
+  /*
+  *@brief 排队的数据已经足够多，应该先发送再继续处理请求
+  */
+  bool full() const { return bytes_ >= HIGH_WATER || count_ > MAX_SEGMENTS - 4; }
+
+  /*
+  *@brief 用非阻塞的 sendmsg/sendfile 尽量发送队列中的数据
+  */
+  FlushResult flush(int fd);
+
+  /*
+  *@brief 把队首连续的内存段填入 iovec（供 io_uring 的 sendmsg 使用）
+  *@param iov 输出
+  *@param max iov 的容量
+  *@param bytes 输出，填入的字节数
+  *@param file 输出，内存段之后紧跟的文件段，没有时为nullptr
+  *@return 填入的 iovec 个数
+  */
+  int fill_iov(struct iovec *iov, int max, size_t *bytes, const Segment **file) const;
+
+  /*
+  *@brief 已经发送了 n 个字节，从队首移除
+  */
+  void consume(size_t n);
+
+  void clear();
+
+private:
+  Segment &at(int i) { return segments_[(head_ + i) % MAX_SEGMENTS]; }
+  const Segment &at(int i) const { return segments_[(head_ + i) % MAX_SEGMENTS]; }
+
+  Segment &push(SegmentType type, size_t len);
+  void pop();
+  const char *memory(const Segment &segment) const;
+
+  my_arena::Arena *arena_;
+  Segment segments_[MAX_SEGMENTS];  // 环形数组，不为每个段分配内存
+  int head_;
+  int count_;
+  size_t bytes_;
+};
+
+} // namespace http
+
+} // namespace http_server
+
+#endif // OUTPUT_QUEUE_H_
@@ -11,6 +11,23 @@
 #include "parameters.h"
 #include "thread_pool.h"
 #include "TcpEpollServer.h"
+#include "TcpUringServer.h"
+#include <content_cache.h>
+#include <open_file_cache.h>
+#include <negative_cache.h>
+#include <my_thread.h>
+#include <my_arena.h>
+#include <my_recv_pool.h>
+#include <http_connection.h>
+#include <connection_table.h>
+#include <memory>
+#include <vector>
+#include <limits.h>
+#include <string.h>
+#include <sys/resource.h>
+
+static const size_t MAX_OPEN_FILES = 1024;  // 缓存的文件描述符个数上限
+static const size_t MAX_NEGATIVE_ENTRIES = 4096;  // 缓存的不存在路径个数上限
 
 int main(int argc, char *argv[])
 {
@@ -18,7 +35,77 @@ int main(int argc, char *argv[])
   parameters.displayConfig();
   http_server::ThreadPool pool(&parameters);
   pool.start();
-  http_server::TcpEpollServer server(&pool, &parameters);
-  server.handle_request();
+  http_server::cache::ContentCache content_cache(static_cast<size_t>(parameters.getCacheSize()) * 1024,
+                                                 parameters.getCacheValidTime());
+  http_server::cache::OpenFileCache open_files(parameters.getDocumentRoot(), parameters.getDefaultFile(),
+                                               parameters.getCacheValidTime(), MAX_OPEN_FILES);
+  http_server::cache::NegativeCache negative_cache(parameters.getDocumentRoot(), parameters.getCacheValidTime(),
+                                                   MAX_NEGATIVE_ENTRIES);
+
+  // 多reactor模式：每个reactor拥有自己的SO_REUSEPORT监听套接字、事件循环（epoll 或 io_uring）、定时器队列和客户端表。
+  // reactor 0 运行在主线程上，其余各自一个线程。
+  bool uring = strcmp(parameters.getBackend(), "uring") == 0;
+  if(uring && !http_server::TcpUringServer::supported())
+  {
+    printf("io_uring backend is not supported by this kernel, fall back to epoll\n");
+    uring = false;
+  }
+  // 打开文件数的软限制提高到硬限制。连接表（io_uring 后端是每个reactor的固定文件表）按它确定容量
+  struct rlimit nofile;
+  int max_fd = 1024;
+  if(getrlimit(RLIMIT_NOFILE, &nofile) == 0)
+  {
+    if(nofile.rlim_cur < nofile.rlim_max)
+    {
+      nofile.rlim_cur = nofile.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &nofile);
+      getrlimit(RLIMIT_NOFILE, &nofile);
+    }
+    max_fd = nofile.rlim_cur < static_cast<rlim_t>(INT_MAX) ? static_cast<int>(nofile.rlim_cur) : INT_MAX;
+  }
+  http_server::TcpEpollServer::ConnectionTable connections(max_fd);  // 所有 epoll reactor 共享，按fd索引
+  // 接收缓冲区总数的上限，用完时连接暂停读取，慢速上传的连接再多内存也有界
+  my_recv_pool::RecvBufferPool::instance().configure(static_cast<size_t>(parameters.getRecvBuffers()),
+                                                     parameters.getHugePages());
+
+  int reactor_num = parameters.getReactorNum();
+  std::vector<std::shared_ptr<http_server::TcpServer>> servers;
+  std::vector<std::shared_ptr<my_thread::Thread>> reactor_threads;
+  for(int i = 0; i < reactor_num; ++i)
+  {
+    if(uring)
+      servers.push_back(std::make_shared<http_server::TcpUringServer>(&pool, &parameters, &content_cache, &open_files, &negative_cache));
+    else
+      servers.push_back(std::make_shared<http_server::TcpEpollServer>(&pool, &parameters, &content_cache, &open_files, &negative_cache,
+                                                                          &connections));
+  }
+  for(int i = 1; i < reactor_num; ++i)
+  {
+    reactor_threads.push_back(std::make_shared<my_thread::Thread>(
+      &http_server::TcpServer::handle_request, servers[i].get()));
+    reactor_threads.back()->start();
+  }
+  servers[0]->handle_request();
+  for(size_t i = 0; i < reactor_threads.size(); ++i)
+  {
+    reactor_threads[i]->join();
+  }
+  my_arena::Arena::Stats arena_stats = my_arena::Arena::stats();
+  printf("arena: request high water %zu bytes, %zu chunks (%zu free), %zu large allocations\n",
+         arena_stats.high_water, arena_stats.chunks, arena_stats.free_chunks, arena_stats.large_allocs);
+  http_server::http::BufferPool::Stats buffer_stats = http_server::http::BufferPool::instance().stats();
+  printf("connection buffers: %zu in use, peak %zu, %zu free; connection table: %d pages of %d records\n",
+         buffer_stats.in_use, buffer_stats.peak, buffer_stats.free,
+         connections.pages(), http_server::TcpEpollServer::ConnectionTable::PAGE_SIZE);
+  my_recv_pool::RecvBufferPool::Stats recv_stats = my_recv_pool::RecvBufferPool::instance().stats();
+  printf("recv buffers: %zu in use or cached, peak %zu, %zu allocated in %zu slabs (%zu huge page), exhausted %zu times\n",
+         recv_stats.in_use, recv_stats.peak, recv_stats.buffers, recv_stats.slabs, recv_stats.huge_slabs,
+         recv_stats.exhausted);
+  http_server::ThreadPool::PoolStats pool_stats = pool.stats();
+  printf("thread pool: %d threads, queue delay %lld us, shedding %s, %zu shed, %zu stale\n",
+         pool_stats.threads, static_cast<long long>(pool_stats.queue_delay_us),
+         pool_stats.shedding ? "yes" : "no", pool_stats.shed, pool_stats.stale);
+  printf("pool work: %zu allocated, %zu freed, %zu heap callables\n",
+         pool_stats.work_allocs, pool_stats.work_frees, pool_stats.heap_funcs);
   pool.close_pool();
 }
\ No newline at end of file
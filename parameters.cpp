@@ -13,6 +13,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <string>
+#include <algorithm>
+#include <unistd.h>
 
 
 namespace http_server
@@ -25,11 +27,26 @@ Parameters::Parameters(int argc, char *argv[])
       default_file_("index.html"),
       document_root_("doc"),
       config_file_("doc/config.xml"),
+      backend_(BACKEND),
       listen_port_(LISTEN_PORT),
       max_client_(MAX_CLIENT),
       time_out_(TIME_OUT),
       init_worker_num_(INIT_WORKER_NUM),
-      max_work_num_(MAX_WORK_NUM)
+      max_work_num_(MAX_WORK_NUM),
+      reactor_num_(REACTOR_NUM),
+      keep_alive_timeout_(KEEP_ALIVE_TIMEOUT),
+      keep_alive_requests_(KEEP_ALIVE_REQUESTS),
+      cache_size_(CACHE_SIZE),
+      cache_valid_time_(CACHE_VALID_TIME),
+      header_timeout_(HEADER_TIMEOUT),
+      body_timeout_(BODY_TIMEOUT),
+      send_timeout_(SEND_TIMEOUT),
+      min_worker_num_(MIN_WORKER_NUM),
+      max_worker_num_(MAX_WORKER_NUM),
+      queue_target_(QUEUE_TARGET),
+      queue_interval_(QUEUE_INTERVAL),
+      recv_buffers_(RECV_BUFFERS),
+      huge_pages_(HUGE_PAGES)
 {
   loadConfig();
   if (argc >= 2 && argv != nullptr)
@@ -80,6 +97,81 @@ Parameters::Parameters(int argc, char *argv[])
         printf("set MaxWorkerNum: %d\n", value);
         max_work_num_ = value;
         break;
+      case 'r':
+        value = atoi(optarg);
+        printf("set ReactorNum: %d\n", value);
+        reactor_num_ = value;
+        break;
+      case 'k':
+        value = atoi(optarg);
+        printf("set KeepAliveTimeout: %d\n", value);
+        keep_alive_timeout_ = value;
+        break;
+      case 'q':
+        value = atoi(optarg);
+        printf("set KeepAliveRequests: %d\n", value);
+        keep_alive_requests_ = value;
+        break;
+      case 's':
+        value = atoi(optarg);
+        printf("set CacheSize: %d\n", value);
+        cache_size_ = value;
+        break;
+      case 'v':
+        value = atoi(optarg);
+        printf("set CacheValidTime: %d\n", value);
+        cache_valid_time_ = value;
+        break;
+      case 'e':
+        value = atoi(optarg);
+        printf("set HeaderTimeout: %d\n", value);
+        header_timeout_ = value;
+        break;
+      case 'b':
+        value = atoi(optarg);
+        printf("set BodyTimeout: %d\n", value);
+        body_timeout_ = value;
+        break;
+      case 'n':
+        value = atoi(optarg);
+        printf("set SendTimeout: %d\n", value);
+        send_timeout_ = value;
+        break;
+      case 'a':
+        value = atoi(optarg);
+        printf("set MinWorkerNum: %d\n", value);
+        min_worker_num_ = value;
+        break;
+      case 'x':
+        value = atoi(optarg);
+        printf("set MaxWorkerNum: %d\n", value);
+        max_worker_num_ = value;
+        break;
+      case 'g':
+        value = atoi(optarg);
+        printf("set QueueTarget: %d\n", value);
+        queue_target_ = value;
+        break;
+      case 'u':
+        value = atoi(optarg);
+        printf("set QueueInterval: %d\n", value);
+        queue_interval_ = value;
+        break;
+      case 'p':
+        value = atoi(optarg);
+        printf("set RecvBuffers: %d\n", value);
+        recv_buffers_ = value;
+        break;
+      case 'j':
+        value = atoi(optarg);
+        printf("set HugePages: %d\n", value);
+        huge_pages_ = value;
+        break;
+      case 'y':
+        printf("set Backend: %s\n", optarg);
+        strncpy(backend_, optarg, sizeof(backend_) - 1);
+        backend_[MAX_FILE_LINE - 1] = '\0';
+        break;
       case 'h':
         printf("help test");
         break;
@@ -88,9 +180,17 @@ Parameters::Parameters(int argc, char *argv[])
       }
     }
   }
-  char path[BUFSIZ];
-  sprintf(path, "%s%s%s", document_root_, "/", default_file_);//发送格式化输出到path所指向的字符串。
-  file_lists_.push_back(path);
+  if(reactor_num_ <= 0)
+  {
+    reactor_num_ = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));//每个在线CPU核心一个reactor
+    if(reactor_num_ <= 0)
+      reactor_num_ = 1;
+  }
+  if(min_worker_num_ < 1)
+    min_worker_num_ = 1;
+  if(max_worker_num_ < min_worker_num_)
+    max_worker_num_ = min_worker_num_;
+  init_worker_num_ = std::min(std::max(init_worker_num_, min_worker_num_), max_worker_num_);//初始线程数在上下限之间
 }
 
 /*
@@ -107,6 +207,21 @@ void Parameters::displayConfig()
   printf("http sever TimeOut: %d\n", time_out_);
   printf("http sever InitWorkerNum: %d\n", init_worker_num_);
   printf("http server MaxWorkNum: %d\n", max_work_num_);
+  printf("http server ReactorNum: %d\n", reactor_num_);
+  printf("http server Backend: %s\n", backend_);
+  printf("http server KeepAliveTimeout: %d ms\n", keep_alive_timeout_);
+  printf("http server KeepAliveRequests: %d\n", keep_alive_requests_);
+  printf("http server CacheSize: %d KB\n", cache_size_);
+  printf("http server CacheValidTime: %d s\n", cache_valid_time_);
+  printf("http server HeaderTimeout: %d ms\n", header_timeout_);
+  printf("http server BodyTimeout: %d ms\n", body_timeout_);
+  printf("http server SendTimeout: %d ms\n", send_timeout_);
+  printf("http server MinWorkerNum: %d\n", min_worker_num_);
+  printf("http server MaxWorkerNum: %d\n", max_worker_num_);
+  printf("http server QueueTarget: %d ms\n", queue_target_);
+  printf("http server QueueInterval: %d ms\n", queue_interval_);
+  printf("http server RecvBuffers: %d\n", recv_buffers_);
+  printf("http server HugePages: %d\n", huge_pages_);
   //printf("http server FileList: %s\n", file_lists_[0].c_str());
 }
 
@@ -156,6 +271,146 @@ bool Parameters::loadConfig()
     printf("read xml max_work_num error: %s\n", e.what());
   }
 
+  try
+  {
+    int reactor_num = xml_tree_.get_child("root.http_server.reactor_num").get<int>("<xmlattr>.value");
+    reactor_num_ = reactor_num;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml reactor_num error: %s\n", e.what());
+  }
+
+  try
+  {
+    int keep_alive_timeout = xml_tree_.get_child("root.http_server.keep_alive_timeout").get<int>("<xmlattr>.value");
+    keep_alive_timeout_ = keep_alive_timeout;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml keep_alive_timeout error: %s\n", e.what());
+  }
+
+  try
+  {
+    int keep_alive_requests = xml_tree_.get_child("root.http_server.keep_alive_requests").get<int>("<xmlattr>.value");
+    keep_alive_requests_ = keep_alive_requests;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml keep_alive_requests error: %s\n", e.what());
+  }
+
+  try
+  {
+    int cache_size = xml_tree_.get_child("root.http_server.cache_size").get<int>("<xmlattr>.value");
+    cache_size_ = cache_size;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml cache_size error: %s\n", e.what());
+  }
+
+  try
+  {
+    int cache_valid_time = xml_tree_.get_child("root.http_server.cache_valid_time").get<int>("<xmlattr>.value");
+    cache_valid_time_ = cache_valid_time;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml cache_valid_time error: %s\n", e.what());
+  }
+
+  try
+  {
+    int header_timeout = xml_tree_.get_child("root.http_server.header_timeout").get<int>("<xmlattr>.value");
+    header_timeout_ = header_timeout;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml header_timeout error: %s\n", e.what());
+  }
+
+  try
+  {
+    int body_timeout = xml_tree_.get_child("root.http_server.body_timeout").get<int>("<xmlattr>.value");
+    body_timeout_ = body_timeout;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml body_timeout error: %s\n", e.what());
+  }
+
+  try
+  {
+    int send_timeout = xml_tree_.get_child("root.http_server.send_timeout").get<int>("<xmlattr>.value");
+    send_timeout_ = send_timeout;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml send_timeout error: %s\n", e.what());
+  }
+
+  try
+  {
+    int min_worker_num = xml_tree_.get_child("root.http_server.min_worker_num").get<int>("<xmlattr>.value");
+    min_worker_num_ = min_worker_num;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml min_worker_num error: %s\n", e.what());
+  }
+
+  try
+  {
+    int max_worker_num = xml_tree_.get_child("root.http_server.max_worker_num").get<int>("<xmlattr>.value");
+    max_worker_num_ = max_worker_num;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml max_worker_num error: %s\n", e.what());
+  }
+
+  try
+  {
+    int queue_target = xml_tree_.get_child("root.http_server.queue_target").get<int>("<xmlattr>.value");
+    queue_target_ = queue_target;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml queue_target error: %s\n", e.what());
+  }
+
+  try
+  {
+    int queue_interval = xml_tree_.get_child("root.http_server.queue_interval").get<int>("<xmlattr>.value");
+    queue_interval_ = queue_interval;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml queue_interval error: %s\n", e.what());
+  }
+
+  try
+  {
+    int recv_buffers = xml_tree_.get_child("root.http_server.recv_buffers").get<int>("<xmlattr>.value");
+    recv_buffers_ = recv_buffers;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml recv_buffers error: %s\n", e.what());
+  }
+
+  try
+  {
+    int huge_pages = xml_tree_.get_child("root.http_server.huge_pages").get<int>("<xmlattr>.value");
+    huge_pages_ = huge_pages;
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml huge_pages error: %s\n", e.what());
+  }
+
   try
   {
     std::string document_root = xml_tree_.get_child("root.http_server.document_root").get<std::string>("<xmlattr>.value");
@@ -180,6 +435,18 @@ bool Parameters::loadConfig()
     printf("read xml default_file: %s\n", e.what());
   }
 
+  try
+  {
+    std::string backend = xml_tree_.get_child("root.http_server.backend").get<std::string>("<xmlattr>.value");
+    memset(backend_, 0, sizeof(backend_));
+    strncpy(backend_, backend.c_str(), sizeof(backend_) - 1);
+    backend_[MAX_FILE_LINE - 1] = '\0';
+  }
+  catch (const ptree_error &e)
+  {
+    printf("read xml backend: %s\n", e.what());
+  }
+
   return true;
   
 }
@@ -37,10 +37,25 @@ static const int MAX_FILE_LINE = 128;
 #define MAX_CLIENT 10000
 #define TIME_OUT 10
 #define INIT_WORKER_NUM 5
+#define MIN_WORKER_NUM 2  // 线程池收缩的下限
+#define MAX_WORKER_NUM 64  // 线程池扩张的上限
 #define MAX_WORK_NUM 100000
+#define QUEUE_TARGET 5  // 排队时间目标，持续超过目标时拒绝新请求，毫秒
+#define QUEUE_INTERVAL 100  // 排队时间超过目标多久之后开始拒绝，毫秒
+#define REACTOR_NUM 0  // 0 表示每个CPU核心一个reactor
+#define KEEP_ALIVE_TIMEOUT 5000  // 长连接空闲超时时间，毫秒
+#define KEEP_ALIVE_REQUESTS 100  // 每个长连接最多处理的请求数
+#define HEADER_TIMEOUT 10000  // 读取请求头的超时时间（从请求第一个字节或建立连接开始），毫秒
+#define BODY_TIMEOUT 10000  // 读取请求体时两次读之间的超时时间，毫秒
+#define SEND_TIMEOUT 10000  // 发送响应时等待套接字可写的超时时间，毫秒
+#define CACHE_SIZE 65536  // 静态内容缓存的字节预算，KB
+#define CACHE_VALID_TIME 5  // 缓存条目的有效期，秒，过期后重新 stat 校验
+#define BACKEND "epoll"  // reactor 的事件后端：epoll 或 uring
+#define RECV_BUFFERS 16384  // 接收缓冲区（8KB）个数的上限，用完时连接暂停读取，0 表示没有上限
+#define HUGE_PAGES 0  // 接收缓冲区是否用大页映射
 
 /* the short cmd opt string */
-static const char *short_cmd_opt = "c:d:f:o:l:m:t:i:w:h";
+static const char *short_cmd_opt = "c:d:f:o:l:m:t:i:a:x:w:g:u:r:y:k:q:s:v:e:b:n:p:j:h";
 
 /*the long cmd opt structure*/
 static struct option long_cmd_opt[] = {
@@ -53,7 +68,23 @@ static struct option long_cmd_opt[] = {
     {"TimeOut", required_argument, nullptr, 't'},
     {"InitWorkerNum", required_argument, nullptr, 'i'},
     {"MaxWorkNum", required_argument, nullptr, 'w'},
+    {"ReactorNum", required_argument, nullptr, 'r'},
+    {"Backend", required_argument, nullptr, 'y'},
+    {"KeepAliveTimeout", required_argument, nullptr, 'k'},
+    {"KeepAliveRequests", required_argument, nullptr, 'q'},
+    {"CacheSize", required_argument, nullptr, 's'},
+    {"CacheValidTime", required_argument, nullptr, 'v'},
+    {"HeaderTimeout", required_argument, nullptr, 'e'},
+    {"BodyTimeout", required_argument, nullptr, 'b'},
+    {"SendTimeout", required_argument, nullptr, 'n'},
+    {"MinWorkerNum", required_argument, nullptr, 'a'},
+    {"MaxWorkerNum", required_argument, nullptr, 'x'},
+    {"QueueTarget", required_argument, nullptr, 'g'},
+    {"QueueInterval", required_argument, nullptr, 'u'},
+    {"RecvBuffers", required_argument, nullptr, 'p'},
+    {"HugePages", required_argument, nullptr, 'j'},
     {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}  // getopt_long 要求以全零的元素结尾
 };
 
 class Parameters
@@ -69,12 +100,40 @@ public:
 
   int getMaxWorkNum() { return max_work_num_; }
 
+  int getReactorNum() { return reactor_num_; }
+
+  char* getBackend() { return backend_; }
+
+  int getKeepAliveTimeout() { return keep_alive_timeout_; }
+
+  int getKeepAliveRequests() { return keep_alive_requests_; }
+
+  int getCacheSize() { return cache_size_; }
+
+  int getCacheValidTime() { return cache_valid_time_; }
+
+  int getHeaderTimeout() { return header_timeout_; }
+
+  int getBodyTimeout() { return body_timeout_; }
+
+  int getSendTimeout() { return send_timeout_; }
+
+  int getMinWorkerNum() { return min_worker_num_; }
+
+  int getMaxWorkerNum() { return max_worker_num_; }
+
+  int getQueueTarget() { return queue_target_; }
+
+  int getQueueInterval() { return queue_interval_; }
+
+  int getRecvBuffers() { return recv_buffers_; }
+
+  bool getHugePages() { return huge_pages_ != 0; }
+
   char* getDocumentRoot() { return document_root_; }
 
   char* getDefaultFile() { return default_file_; }
 
-  std::vector<std::string> getHttpFileLists() { return file_lists_; }
-
 
 
 private:
@@ -83,12 +142,26 @@ private:
   char default_file_[MAX_FILE_LINE];
   char document_root_[MAX_FILE_LINE];
   char config_file_[MAX_FILE_LINE];
+  char backend_[MAX_FILE_LINE];
   int listen_port_;
   int max_client_;
   int time_out_;
   int init_worker_num_;
   int max_work_num_;
-  std::vector<std::string> file_lists_;
+  int reactor_num_;
+  int keep_alive_timeout_;
+  int keep_alive_requests_;
+  int cache_size_;
+  int cache_valid_time_;
+  int header_timeout_;
+  int body_timeout_;
+  int send_timeout_;
+  int min_worker_num_;
+  int max_worker_num_;
+  int queue_target_;
+  int queue_interval_;
+  int recv_buffers_;
+  int huge_pages_;
   ptree xml_tree_;
 };
 }
@@ -0,0 +1,220 @@
+#include <http_connection.h>
+#include <http_parser.h>
+#include <http_response.h>
+#include <output_queue.h>
+#include <content_cache.h>
+#include <open_file_cache.h>
+#include <negative_cache.h>
+#include <my_arena.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+// 在请求路径上统计 malloc：从缓冲区池取得连接的缓冲区、解析请求、在连接 arena 中规范化路径，
+// 和服务器一样依次查不存在路径缓存、内容缓存和打开文件缓存，生成响应首部、加入发送队列、发送后 reset arena、
+// 连接空闲后缓冲区还给池。小文件从内容缓存发送，大文件每次都经过打开文件缓存（url 都超过 std::string 的内联长度）。
+// 稳定状态下每个请求应该是 0 次 malloc。
+
+extern "C" void *__libc_malloc(size_t size);
+
+static size_t malloc_calls = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  ++malloc_calls;
+  return __libc_malloc(size);
+}
+
+static const char *request_texts[] = {
+  "GET /static/js/../css/site.css?v=3 HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/119.0\r\n"
+  "Accept: text/css,*/*;q=0.1\r\n"
+  "Connection: keep-alive\r\n"
+  "\r\n",
+  "GET /static/media/intro-video.mp4 HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/119.0\r\n"
+  "Accept: video/*\r\n"
+  "Connection: keep-alive\r\n"
+  "\r\n"
+};
+
+static const char body[] = "body { margin: 0; }\n";
+static const size_t CACHE_BYTES = 1024 * 1024;  // 超过 1/16 的文件不进内容缓存
+static const off_t LARGE_FILE = 256 * 1024;
+
+static int64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 在临时的文档根目录下创建小文件 static/css/site.css 和大文件 static/media/intro-video.mp4
+ */
+static bool make_document_root(const std::string &root)
+{
+  if(mkdir((root + "/static").c_str(), 0755) != 0 || mkdir((root + "/static/css").c_str(), 0755) != 0 ||
+     mkdir((root + "/static/media").c_str(), 0755) != 0)
+    return false;
+  int fd = open((root + "/static/css/site.css").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd == -1)
+    return false;
+  bool ok = write(fd, body, sizeof(body) - 1) == static_cast<ssize_t>(sizeof(body) - 1);
+  close(fd);
+  fd = open((root + "/static/media/intro-video.mp4").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd == -1)
+    return false;
+  ok = ok && ftruncate(fd, LARGE_FILE) == 0;
+  close(fd);
+  return ok;
+}
+
+static void remove_document_root(const std::string &root)
+{
+  unlink((root + "/static/css/site.css").c_str());
+  unlink((root + "/static/media/intro-video.mp4").c_str());
+  rmdir((root + "/static/css").c_str());
+  rmdir((root + "/static/media").c_str());
+  rmdir((root + "/static").c_str());
+  rmdir(root.c_str());
+}
+
+struct Caches
+{
+  http_server::cache::ContentCache *content;
+  http_server::cache::OpenFileCache *open_files;
+  http_server::cache::NegativeCache *negative;
+};
+
+/**
+ * @brief 按服务器的顺序处理一个请求：取得连接的缓冲区和读缓冲区，经过缓存生成响应，
+ *        响应“发送”后回收 arena，连接空闲后缓冲区还给池
+ */
+static bool serve(http_server::http::HttpConnection *conn, const char *request_text, const Caches &caches)
+{
+  using namespace http_server::http;
+  using namespace http_server::cache;
+  if(!conn->acquire_read_buffer())
+    return false;
+  ConnectionBuffers *buffers = conn->buffers;
+  size_t len = strlen(request_text);
+  memcpy(buffers->read_buffer, request_text, len);
+  buffers->read_start = 0;
+  buffers->read_end = len;
+  if(buffers->parser.parse(buffers->read_buffer, len) != HttpParser::PARSE_DONE)
+    return false;
+  const HttpRequest &request = buffers->parser.request();
+
+  const char *query = static_cast<const char*>(memchr(request.target.data, '?', request.target.len));
+  size_t url_len = query ? query - request.target.data : request.target.len;
+  char *url = static_cast<char*>(buffers->arena.allocate(url_len + 3));
+  url_len = normalize_path(request.target.data, url_len, url, url_len + 3);
+  if(url_len == 0)
+    return false;
+
+  time_t now = time(NULL);
+  if(caches.negative->contains(url, url_len, now))
+    return false;
+  bool stale = false;
+  ContentPtr content = caches.content->find(url, url_len, now, &stale);
+  OpenFilePtr file;
+  if(!content || stale)
+  {
+    file = caches.open_files->open(url, url_len, now);
+    if(!file)
+      return false;
+    if(caches.content->cacheable(file->size))
+    {
+      content = CachedContent::load(*file, mime_type(file->path.c_str()));
+      if(!content)
+        return false;
+      caches.content->insert(url, url_len, content);
+      file.reset();
+    }
+    else
+      content.reset();
+  }
+
+  ResponseBuilder response(&buffers->arena, request.minor_version, 200, "OK");
+  if(content)
+  {
+    response.add_header("Content-Type", content->content_type);
+    response.add_header("Content-Length", content->data.size());
+  }
+  else
+  {
+    response.add_header("Content-Type", mime_type(file->path.c_str()));
+    response.add_header("Content-Length", static_cast<size_t>(file->size));
+  }
+  response.add_keep_alive(request.keep_alive);
+  buffers->output.append_arena(response.head(), response.head_len());
+  if(content)
+    buffers->output.append_content(content, 0, content->data.size());
+  else
+    buffers->output.append_file(file, 0, static_cast<size_t>(file->size));
+
+  buffers->output.consume(buffers->output.bytes());  // 相当于一次完整的 sendmsg/sendfile
+  buffers->read_start = buffers->read_end = 0;
+  buffers->parser.reset();
+  buffers->arena.reset();
+  conn->release_idle_buffers();
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  int requests = argc > 1 ? atoi(argv[1]) : 1000000;
+  char root_template[] = "/tmp/arena_bench.XXXXXX";
+  if(mkdtemp(root_template) == nullptr)
+  {
+    printf("mkdtemp failed\n");
+    return 1;
+  }
+  std::string root(root_template);
+  if(!make_document_root(root))
+  {
+    printf("can not create files under %s\n", root.c_str());
+    remove_document_root(root);
+    return 1;
+  }
+  http_server::cache::ContentCache content_cache(CACHE_BYTES, 3600);
+  http_server::cache::OpenFileCache open_files(root.c_str(), "index.html", 3600, 16);
+  http_server::cache::NegativeCache negative_cache(root.c_str(), 3600, 16);
+  Caches caches = { &content_cache, &open_files, &negative_cache };
+
+  http_server::http::HttpConnection *conn = new http_server::http::HttpConnection(0);
+  for(int i = 0; i < 2; ++i)
+  {
+    if(!serve(conn, request_texts[i], caches))  // 预热：块池切出第一个 slab，缓冲区池新建第一个对象，载入两个缓存
+    {
+      printf("request failed\n");
+      remove_document_root(root);
+      return 1;
+    }
+  }
+
+  size_t before = malloc_calls;
+  int64_t start = now_ns();
+  for(int i = 0; i < requests; ++i)
+    serve(conn, request_texts[i & 1], caches);
+  int64_t elapsed = now_ns() - start;
+  size_t mallocs = malloc_calls - before;
+
+  my_arena::Arena::Stats stats = my_arena::Arena::stats();
+  printf("warm-up request: %zu malloc calls\n", before);
+  printf("%d requests: %.1f ns per request, %zu malloc calls (%.3f per request)\n",
+         requests, static_cast<double>(elapsed) / requests, mallocs, static_cast<double>(mallocs) / requests);
+  printf("arena: high water %zu bytes per request, %zu chunks of %zu bytes (%zu free), %zu large allocations\n",
+         stats.high_water, stats.chunks, my_arena::ChunkPool::CHUNK_SIZE, stats.free_chunks, stats.large_allocs);
+  delete conn;
+  remove_document_root(root);
+  return mallocs == 0 ? 0 : 1;
+}
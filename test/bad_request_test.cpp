@@ -0,0 +1,99 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+// 错误请求测试：发送超长的请求头、超长的请求行、无法解析的请求、不支持的版本和冲突的 Content-Length，
+// 确认客户端收到对应的错误响应，而不是连接被重置。
+// 请求头超过读缓冲区时服务器只读入了一部分，应答后必须先读走客户端还在发送的数据再关闭连接：
+//   httpserver -r 2
+//   bad_request_test 127.0.0.1 54321
+
+static int connect_to(const char *host, int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(fd < 0)
+    return -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, host, &addr.sin_addr);
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  struct timeval timeout = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+/**
+ * @brief 发送 request，读到连接关闭为止
+ *
+ * @return 响应的状态码，连接被重置、超时或响应不是 HTTP/1.1 返回-1
+ */
+static int exchange(const char *host, int port, const std::string &request)
+{
+  int fd = connect_to(host, port);
+  if(fd == -1)
+    return -1;
+  size_t sent = 0;
+  while(sent < request.size())  // 服务器应答后可能已经关闭了写方向，发送仍然成功（数据被丢弃）
+  {
+    ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+    if(n <= 0)
+      break;
+    sent += n;
+  }
+  std::string data;
+  char buf[4096];
+  ssize_t n;
+  while((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    data.append(buf, n);
+  close(fd);
+  if(n < 0 || data.compare(0, 9, "HTTP/1.1 ") != 0)
+    return -1;
+  return atoi(data.c_str() + 9);
+}
+
+static bool check(const char *name, int status, int expected)
+{
+  printf("%-28s %d (expected %d) %s\n", name, status, expected, status == expected ? "ok" : "FAILED");
+  return status == expected;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3)
+  {
+    printf("usage: %s host port\n", argv[0]);
+    return 1;
+  }
+  const char *host = argv[1];
+  int port = atoi(argv[2]);
+
+  bool ok = true;
+  ok &= check("9000 byte header line",
+              exchange(host, port, "GET /index.html HTTP/1.1\r\nHost: t\r\nX-Long: " + std::string(9000, 'x') + "\r\n\r\n"), 431);
+  ok &= check("64 KB header line",
+              exchange(host, port, "GET /index.html HTTP/1.1\r\nHost: t\r\nX-Long: " + std::string(65536, 'x') + "\r\n\r\n"), 431);
+  ok &= check("9000 byte request line",
+              exchange(host, port, "GET /" + std::string(9000, 'a') + " HTTP/1.1\r\nHost: t\r\n\r\n"), 414);
+  ok &= check("malformed request line",
+              exchange(host, port, "GET\r\nHost: t\r\n\r\n" + std::string(9000, 'x')), 400);
+  ok &= check("malformed version",
+              exchange(host, port, "GET /index.html HTTP/1.1 junk\r\nHost: t\r\n\r\n"), 400);
+  ok &= check("unsupported version",
+              exchange(host, port, "GET /index.html HTTP/2.0\r\nHost: t\r\n\r\n"), 505);
+  ok &= check("conflicting Content-Length",
+              exchange(host, port, "POST /index.html HTTP/1.1\r\nHost: t\r\nContent-Length: 5\r\n"
+                                   "Content-Length: 10\r\n\r\nhello"), 400);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+// 空闲长连接浸泡测试：分两半打开 N 个连接，每个连接应答一个请求后保持空闲，统计服务器每个空闲连接增加的常驻内存（VmRSS）。
+// 每个连接的内存按后一半连接计算，前一半连接已经让缓冲区池、io_uring 的接收缓冲区环等固定大小的内存都用到过，不计入。
+// 保持 hold 秒后在每个连接上再发一个请求，确认空闲连接都还可用。服务器的长连接超时和请求数上限要足够大：
+//   httpserver -r 2 -k 600000 -q 100000000
+//   conn_soak 127.0.0.1 54321 15000 10 /index.html <pid>
+// 测试进程和服务器各自受打开文件数的限制（ulimit -n），连接数不能超过它。
+// 这里统计的是用户态内存，内核中套接字的内存不计入 VmRSS。
+
+static int64_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 读取进程的常驻内存，KB
+ */
+static long rss_kb(int pid)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  FILE *f = fopen(path, "r");
+  if(f == nullptr)
+    return -1;
+  char line[256];
+  long kb = -1;
+  while(fgets(line, sizeof(line), f) != nullptr)
+  {
+    if(strncmp(line, "VmRSS:", 6) == 0)
+    {
+      kb = atol(line + 6);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+static int connect_to(const char *host, int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(fd < 0)
+    return -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, host, &addr.sin_addr);
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  struct timeval timeout = { 10, 0 };  // 服务器没有应答时不要一直阻塞
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+/**
+ * @brief 读取一个完整的响应（首部和 Content-Length 长度的响应体）
+ *
+ * @return 成功并且服务器保持连接返回true
+ */
+static bool read_response(int fd)
+{
+  std::string data;
+  char buf[16384];
+  size_t head_end = std::string::npos;
+  size_t total = 0;
+  while(true)
+  {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if(n <= 0)
+      return false;
+    data.append(buf, n);
+    if(head_end == std::string::npos)
+    {
+      head_end = data.find("\r\n\r\n");
+      if(head_end == std::string::npos)
+        continue;
+      if(data.compare(0, 12, "HTTP/1.1 200") != 0 || data.find("Connection: close") < head_end)
+        return false;
+      size_t cl = data.find("Content-Length:");
+      if(cl == std::string::npos || cl > head_end)
+        return false;
+      total = head_end + 4 + strtoul(data.c_str() + cl + 15, nullptr, 10);
+    }
+    if(data.size() >= total)
+      return data.size() == total;
+  }
+}
+
+/**
+ * @brief 在 [first, fds.size()) 的连接上各发一个请求，分批发送后再逐个读响应
+ *
+ * @return 失败的连接数
+ */
+static int request_all(std::vector<int> &fds, size_t first, const std::string &request)
+{
+  static const size_t BATCH = 256;
+  int failed = 0;
+  for(size_t begin = first; begin < fds.size(); begin += BATCH)
+  {
+    size_t end = std::min(fds.size(), begin + BATCH);
+    for(size_t i = begin; i < end; ++i)
+    {
+      if(fds[i] != -1 && send(fds[i], request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+      {
+        close(fds[i]);
+        fds[i] = -1;
+      }
+    }
+    for(size_t i = begin; i < end; ++i)
+    {
+      if(fds[i] != -1 && !read_response(fds[i]))
+      {
+        close(fds[i]);
+        fds[i] = -1;
+      }
+      if(fds[i] == -1)
+        ++failed;
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 4)
+  {
+    printf("usage: %s host port connections [hold_seconds] [path] [server_pid]\n", argv[0]);
+    return 1;
+  }
+  const char *host = argv[1];
+  int port = atoi(argv[2]);
+  int connections = atoi(argv[3]);
+  int hold = argc > 4 ? atoi(argv[4]) : 10;
+  std::string path = argc > 5 ? argv[5] : "/index.html";
+  int pid = argc > 6 ? atoi(argv[6]) : -1;
+
+  struct rlimit nofile;
+  if(getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max)
+  {
+    nofile.rlim_cur = nofile.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &nofile);
+  }
+
+  std::string request = "GET " + path + " HTTP/1.1\r\nHost: soak\r\n\r\n";
+  long rss_start = pid > 0 ? rss_kb(pid) : -1;
+
+  int64_t start = now_ms();
+  std::vector<int> fds;
+  fds.reserve(connections);
+  int failed = 0;
+  long rss_half = -1;
+  int open_half = 0;
+  for(int half = 0; half < 2; ++half)
+  {
+    size_t first = fds.size();
+    int target = half == 0 ? connections / 2 : connections;
+    for(int i = static_cast<int>(first); i < target; ++i)
+    {
+      int fd = connect_to(host, port);
+      if(fd == -1)
+      {
+        printf("connect failed after %d connections: %s\n", i, strerror(errno));
+        break;
+      }
+      fds.push_back(fd);
+    }
+    failed += request_all(fds, first, request);
+    if(half == 0)
+    {
+      sleep(1);
+      rss_half = pid > 0 ? rss_kb(pid) : -1;
+      open_half = static_cast<int>(fds.size()) - failed;
+    }
+  }
+  int open = static_cast<int>(fds.size()) - failed;
+  printf("%d connections opened and answered in %lld ms, %d failed\n",
+         open, static_cast<long long>(now_ms() - start), failed);
+
+  sleep(1);
+  long rss_idle = pid > 0 ? rss_kb(pid) : -1;
+  if(pid > 0 && open > open_half)
+  {
+    printf("server rss: %ld KB before, %ld KB with %d idle connections, %ld KB with %d\n",
+           rss_start, rss_half, open_half, rss_idle, open);
+    printf("%.0f bytes per idle connection\n", (rss_idle - rss_half) * 1024.0 / (open - open_half));
+  }
+
+  sleep(hold);
+  start = now_ms();
+  int lost = request_all(fds, 0, request) - failed;
+  printf("after %d s idle: %d of %d connections answered again in %lld ms\n",
+         hold, open - lost, open, static_cast<long long>(now_ms() - start));
+  if(pid > 0)
+  {
+    sleep(1);
+    printf("server rss after the second round: %ld KB\n", rss_kb(pid));
+  }
+
+  for(size_t i = 0; i < fds.size(); ++i)
+  {
+    if(fds[i] != -1)
+      close(fds[i]);
+  }
+  return (failed == 0 && lost == 0) ? 0 : 1;
+}
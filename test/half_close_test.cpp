@@ -0,0 +1,129 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+// 半关闭测试：客户端发送流水线请求后关闭写方向（shutdown(SHUT_WR)），用很小的接收缓冲区慢慢读取，
+// 确认收到完整的响应后服务器才关闭连接。文件要比套接字缓冲区大得多，服务器才会在对端半关闭后等待可写：
+//   head -c 20000000 /dev/urandom > doc/big.bin
+//   httpserver -r 2
+//   half_close_test 127.0.0.1 54321 /big.bin
+
+static const int RCVBUF = 4096;  // 连接前设置，窗口一开始就很小，服务器的发送很快被阻塞
+
+static int connect_to(const char *host, int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(fd < 0)
+    return -1;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &RCVBUF, sizeof(RCVBUF));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, host, &addr.sin_addr);
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  struct timeval timeout = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+/**
+ * @brief 从 data 的 pos 处解析一个响应，pos 移到响应之后
+ *
+ * @return 响应的状态码；响应头不完整或缺少 Content-Length 返回-1，响应体不完整返回-2
+ */
+static int next_response(const std::string &data, size_t *pos)
+{
+  size_t header_end = data.find("\r\n\r\n", *pos);
+  if(header_end == std::string::npos || data.compare(*pos, 9, "HTTP/1.1 ") != 0)
+    return -1;
+  int status = atoi(data.c_str() + *pos + 9);
+  std::string header = data.substr(*pos, header_end - *pos);
+  const char *cl = strcasestr(header.c_str(), "\r\nContent-Length:");
+  if(cl == nullptr)
+    return -1;
+  size_t length = strtoull(cl + 17, nullptr, 10);
+  if(data.size() - (header_end + 4) < length)
+    return -2;
+  *pos = header_end + 4 + length;
+  return status;
+}
+
+/**
+ * @brief 发送 requests 个对 path 的请求后关闭写方向，先暂停让服务器的发送阻塞，再读到连接关闭为止
+ *
+ * @return 收到的完整响应个数，最后有多余或不完整的数据、连接被重置或超时返回-1
+ */
+static int half_close(const char *host, int port, const char *path, int requests)
+{
+  int fd = connect_to(host, port);
+  if(fd == -1)
+    return -1;
+  std::string request;
+  for(int i = 0; i < requests; ++i)
+    request += std::string("GET ") + path + " HTTP/1.1\r\nHost: t\r\n\r\n";
+  if(send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+  {
+    close(fd);
+    return -1;
+  }
+  shutdown(fd, SHUT_WR);
+  usleep(200000);  // 服务器填满套接字缓冲区后等待可写，此时对端已经半关闭
+
+  std::string data;
+  char buf[65536];
+  ssize_t n;
+  while((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    data.append(buf, n);
+  close(fd);
+  if(n < 0)
+    return -1;
+  size_t pos = 0;
+  int responses = 0;
+  while(pos < data.size())
+  {
+    int status = next_response(data, &pos);
+    if(status != 200)
+    {
+      printf("  response %d: %s after %zu of %zu bytes\n", responses + 1,
+             status == -2 ? "truncated body" : "bad header", pos, data.size());
+      return -1;
+    }
+    ++responses;
+  }
+  return responses;
+}
+
+static bool check(const char *name, int responses, int expected)
+{
+  printf("%-28s %d (expected %d) %s\n", name, responses, expected, responses == expected ? "ok" : "FAILED");
+  return responses == expected;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 4)
+  {
+    printf("usage: %s host port path\n", argv[0]);
+    return 1;
+  }
+  const char *host = argv[1];
+  int port = atoi(argv[2]);
+  const char *path = argv[3];
+
+  bool ok = true;
+  ok &= check("one request, half-closed", half_close(host, port, path, 1), 1);
+  ok &= check("pipelined, half-closed", half_close(host, port, path, 3), 3);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// 长连接压测：N 个连接各自循环发送同一个 GET 请求（收到完整响应后再发下一个），统计吞吐和延迟。
+// 给出服务器的 pid 时还统计服务器每个请求消耗的CPU时间，用来在同一负载下比较 epoll 和 io_uring 后端：
+//   httpserver -y epoll  /  httpserver -y uring
+//   http_bench 127.0.0.1 54321 1000 10 /index.html <pid>
+// io_uring 后端退出（SIGINT）时输出处理的请求数和 io_uring_enter 的调用次数。
+
+struct Client
+{
+  int fd;
+  size_t received;  // 当前响应已收到的字节数
+  size_t expected;  // 首部解析出的完整响应长度，0 表示首部还没收全
+  int64_t sent_at;
+  std::string head;
+};
+
+static int64_t now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 读取进程累计的用户态和内核态CPU时间（时钟滴答）
+ */
+static long long cpu_ticks(int pid)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE *f = fopen(path, "r");
+  if(f == nullptr)
+    return -1;
+  char buf[1024];
+  size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = '\0';
+  const char *p = strrchr(buf, ')');  // 进程名中可能有空格，从右括号之后开始数字段
+  long long utime = 0, stime = 0;
+  if(p == nullptr || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lld %lld", &utime, &stime) != 2)
+    return -1;
+  return utime + stime;
+}
+
+static int connect_to(const char *host, int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, host, &addr.sin_addr);
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 6)
+  {
+    printf("usage: %s host port connections seconds path [server_pid]\n", argv[0]);
+    return 1;
+  }
+  const char *host = argv[1];
+  int port = atoi(argv[2]);
+  int conn_num = atoi(argv[3]);
+  int seconds = atoi(argv[4]);
+  std::string request = std::string("GET ") + argv[5] + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+  int server_pid = argc > 6 ? atoi(argv[6]) : 0;
+
+  int epfd = epoll_create1(0);
+  std::vector<Client> clients(conn_num);
+  for(int i = 0; i < conn_num; ++i)
+  {
+    clients[i].fd = connect_to(host, port);
+    if(clients[i].fd == -1)
+    {
+      printf("connect %d failed: %s\n", i, strerror(errno));
+      return 1;
+    }
+    clients[i].received = clients[i].expected = 0;
+    struct epoll_event e;
+    e.events = EPOLLIN;
+    e.data.u32 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i].fd, &e);
+  }
+
+  std::vector<int64_t> latency;
+  latency.reserve(1 << 20);
+  long long cpu_start = server_pid > 0 ? cpu_ticks(server_pid) : -1;
+  int64_t start = now_us();
+  int64_t end = start + seconds * 1000000LL;
+  for(int i = 0; i < conn_num; ++i)
+  {
+    clients[i].sent_at = now_us();
+    if(send(clients[i].fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+      return 1;
+  }
+
+  long long errors = 0;
+  std::vector<struct epoll_event> events(1024);
+  std::vector<char> buf(256 * 1024);
+  while(now_us() < end)
+  {
+    int n = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 100);
+    for(int k = 0; k < n; ++k)
+    {
+      Client &c = clients[events[k].data.u32];
+      while(true)
+      {
+        ssize_t r = recv(c.fd, buf.data(), buf.size(), 0);
+        if(r <= 0)
+        {
+          if(r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+          {
+            printf("connection closed by server\n");
+            return 1;
+          }
+          break;
+        }
+        size_t offset = 0;
+        while(offset < static_cast<size_t>(r))
+        {
+          if(c.expected == 0)  // 首部还没收全，逐字节找结尾空行
+          {
+            c.head.push_back(buf[offset++]);
+            ++c.received;
+            size_t pos = c.head.find("\r\n\r\n");
+            if(pos == std::string::npos)
+              continue;
+            if(c.head.compare(0, 12, "HTTP/1.1 200") != 0)
+              ++errors;
+            const char *cl = strstr(c.head.c_str(), "Content-Length: ");
+            c.expected = pos + 4 + (cl ? strtoull(cl + 16, nullptr, 10) : 0);
+          }
+          size_t take = std::min(static_cast<size_t>(r) - offset, c.expected - c.received);
+          offset += take;
+          c.received += take;
+          if(c.received == c.expected)  // 完整的响应，发送下一个请求
+          {
+            int64_t t = now_us();
+            latency.push_back(t - c.sent_at);
+            c.received = c.expected = 0;
+            c.head.clear();
+            c.sent_at = t;
+            if(t < end)
+              send(c.fd, request.data(), request.size(), MSG_NOSIGNAL);
+          }
+        }
+      }
+    }
+  }
+  double elapsed = (now_us() - start) / 1e6;
+  long long cpu_end = server_pid > 0 ? cpu_ticks(server_pid) : -1;
+
+  for(int i = 0; i < conn_num; ++i)
+    close(clients[i].fd);
+  if(latency.empty())
+  {
+    printf("no responses\n");
+    return 1;
+  }
+  std::sort(latency.begin(), latency.end());
+  printf("%d connections, %.1f s: %zu responses (%lld errors), %.0f req/s, latency p50 %lld us p99 %lld us\n",
+         conn_num, elapsed, latency.size(), errors, latency.size() / elapsed,
+         static_cast<long long>(latency[latency.size() / 2]),
+         static_cast<long long>(latency[latency.size() * 99 / 100]));
+  if(cpu_start >= 0 && cpu_end >= 0)
+    printf("server cpu: %.1f us per request\n",
+           (cpu_end - cpu_start) * 1e6 / sysconf(_SC_CLK_TCK) / latency.size());
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "../thread_pool.h"
+#include "../parameters.h"
+#include <logger.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// 混合负载下快速请求的排队延迟：每 20 个快速工作（10us）夹一个阻塞 20ms 的慢工作（模拟CGI）。
+// 所有工作都在快速通道时，慢工作会占满全部线程，快速工作排在它们后面；
+// 慢工作放入 LANE_SLOW 后最多占用四分之一的线程，快速工作的延迟应当基本不受影响。
+
+static const int FAST_NUM = 20000;
+static const int SLOW_EVERY = 20;
+
+static std::vector<int64_t> latency(FAST_NUM);
+static std::atomic<int> fast_done(0);
+static std::atomic<int> slow_done(0);
+
+static int64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void fast_task(int id, int64_t submitted)
+{
+  latency[id] = now_ns() - submitted;
+  int64_t end = now_ns() + 10000;
+  while(now_ns() < end)
+    ;
+  fast_done.fetch_add(1, std::memory_order_release);
+}
+
+static void slow_task()
+{
+  usleep(20000);
+  slow_done.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * @brief 提交混合负载并等待全部完成，返回快速工作的 p99 排队延迟（微秒）
+ */
+static double run(http_server::ThreadPool *pool, http_server::work_lane slow_lane)
+{
+  fast_done.store(0);
+  slow_done.store(0);
+  int slow_num = 0;
+  for(int i = 0; i < FAST_NUM; ++i)
+  {
+    if(i % SLOW_EVERY == 0)
+    {
+      while(pool->add_task_to_pool(slow_task, slow_lane) != http_server::SUCCESS)
+        sched_yield();
+      ++slow_num;
+    }
+    while(pool->add_task_to_pool(std::bind(fast_task, i, now_ns())) != http_server::SUCCESS)
+      sched_yield();
+    while(i - fast_done.load(std::memory_order_acquire) > 64)  // 限制积压，按处理速度提交
+      sched_yield();
+  }
+  while(fast_done.load(std::memory_order_acquire) != FAST_NUM || slow_done.load(std::memory_order_acquire) != slow_num)
+    usleep(1000);
+  std::sort(latency.begin(), latency.end());
+  return latency[FAST_NUM * 99 / 100] / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+  http_server::parameters::Parameters parameters(argc, argv);
+  http_server::ThreadPool pool(&parameters);
+  pool.start();
+
+  double shared = run(&pool, http_server::LANE_FAST);
+  double laned = run(&pool, http_server::LANE_SLOW);
+  printf("fast task p99 queue delay: %.1f us with one FIFO, %.1f us with a slow lane (%d workers)\n",
+         shared, laned, pool.stats().threads);
+  pool.close_pool();
+  return 0;
+}
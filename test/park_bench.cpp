@@ -0,0 +1,90 @@
+#include "../thread_pool.h"
+#include "../parameters.h"
+#include <logger.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <vector>
+
+// 工作线程空闲策略的延迟测试：开环泊松到达，CPU利用率 10%、50%、90% 时
+// 统计从提交到开始执行的延迟分位数，以及平均每个工作的唤醒（futex）次数。
+
+static const int TASK_NUM = 20000;
+static const int64_t SERVICE_NS = 20000;  // 每个工作耗时 20us
+
+static std::vector<int64_t> latency(TASK_NUM);
+static std::atomic<int> done(0);
+
+static int64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void task(int id, int64_t submitted)
+{
+  int64_t start = now_ns();
+  latency[id] = start - submitted;
+  while(now_ns() < start + SERVICE_NS)
+    ;
+  done.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * @brief 等到 deadline，较长的间隔先睡眠，避免提交线程占满CPU
+ */
+static void wait_until(int64_t deadline)
+{
+  while(true)
+  {
+    int64_t left = deadline - now_ns();
+    if(left <= 0)
+      return;
+    if(left > 100000)
+    {
+      struct timespec ts = {0, left - 50000};
+      nanosleep(&ts, NULL);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  http_server::parameters::Parameters parameters(argc, argv);
+  http_server::ThreadPool pool(&parameters);
+  pool.start();
+
+  int cores = std::min(parameters.getInitWorkerNum(), static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)));
+  const double loads[] = {0.1, 0.5, 0.9};
+  std::mt19937 rng(12345);
+  printf("workers %d, cores used %d, service time %.0f us\n", parameters.getInitWorkerNum(), cores, SERVICE_NS / 1e3);
+  printf("%6s %10s %10s %10s %14s\n", "load", "p50 us", "p99 us", "p99.9 us", "wakeups/task");
+  for(size_t n = 0; n < sizeof(loads) / sizeof(loads[0]); ++n)
+  {
+    std::exponential_distribution<double> gap(loads[n] * cores / SERVICE_NS);  // 到达率 = 利用率 * 核数 / 服务时间
+    done.store(0);
+    http_server::ThreadPool::PoolStats before = pool.stats();
+    int64_t arrival = now_ns();
+    for(int i = 0; i < TASK_NUM; ++i)
+    {
+      arrival += static_cast<int64_t>(gap(rng));
+      wait_until(arrival);
+      while(pool.add_task_to_pool(std::bind(task, i, now_ns())) != http_server::SUCCESS)
+        sched_yield();
+    }
+    while(done.load(std::memory_order_acquire) != TASK_NUM)
+      sched_yield();
+    http_server::ThreadPool::PoolStats after = pool.stats();
+
+    std::sort(latency.begin(), latency.end());
+    printf("%5.0f%% %10.1f %10.1f %10.1f %14.3f\n", loads[n] * 100,
+           latency[TASK_NUM / 2] / 1e3, latency[TASK_NUM * 99 / 100] / 1e3, latency[TASK_NUM * 999 / 1000] / 1e3,
+           static_cast<double>(after.wakeups - before.wakeups) / TASK_NUM);
+  }
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include <http_parser.h>
+#include <http_scan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace http_server::http;
+
+// 典型浏览器请求头
+static const char *chrome_request =
+  "GET /static/js/app.4f3c2a.js HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "Connection: keep-alive\r\n"
+  "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+  "sec-ch-ua-mobile: ?0\r\n"
+  "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+  "sec-ch-ua-platform: \"Windows\"\r\n"
+  "Accept: */*\r\n"
+  "Sec-Fetch-Site: same-origin\r\n"
+  "Sec-Fetch-Mode: no-cors\r\n"
+  "Sec-Fetch-Dest: script\r\n"
+  "Referer: https://www.example.com/\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8,zh;q=0.7\r\n"
+  "\r\n";
+
+static const char *firefox_request =
+  "GET /index.html HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/119.0\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Connection: keep-alive\r\n"
+  "Upgrade-Insecure-Requests: 1\r\n"
+  "Sec-Fetch-Dest: document\r\n"
+  "Sec-Fetch-Mode: navigate\r\n"
+  "Sec-Fetch-Site: none\r\n"
+  "Sec-Fetch-User: ?1\r\n"
+  "\r\n";
+
+static const char *ab_request =
+  "GET /index.html HTTP/1.0\r\n"
+  "Host: localhost:54321\r\n"
+  "User-Agent: ApacheBench/2.3\r\n"
+  "Accept: */*\r\n"
+  "\r\n";
+
+/*
+*@brief 带大 Cookie 的请求（登录后的站点常见）
+*/
+static std::string cookie_request()
+{
+  std::string req =
+    "GET /account/overview?tab=orders&page=2 HTTP/1.1\r\n"
+    "Host: shop.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.0 Safari/605.1.15\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "Cookie: ";
+  for(int i = 0; i < 40; ++i)
+  {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "_ga_%02d=GA1.1.%010d.1697012345; sess_%02d=3f9a8c7e6d5b4a39281706f5e4d3c2b1; ",
+             i, 1234567 * (i + 1), i);
+    req += buf;
+  }
+  req += "\r\nConnection: keep-alive\r\n\r\n";
+  return req;
+}
+
+static inline unsigned long long cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static volatile size_t sink;
+
+/*
+*@brief 只测查找换行符的内核
+*/
+static double bench_scan(const std::string &req, int rounds)
+{
+  const char *begin = req.data();
+  const char *end = begin + req.size();
+  unsigned long long start = cycles();
+  for(int r = 0; r < rounds; ++r)
+  {
+    const char *p = begin;
+    while(p < end)
+    {
+      p = find_first_of(p, end, "\n", 1) + 1;
+      sink += p - begin;
+    }
+  }
+  unsigned long long stop = cycles();
+  return static_cast<double>(req.size()) * rounds / (stop - start);
+}
+
+/*
+*@brief 测完整的请求解析
+*/
+static double bench_parse(const std::string &req, int rounds)
+{
+  HttpParser parser;
+  unsigned long long start = cycles();
+  for(int r = 0; r < rounds; ++r)
+  {
+    parser.reset();
+    if(parser.parse(req.data(), req.size()) != HttpParser::PARSE_DONE)
+    {
+      printf("parse failed\n");
+      return 0;
+    }
+    sink += parser.request().header_num;
+  }
+  unsigned long long stop = cycles();
+  return static_cast<double>(req.size()) * rounds / (stop - start);
+}
+
+int main(int argc, char **argv)
+{
+  int rounds = argc > 1 ? atoi(argv[1]) : 200000;
+  std::vector<std::pair<std::string, std::string>> requests;
+  requests.push_back(std::make_pair(std::string("ab"), std::string(ab_request)));
+  requests.push_back(std::make_pair(std::string("firefox"), std::string(firefox_request)));
+  requests.push_back(std::make_pair(std::string("chrome"), std::string(chrome_request)));
+  requests.push_back(std::make_pair(std::string("big-cookie"), cookie_request()));
+
+  ScanImpl impls[] = {SCAN_SCALAR, SCAN_SSE42, SCAN_AVX2};
+  ScanImpl best = scan_impl();
+
+  printf("bytes/cycle (higher is better), %d rounds\n", rounds);
+  printf("%-12s %6s %-8s %10s %10s\n", "request", "bytes", "impl", "scan", "parse");
+  for(size_t i = 0; i < requests.size(); ++i)
+  {
+    for(int j = 0; j < 3; ++j)
+    {
+      if(!scan_supported(impls[j]))
+        continue;
+      set_scan_impl(impls[j]);
+      double scan = bench_scan(requests[i].second, rounds);
+      double parse = bench_parse(requests[i].second, rounds);
+      printf("%-12s %6zu %-8s %10.3f %10.3f\n", requests[i].first.c_str(), requests[i].second.size(),
+             scan_impl_name(impls[j]), scan, parse);
+    }
+  }
+  set_scan_impl(best);
+  printf("runtime selected: %s\n", scan_impl_name(best));
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include "../thread_pool.h"
+#include "../parameters.h"
+#include <logger.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// 耗时不均匀的工作下线程池的排队延迟：1% 的工作耗时是其他工作的 200 倍，
+// 统计从提交到开始执行的延迟分位数。慢工作阻塞一个线程时，积压在它后面的工作应当被其他线程取走。
+// 预热之后 Work 对象都在空闲链表里循环使用，测量阶段的分配次数应当为0。
+// 最后提交一批会阻塞的工作（模拟CGI、冷磁盘读），线程池应当增加线程，被阻塞的工作不会拖住其余的工作。
+
+static const int TASK_NUM = 200000;
+static const int BURST = 64;  // 每次连续提交的工作数
+
+static std::vector<int64_t> latency(TASK_NUM);
+static std::atomic<int> done(0);
+
+static int64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void spin(int64_t ns)
+{
+  int64_t end = now_ns() + ns;
+  while(now_ns() < end)
+    ;
+}
+
+static void task(int id, int64_t submitted)
+{
+  latency[id] = now_ns() - submitted;
+  spin(id % 100 == 0 ? 400000 : 2000);  // 慢工作 400us，普通工作 2us
+  done.fetch_add(1, std::memory_order_release);
+}
+
+static void blocking_task()
+{
+  usleep(50000);  // 阻塞 50ms
+  done.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * @brief 提交 TASK_NUM 个工作并等待全部完成，返回耗时（秒）
+ */
+static double run(http_server::ThreadPool *pool)
+{
+  done.store(0);
+  int64_t start = now_ns();
+  for(int i = 0; i < TASK_NUM; )
+  {
+    for(int j = 0; j < BURST && i < TASK_NUM; ++j, ++i)
+    {
+      while(pool->add_task_to_pool(std::bind(task, i, now_ns())) != http_server::SUCCESS)
+        sched_yield();
+    }
+    while(i - done.load(std::memory_order_acquire) > BURST * 4)  // 限制积压，测量排队延迟而不是提交速度
+      sched_yield();
+  }
+  while(done.load(std::memory_order_acquire) != TASK_NUM)
+    sched_yield();
+  return (now_ns() - start) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+  http_server::parameters::Parameters parameters(argc, argv);
+  http_server::ThreadPool pool(&parameters);
+  pool.start();
+
+  run(&pool);  // 预热，填满空闲链表
+  http_server::ThreadPool::PoolStats before = pool.stats();
+  double seconds = run(&pool);
+  http_server::ThreadPool::PoolStats after = pool.stats();
+
+  std::sort(latency.begin(), latency.end());
+  printf("workers %d, %d tasks in %.2f s\n", after.threads, TASK_NUM, seconds);
+  printf("queue delay p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+         latency[TASK_NUM / 2] / 1e3, latency[TASK_NUM * 99 / 100] / 1e3,
+         latency[TASK_NUM * 999 / 1000] / 1e3, latency[TASK_NUM - 1] / 1e3);
+  printf("steady state: %zu Work allocations, %zu frees, %zu heap callables (%zu Work objects allocated in total)\n",
+         after.work_allocs - before.work_allocs, after.work_frees - before.work_frees,
+         after.heap_funcs - before.heap_funcs, after.work_allocs);
+
+  const int BLOCKING_NUM = 400;
+  done.store(0);
+  int64_t start = now_ns();
+  for(int i = 0; i < BLOCKING_NUM; ++i)
+  {
+    while(pool.add_task_to_pool(blocking_task) != http_server::SUCCESS)
+      sched_yield();
+  }
+  while(done.load(std::memory_order_acquire) != BLOCKING_NUM)
+    usleep(1000);
+  http_server::ThreadPool::PoolStats blocked = pool.stats();
+  printf("%d blocking tasks in %.2f s: threads %d -> %d (%zu grows, max %d)\n", BLOCKING_NUM,
+         (now_ns() - start) / 1e9, after.threads, blocked.threads, blocked.grows, parameters.getMaxWorkerNum());
+
+  start = now_ns();
+  pool.close_pool();
+  printf("close_pool joined all workers in %.1f ms\n", (now_ns() - start) / 1e6);
+  return 0;
+}
@@ -0,0 +1,175 @@
+#include "../work_queue.h"
+#include <my_thread.h>
+#include <my_mutex.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// 生产者和消费者数目从1到64，比较加锁链表队列与无锁环形队列（单个/批量）的吞吐量
+
+static const size_t ITEMS = 1 << 21;  // 每轮入队的总个数
+static const size_t BATCH = 16;
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*@brief 对照组：原来的实现方式，一把锁保护的队列*/
+class LockedQueue
+{
+public:
+  bool push_work(size_t work)
+  {
+    my_mutex::MutexLockGuard mlg(mutex_);
+    queue_.push_back(work);
+    return true;
+  }
+
+  size_t pop_work()
+  {
+    my_mutex::MutexLockGuard mlg(mutex_);
+    if(queue_.empty())
+      return 0;
+    size_t work = queue_.front();
+    queue_.pop_front();
+    return work;
+  }
+
+private:
+  std::deque<size_t> queue_;
+  my_mutex::MutexLock mutex_;
+};
+
+struct Counters
+{
+  std::atomic<size_t> popped;
+  std::atomic<size_t> sum;
+};
+
+template <class Queue>
+static void produce(Queue *queue, size_t begin, size_t end)
+{
+  for(size_t i = begin; i < end; ++i)
+  {
+    while(!queue->push_work(i + 1))
+      sched_yield();
+  }
+}
+
+template <class Queue>
+static void consume(Queue *queue, Counters *counters)
+{
+  size_t popped = 0, sum = 0;
+  while(counters->popped.load(std::memory_order_relaxed) < ITEMS)
+  {
+    size_t work = queue->pop_work();
+    if(work == 0)
+    {
+      if(popped > 0)
+      {
+        counters->popped += popped;
+        counters->sum += sum;
+        popped = sum = 0;
+      }
+      sched_yield();
+      continue;
+    }
+    ++popped;
+    sum += work;
+  }
+  counters->popped += popped;
+  counters->sum += sum;
+}
+
+static void produce_batch(WorkQueue<size_t> *queue, size_t begin, size_t end)
+{
+  size_t works[BATCH];
+  for(size_t i = begin; i < end; )
+  {
+    size_t n = std::min(BATCH, end - i);
+    for(size_t j = 0; j < n; ++j)
+      works[j] = i + j + 1;
+    size_t pushed = 0;
+    while(pushed < n)
+    {
+      size_t k = queue->push_works(works + pushed, n - pushed);
+      if(k == 0)
+        sched_yield();
+      pushed += k;
+    }
+    i += n;
+  }
+}
+
+static void consume_batch(WorkQueue<size_t> *queue, Counters *counters)
+{
+  size_t works[BATCH];
+  while(counters->popped.load(std::memory_order_relaxed) < ITEMS)
+  {
+    size_t n = queue->pop_works(works, BATCH);
+    if(n == 0)
+    {
+      sched_yield();
+      continue;
+    }
+    size_t sum = 0;
+    for(size_t j = 0; j < n; ++j)
+      sum += works[j];
+    counters->sum += sum;
+    counters->popped += n;
+  }
+}
+
+/**
+ * @brief 运行一轮，返回每个元素的平均耗时(ns)。校验所有元素恰好被取出一次
+ */
+template <class Queue, class Produce, class Consume>
+static double run(Queue *queue, int threads, Produce produce_func, Consume consume_func)
+{
+  Counters counters;
+  counters.popped = 0;
+  counters.sum = 0;
+  std::vector<std::shared_ptr<my_thread::Thread>> workers;
+  double start = now_ns();
+  for(int i = 0; i < threads; ++i)
+  {
+    size_t begin = ITEMS * i / threads, end = ITEMS * (i + 1) / threads;
+    workers.push_back(std::make_shared<my_thread::Thread>(produce_func, queue, begin, end));
+    workers.push_back(std::make_shared<my_thread::Thread>(consume_func, queue, &counters));
+  }
+  for(size_t i = 0; i < workers.size(); ++i)
+    workers[i]->start();
+  for(size_t i = 0; i < workers.size(); ++i)
+    workers[i]->join();
+  double elapsed = now_ns() - start;
+
+  if(counters.popped != ITEMS || counters.sum != ITEMS * (ITEMS + 1) / 2)
+  {
+    printf("queue lost or duplicated work! popped %zu\n", counters.popped.load());
+    return -1;
+  }
+  return elapsed / ITEMS;
+}
+
+int main(int argc, char **argv)
+{
+  printf("%8s %14s %14s %14s\n", "threads", "mutex ns/op", "ring ns/op", "batch ns/op");
+  for(int threads = 1; threads <= 64; threads *= 2)  // 生产者和消费者各 threads 个
+  {
+    LockedQueue locked;
+    WorkQueue<size_t> ring(4096), batch(4096);
+    double t_locked = run(&locked, threads, produce<LockedQueue>, consume<LockedQueue>);
+    double t_ring = run(&ring, threads, produce<WorkQueue<size_t>>, consume<WorkQueue<size_t>>);
+    double t_batch = run(&batch, threads, produce_batch, consume_batch);
+    printf("%8d %14.1f %14.1f %14.1f\n", threads, t_locked, t_ring, t_batch);
+  }
+  return 0;
+}
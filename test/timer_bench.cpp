@@ -0,0 +1,53 @@
+#include <timer_tick.h>
+#include <timer_queue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+// 时间轮添加/删除定时器的开销应当与队列中定时器个数无关
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void callback(timer_tick::Timer *timer)
+{
+}
+
+int main(int argc, char **argv)
+{
+  const int sizes[] = {1000, 10000, 100000, 1000000};
+  printf("%10s %12s %12s %12s\n", "timers", "add ns/op", "del ns/op", "expire ns/op");
+  for(size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n)
+  {
+    int count = sizes[n];
+    int64_t start = 1000000;
+    timer_tick::TimerQueue queue(start);
+    std::vector<timer_tick::Timer> timers;
+    timers.reserve(count);
+    for(int i = 0; i < count; ++i)
+    {
+      timers.push_back(timer_tick::Timer(i, callback, start + 1 + rand() % 600000));  // 模拟长连接空闲超时，毫秒，分布在10分钟内
+    }
+
+    double t0 = now_ns();
+    for(int i = 0; i < count; ++i)
+      queue.add_timer(&timers[i]);
+    double t1 = now_ns();
+    for(int i = 0; i < count; ++i)  // 模拟请求到达时删除定时器，再重新加入
+      queue.del_timer(&timers[i]);
+    double t2 = now_ns();
+    for(int i = 0; i < count; ++i)
+      queue.add_timer(&timers[i]);
+    double t3 = now_ns();
+    int expired = queue.expire(start + 600000);
+    double t4 = now_ns();
+
+    printf("%10d %12.1f %12.1f %12.1f\n", count, (t1 - t0) / count, (t2 - t1) / count, (t4 - t3) / expired);
+  }
+  return 0;
+}
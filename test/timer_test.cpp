@@ -4,6 +4,7 @@
 #include <time.h>
 #include <vector>
 #include <timer_queue.h>
+#include <stdio.h>
 
 void callback(timer_tick::Timer* timer)
 {}
@@ -21,12 +22,12 @@ int main()
   std::priority_queue<timer_tick::Timer*, std::vector<timer_tick::Timer*>, Compare_timer> timers;
   for(int i = 0; i < 5; ++i)
   {
-    timer_tick::Timer *new_timer = new timer_tick::Timer(callback, time(NULL));
+    timer_tick::Timer *new_timer = new timer_tick::Timer(callback, timer_tick::now_ms());
     timers.push(new_timer);
     sleep(1);
   }
 
-  timer_tick::Timer *new_timer = new timer_tick::Timer(callback, time(NULL)-10);
+  timer_tick::Timer *new_timer = new timer_tick::Timer(callback, timer_tick::now_ms()-10);
   timers.push(new_timer);
 
   while(!timers.empty())
@@ -43,18 +44,20 @@ int main()
   timer_tick::TimerQueue timer_queue;
 
 
-  timer_tick::Timer *new_timer1 = new timer_tick::Timer(1, callback, time(NULL)-10);
+  timer_tick::Timer *new_timer1 = new timer_tick::Timer(1, callback, timer_tick::now_ms()-10);
   timer_queue.add_timer(new_timer1);
 
-  timer_tick::Timer *new_timer2 = new timer_tick::Timer(1, callback, time(NULL)-10);
+  timer_tick::Timer *new_timer2 = new timer_tick::Timer(2, callback, timer_tick::now_ms()-10);
   timer_queue.add_timer(new_timer2);
 
+  timer_tick::Timer *new_timer3 = new timer_tick::Timer(3, callback, timer_tick::now_ms()+100000);
+  timer_queue.add_timer(new_timer3);
+
 
   timer_queue.del_timer(new_timer1);
 
-  while(!timer_queue.empty())
-  {
-    printf("%ld\n", timer_queue.top()->overtime());
-    timer_queue.pop();
-  }
-}
\ No newline at end of file
+  printf("expired: %d\n", timer_queue.expire(timer_tick::now_ms()));  // new_timer2
+  printf("size: %d\n", timer_queue.size());  // new_timer3
+  printf("expired: %d\n", timer_queue.expire(timer_tick::now_ms()+100000));
+  printf("empty: %d\n", timer_queue.empty());
+}
@@ -0,0 +1,198 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+// 慢速上传浸泡测试：打开 N 个连接，每个连接先发送请求头的开头，之后每秒再发送一个字节，数据一直处于“在途”状态，
+// 服务器必须为每个连接保留收到的部分。hold 秒后补全所有连接的请求头，再逐个读取应答，确认每个连接都收到应答。
+// 接收缓冲区池的上限小于连接数时，取不到缓冲区的连接暂停读取，服务器的常驻内存不随连接数增长，
+// 补全请求头后随着缓冲区放回依次恢复（持有缓冲区的连接一直不补全请求头时，只能等请求头超时关闭它们）。请求头超时要大于 hold：
+//   httpserver -r 2 -e 60000 -p 1024
+//   upload_soak 127.0.0.1 54321 15000 10 /index.html <pid>
+// 测试进程和服务器各自受打开文件数的限制（ulimit -n），连接数不能超过它。
+
+static int64_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 读取进程的常驻内存，KB
+ */
+static long rss_kb(int pid)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  FILE *f = fopen(path, "r");
+  if(f == nullptr)
+    return -1;
+  char line[256];
+  long kb = -1;
+  while(fgets(line, sizeof(line), f) != nullptr)
+  {
+    if(strncmp(line, "VmRSS:", 6) == 0)
+    {
+      kb = atol(line + 6);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+static int connect_to(const char *host, int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(fd < 0)
+    return -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, host, &addr.sin_addr);
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  struct timeval timeout = { 30, 0 };  // 暂停的连接要等前面的连接放回缓冲区
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+/**
+ * @brief 读取一个完整的响应（首部和 Content-Length 长度的响应体）
+ *
+ * @return 状态码，连接关闭、超时或响应不完整返回-1
+ */
+static int read_response(int fd)
+{
+  std::string data;
+  char buf[16384];
+  size_t head_end = std::string::npos;
+  size_t total = 0;
+  while(true)
+  {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if(n <= 0)
+      return -1;
+    data.append(buf, n);
+    if(head_end == std::string::npos)
+    {
+      head_end = data.find("\r\n\r\n");
+      if(head_end == std::string::npos)
+        continue;
+      if(data.compare(0, 9, "HTTP/1.1 ") != 0)
+        return -1;
+      size_t cl = data.find("Content-Length:");
+      if(cl == std::string::npos || cl > head_end)
+        return -1;
+      total = head_end + 4 + strtoul(data.c_str() + cl + 15, nullptr, 10);
+    }
+    if(data.size() >= total)
+      return data.size() == total ? atoi(data.c_str() + 9) : -1;
+  }
+}
+
+/**
+ * @brief 在每个还打开的连接上发送 data，失败的连接关闭
+ */
+static void send_all(std::vector<int> &fds, const std::string &data)
+{
+  for(size_t i = 0; i < fds.size(); ++i)
+  {
+    if(fds[i] != -1 && send(fds[i], data.data(), data.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(data.size()))
+    {
+      close(fds[i]);
+      fds[i] = -1;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 4)
+  {
+    printf("usage: %s host port connections [hold_seconds] [path] [server_pid]\n", argv[0]);
+    return 1;
+  }
+  const char *host = argv[1];
+  int port = atoi(argv[2]);
+  int connections = atoi(argv[3]);
+  int hold = argc > 4 ? atoi(argv[4]) : 10;
+  std::string path = argc > 5 ? argv[5] : "/index.html";
+  int pid = argc > 6 ? atoi(argv[6]) : -1;
+
+  struct rlimit nofile;
+  if(getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max)
+  {
+    nofile.rlim_cur = nofile.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &nofile);
+  }
+
+  long rss_start = pid > 0 ? rss_kb(pid) : -1;
+  int64_t start = now_ms();
+  std::vector<int> fds;
+  fds.reserve(connections);
+  for(int i = 0; i < connections; ++i)
+  {
+    int fd = connect_to(host, port);
+    if(fd == -1)
+    {
+      printf("connect failed after %d connections: %s\n", i, strerror(errno));
+      break;
+    }
+    fds.push_back(fd);
+  }
+  send_all(fds, "GET " + path + " HTTP/1.1\r\nHost: soak\r\nX-Upload: ");
+  printf("%zu connections opened in %lld ms\n", fds.size(), static_cast<long long>(now_ms() - start));
+
+  long rss_peak = 0;
+  for(int i = 0; i < hold; ++i)
+  {
+    sleep(1);
+    send_all(fds, "x");
+    long rss = pid > 0 ? rss_kb(pid) : -1;
+    if(rss > rss_peak)
+      rss_peak = rss;
+  }
+  if(pid > 0 && !fds.empty())
+    printf("server rss: %ld KB before, peak %ld KB with %zu slow uploads, %.0f bytes per connection\n",
+           rss_start, rss_peak, fds.size(), (rss_peak - rss_start) * 1024.0 / fds.size());
+
+  // 补全请求头，响应很小，服务器不需要等客户端读取就能发出，按连接的顺序读取即可。
+  // 所有请求同时到达，线程池排队超过目标时会应答503，这是过载保护，单独统计
+  start = now_ms();
+  send_all(fds, "\r\n\r\n");
+  int answered = 0;
+  int shed = 0;
+  int failed = 0;
+  for(size_t i = 0; i < fds.size(); ++i)
+  {
+    int status = fds[i] != -1 ? read_response(fds[i]) : -1;
+    if(status == 200)
+      ++answered;
+    else if(status == 503)
+      ++shed;
+    else
+      ++failed;
+    if(fds[i] != -1)
+      close(fds[i]);
+  }
+  printf("%d of %zu uploads answered in %lld ms, %d shed with 503, %d failed\n",
+         answered, fds.size(), static_cast<long long>(now_ms() - start), shed, failed);
+  return (failed == 0 && answered + shed == connections) ? 0 : 1;
+}
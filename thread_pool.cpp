@@ -9,7 +9,9 @@
  * 
  */
 #include "thread_pool.h"
-#include <signal.h>
+#include <time.h>
+#include <algorithm>
+#include <unistd.h>
 #include "work_queue.h"
 //#define LOGGER_DEBUG
 #define LOGGER_WARN
@@ -18,189 +20,620 @@
 namespace http_server
 {
 
-static struct timeval delay = {0, 2}; //延迟2微妙
+const int ThreadPool::WORK_BATCH;
+const int ThreadPool::SPIN_MIN;
+const int ThreadPool::SPIN_MAX;
+
+static __thread ThreadPool *current_pool = nullptr;  // 当前工作线程所属的线程池，外部线程为nullptr
+static __thread int current_index = -1;  // 当前工作线程的索引
+static __thread unsigned current_picks = 0;  // 当前工作线程取工作的次数，决定何时先看受限通道
+
+static int64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
 ThreadPool::ThreadPool(parameters::Parameters *pool_parameters)
-  : next_(0),
-    threads_num_(0),
+  : threads_num_(0),
+    slot_num_(0),
     started(false),
     boot_mutex_(),
     boot_cond_(boot_mutex_),
     pool_activate(false),
+    manage_cond_(manage_mutex_),
+    queue_delay_ns_(0),
+    taken_(0),
+    grows_(0),
+    retires_(0),
+    first_above_ns_(0),
+    shedding_(false),
+    shed_(0),
+    stale_(0),
+    spinning_num_(0),
+    wakeups_(0),
+    pool_work_queue_(pool_parameters->getMaxWorkNum() + 1),
     pool_parameters_(pool_parameters)
 {
-  threads_num_ = pool_parameters_->getInitWorkerNum();
+  min_threads_ = pool_parameters_->getMinWorkerNum();
+  max_threads_ = pool_parameters_->getMaxWorkerNum();
   max_work_num_ = pool_parameters_->getMaxWorkNum();
+  target_ns_ = pool_parameters_->getQueueTarget() * 1000000LL;
+  interval_ns_ = pool_parameters_->getQueueInterval() * 1000000LL;
+  max_spinning_ = std::min(max_threads_, static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN))) / 2;  // 单核时不自旋
+  lanes_[LANE_FAST] = nullptr;
+  lanes_[LANE_IO] = new Lane(max_work_num_ + 1, LANE_IO_PERCENT);
+  lanes_[LANE_SLOW] = new Lane(max_work_num_ + 1, LANE_SLOW_PERCENT);
 }
 
 /**
- * @brief 启动线程池。设置工作线程。
- * 
+ * @brief 启动线程池。预先分配所有槽位，启动初始数目的工作线程和管理线程。
+ *
  */
 void ThreadPool::start()
 {
   assert(!started);//assert的作用是先计算传入表达式，如果其值为假（即为0），那么它先向stderr打印一条出错信息，然后通过调用 abort 来终止程序运行。
-  assert(threads_num_ != 0);
-
-  sem_init(&task_num_, 0, 0);//线程信号量初始化
+  assert(max_threads_ != 0);
 
   started = true;
+  pool_activate = true;
+
+  for(int i = 0; i < max_threads_; ++i)  // 槽位不会移动或释放，窃取时可以无锁访问
+    work_threads_.push_back(new work_thread::WorkThread(std::bind(&ThreadPool::thread_routine, this, i)));
+
+  int init_threads = pool_parameters_->getInitWorkerNum();
+  for(int i = 0; i < init_threads; ++i)
+    spawn_worker();
 
-  pthread_barrier_init(&pool_barrier_, NULL, threads_num_ + 1); // 初始化线程屏障，屏障等待的最大线程数目为threads_num_ + 1（使用线程屏障使所有线程同步）。
+  manage_thread_ = std::shared_ptr<my_thread::Thread>(new my_thread::Thread(std::bind(&ThreadPool::manage, this)));
+  manage_thread_->start();
+
+  INFO("Thread pool is ready to work.\n");
+}
+
+/**
+ * @brief 工作线程例行函数。从工作队列中获取并执行工作.
+ *
+ * @param 工作线程储存vector的索引 index
+ */
+void ThreadPool::thread_routine(int index)
+{
+  INFO("Generated a work thread. thread id: %lu\n", pthread_self())//显示当前线程的ID
+
+  assert(index < work_threads_.size());
+  work_thread::WorkThread* this_work_thread = work_threads_[index];
 
-  for(int i = 0; i < threads_num_; ++i)
   {
-    work_thread::WorkThread* t = new work_thread::WorkThread(std::bind(&ThreadPool::thread_routine, this, i));
-    work_threads_.push_back(t);
-    t->state_ = BOOTING;
-    t->start();
-    boot_cond_.wait();//等待该线程开启
-    t->state_ = READY;
+    my_mutex::MutexLockGuard mlg(boot_mutex_);
+    this_work_thread->state_ = READY;
   }
+  boot_cond_.notify();//通知该线程开启
 
-  pool_activate = true;
-
-  distribute_thread_ = std::shared_ptr<my_thread::Thread>(new my_thread::Thread(std::bind(&ThreadPool::distribute_task, this)));
-  distribute_thread_->start();
+  current_pool = this;
+  current_index = index;
+  int spin_limit = SPIN_MIN;
 
-  pthread_barrier_wait(&pool_barrier_);//等待并检查线程屏障是否使所有线程同步，若是则执行下一句代码，否则线程继续等待
+  while(pool_activate)
+  {
+    int lane = LANE_FAST;
+    work_thread::Work *work = find_work(index, &lane);
+    if(work == nullptr)
+    {
+      if(!spin(spin_limit) && !park(index))
+        break;  // 空闲太久，退出
+      continue;
+    }
+    DEBUG("get a job. thread id: %lu\n", pthread_self());
+    int64_t start = now_ns();
+    record_delay(work, start);
+    if(work->stale())  // 排队期间所属的连接已经关闭，不再执行
+      stale_.fetch_add(1, std::memory_order_relaxed);
+    else
+    {
+      this_work_thread->task_start_.store(start, std::memory_order_relaxed);
+      work->execute_work();//处理工作
+      this_work_thread->task_start_.store(0, std::memory_order_relaxed);
+    }
+    work_thread::Work::destroy_work(work);
+    if(lane != LANE_FAST)
+      lanes_[lane]->running.fetch_sub(1, std::memory_order_release);
+  }
+  this_work_thread->state_ = QUIT;  // 管理线程或 close_pool() 负责 join
+  INFO("Work thread %d exits.\n", index + 1);
+}
 
-  INFO("Thread pool is ready to work.\n");  
+/**
+ * @brief 为工作线程查找工作：先找快速通道，再找没有达到并发上限的受限通道。
+ *        每 LANE_WEIGHT 次先找受限通道，避免快速通道一直有工作时受限通道饿死
+ *
+ * @param index 工作线程的索引
+ * @param lane 输出找到的工作所在的通道，取自受限通道时执行完要归还名额
+ * @return work_thread::Work* 没有找到返回nullptr
+ */
+work_thread::Work* ThreadPool::find_work(int index, int *lane)
+{
+  bool lanes_first = ++current_picks % LANE_WEIGHT == 0;
+  for(int pass = 0; pass < 2; ++pass)
+  {
+    if(lanes_first == (pass == 0))
+    {
+      for(int l = LANE_FAST + 1; l < LANE_NUM; ++l)
+      {
+        work_thread::Work *work = take_lane(l);
+        if(work != nullptr)
+        {
+          *lane = l;
+          return work;
+        }
+      }
+    }
+    else
+    {
+      work_thread::Work *work = take_fast(index);
+      if(work != nullptr)
+      {
+        *lane = LANE_FAST;
+        return work;
+      }
+    }
+  }
+  return nullptr;
 }
 
 /**
- * @brief 获得工作线程储存数组中下一个工作线程
- * 
- * @return work_thread::WorkThread* 
+ * @brief 查找快速通道的工作：自己的队列（后进先出）、全局注入队列、其他工作线程的队列（窃取）
+ *
+ * @param index 工作线程的索引
+ * @return work_thread::Work* 没有找到返回nullptr
  */
-work_thread::WorkThread* ThreadPool::get_next_work_thread()
+work_thread::Work* ThreadPool::take_fast(int index)
 {
-  work_thread::WorkThread* next_work_thread;
-  next_work_thread = work_threads_[next_];
-  ++next_;
-  if(static_cast<size_t>(next_) >= work_threads_.size())
+  work_thread::WorkThread* this_work_thread = work_threads_[index];
+  work_thread::Work *work = this_work_thread->pop_work();
+  if(work != nullptr)
+    return work;
+
+  // 从注入队列取自己的一份（至少一个），多出的放入自己的队列，其他空闲线程可以窃取。
+  // 平时先执行最早的，其余按先进先出的顺序放入队列；过载时（自适应后进先出）一次取更多，先执行最新的，
+  // 其余按后进先出的顺序执行，排队最久的工作留到最后，那时所属的连接多半已经超时关闭，取出时直接丢弃
+  work_thread::Work *works[SHED_BATCH];
+  bool lifo = shedding_.load(std::memory_order_relaxed);
+  int threads = std::max(threads_num_.load(std::memory_order_relaxed), 1);
+  int batch = lifo ? SHED_BATCH : WORK_BATCH;
+  int share = std::min(batch, pool_work_queue_.size() / threads + 1);
+  size_t count = pool_work_queue_.pop_works(works, share);
+  if(count > 0)
+  {
+    if(lifo)
+    {
+      for(size_t i = 0; i + 1 < count; ++i)
+        this_work_thread->add_work(works[i]);
+    }
+    else
+    {
+      for(size_t i = count - 1; i > 0; --i)
+        this_work_thread->add_work(works[i]);
+    }
+    if(count > 1)
+      wake_idle();
+    return lifo ? works[count - 1] : works[0];
+  }
+
+  int slots = slot_num_.load(std::memory_order_acquire);
+  for(int i = 1; i < slots; ++i)  // 从下一个线程开始，避免所有线程都先窃取同一个
   {
-    next_ = 0;
+    work = work_threads_[(index + i) % slots]->steal_work();
+    if(work != nullptr)
+      return work;
   }
-  return next_work_thread;
+  return nullptr;
 }
 
 /**
- * @brief 工作线程例行函数。从工作队列中获取并执行工作.
- * 
- * @param 工作线程储存vector的索引 index 
+ * @brief 受限通道同时执行的工作数上限：当前线程数的一定比例，至少为1
+ *
  */
-void ThreadPool::thread_routine(int index)
+int ThreadPool::lane_limit(int lane)
 {
-  pthread_detach(pthread_self());//分离当前线程，将状态改为unjoinable状态，使该线程函数退出时或pthread_exit时自动会被释放。
-  INFO("Generated a work thread. thread id: %lu\n", pthread_self())//显示当前线程的ID
+  return std::max(1, threads_num_.load(std::memory_order_relaxed) * lanes_[lane]->percent / 100);
+}
 
-  assert(index < work_threads_.size());
-  work_thread::WorkThread* this_work_thread = work_threads_[index];
+/**
+ * @brief 从受限通道取一个工作。先占用名额再出队，名额不足或队列为空时返回nullptr
+ *
+ */
+work_thread::Work* ThreadPool::take_lane(int lane)
+{
+  Lane *l = lanes_[lane];
+  if(l->queue.empty())
+    return nullptr;
+  if(l->running.fetch_add(1, std::memory_order_acq_rel) >= lane_limit(lane))
+  {
+    l->running.fetch_sub(1, std::memory_order_release);
+    return nullptr;
+  }
+  work_thread::Work *work = l->queue.pop_work();
+  if(work == nullptr)
+    l->running.fetch_sub(1, std::memory_order_release);
+  return work;
+}
+
+/**
+ * @brief 受限通道是否有可以马上执行的工作（有排队的工作且没有达到并发上限）
+ *
+ */
+bool ThreadPool::lane_ready(int lane)
+{
+  return !lanes_[lane]->queue.empty() && lanes_[lane]->running.load(std::memory_order_acquire) < lane_limit(lane);
+}
 
-  while(this_work_thread->state_ == BOOTING)
+/**
+ * @brief 是否有可以执行的工作：注入队列、任一工作线程的队列，或没有达到并发上限的受限通道。
+ *        达到上限的通道不算，否则空闲线程会反复醒来却取不到工作；名额由执行完的线程归还后自己接着取
+ *
+ */
+bool ThreadPool::has_work()
+{
+  if(!pool_work_queue_.empty())
+    return true;
+  for(int lane = LANE_FAST + 1; lane < LANE_NUM; ++lane)
+  {
+    if(lane_ready(lane))
+      return true;
+  }
+  int slots = slot_num_.load(std::memory_order_acquire);
+  for(int i = 0; i < slots; ++i)
   {
-    //my_mutex::MutexLockGuard mlg(boot_mutex_);
-    boot_cond_.notify();//通知该线程开启
+    if(work_threads_[i]->work_size() > 0)
+      return true;
   }
+  return false;
+}
 
-  pthread_barrier_wait(&pool_barrier_);
+/**
+ * @brief 放入工作后调用。有线程正在自旋时它会取走工作，不需要唤醒；否则唤醒一个睡眠的工作线程。
+ *        提交者先放入工作再检查自旋/睡眠的线程数，工作线程先宣布睡眠再检查队列（两边都有顺序一致的栅栏），
+ *        两者至少有一方能看到对方，不会丢失唤醒。
+ */
+void ThreadPool::wake_idle()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(spinning_num_.load(std::memory_order_relaxed) > 0)
+    return;
+  if(idle_event_.notify_one())
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+}
 
-  while(pool_activate)
+/**
+ * @brief 睡眠前先自旋等待一会儿，中等负载下工作间隔很短，自旋就能等到，省去睡眠和唤醒两次系统调用。
+ *        自旋次数自适应：自旋等到了工作就加倍，没等到就减半。同时自旋的线程数不超过CPU数的一半。
+ *
+ * @param spin_limit 本线程当前的自旋次数上限
+ * @return 等到了工作返回true
+ */
+bool ThreadPool::spin(int &spin_limit)
+{
+  int spinning = spinning_num_.load(std::memory_order_relaxed);
+  if(spinning >= max_spinning_ || !spinning_num_.compare_exchange_strong(spinning, spinning + 1))
+    return false;
+  bool found = false;
+  for(int i = 0; i < spin_limit && pool_activate; ++i)
   {
-    if(this_work_thread->work_empty())
+    if(has_work())
     {
-      {
-        my_mutex::MutexLockGuard mlg(this_work_thread->get_mutex());
-        this_work_thread->state_ = IDLE;
-      }
-      this_work_thread->get_condition().wait();// 等待激活该工作线程
+      found = true;
+      break;
     }
-    if(pool_activate == false)
+    my_eventcount::cpu_relax();
+  }
+  spinning_num_.fetch_sub(1, std::memory_order_seq_cst);
+  if(found)
+    spin_limit = std::min(spin_limit * 2, SPIN_MAX);
+  else
+    spin_limit = std::max(spin_limit / 2, SPIN_MIN);
+  return found;
+}
+
+/**
+ * @brief 找不到工作时睡眠，直到有新的工作提交、线程池关闭，或者空闲超过 RETIRE_IDLE_MS
+ *
+ * @param index 工作线程的索引
+ * @return 本线程应当退出时返回false
+ */
+bool ThreadPool::park(int index)
+{
+  uint32_t key = idle_event_.prepare_wait();
+  if(has_work() || !pool_activate)  // 宣布睡眠后再检查一次
+  {
+    idle_event_.cancel_wait();
+    return true;
+  }
+  work_threads_[index]->state_ = IDLE;
+  bool notified = idle_event_.wait_for(key, RETIRE_IDLE_MS);
+  work_threads_[index]->state_ = BUSY;
+  if(!notified)
+    return !retire(index);
+  return true;
+}
+
+/**
+ * @brief 空闲超时的线程尝试退出。线程数不能低于下限。
+ *        超时与通知可能同时发生：退出前再检查一次队列，有工作就不退出，避免通知落在正在退出的线程上而丢失。
+ *
+ * @param index 工作线程的索引
+ * @return 可以退出返回true
+ */
+bool ThreadPool::retire(int index)
+{
+  int threads = threads_num_.load(std::memory_order_relaxed);
+  while(true)
+  {
+    if(threads <= min_threads_)
+      return false;
+    if(threads_num_.compare_exchange_weak(threads, threads - 1, std::memory_order_seq_cst))
       break;
-    while(!this_work_thread->work_empty())
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(has_work() && pool_activate)
+  {
+    threads_num_.fetch_add(1, std::memory_order_seq_cst);
+    return false;
+  }
+  retires_.fetch_add(1, std::memory_order_relaxed);
+  INFO("Work thread %d retires after idling. threads: %d\n", index + 1, threads - 1);
+  return true;
+}
+
+/**
+ * @brief 在一个空槽位上启动新的工作线程。调用者为 start() 或管理线程
+ *
+ * @return 已达到线程数上限返回false
+ */
+bool ThreadPool::spawn_worker()
+{
+  my_mutex::MutexLockGuard mlg(pool_mutex_);
+  for(int i = 0; i < max_threads_; ++i)
+  {
+    work_thread::WorkThread *t = work_threads_[i];
+    if(t->started() && t->state_ == QUIT)  // 已退出的线程先回收
+      t->join();
+    if(t->started())
+      continue;
+    threads_num_.fetch_add(1, std::memory_order_seq_cst);
+    if(i >= slot_num_.load(std::memory_order_relaxed))
+      slot_num_.store(i + 1, std::memory_order_release);
+    t->state_ = BOOTING;
+    t->start();
+    boot_cond_.wait([t] { return t->state_ != BOOTING; });//等待该线程开启
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief 回收已经退出的线程
+ *
+ */
+void ThreadPool::join_exited()
+{
+  my_mutex::MutexLockGuard mlg(pool_mutex_);
+  for(int i = 0; i < max_threads_; ++i)
+  {
+    if(work_threads_[i]->started() && work_threads_[i]->state_ == QUIT)
+      work_threads_[i]->join();
+  }
+}
+
+/**
+ * @brief 执行时间超过 BLOCKED_NS 的线程数
+ *
+ */
+int ThreadPool::blocked_workers(int64_t now)
+{
+  int blocked = 0;
+  int slots = slot_num_.load(std::memory_order_acquire);
+  for(int i = 0; i < slots; ++i)
+  {
+    int64_t start = work_threads_[i]->task_start_.load(std::memory_order_relaxed);
+    if(start != 0 && now - start > BLOCKED_NS)
+      ++blocked;
+  }
+  return blocked;
+}
+
+/**
+ * @brief 记录一个工作的排队时间：更新指数移动平均（权重1/8），并按 CoDel 的规则判断是否过载。
+ *        排队时间低于目标即退出过载；第一次超过目标时记下 now + interval，到那时仍然超过目标才进入过载，
+ *        短暂的突发不会触发拒绝。多个线程同时更新时可能丢失个别样本，不影响判断
+ *
+ */
+void ThreadPool::record_delay(work_thread::Work *work, int64_t now)
+{
+  int64_t sample = now - work->enqueue_time();
+  int64_t average = queue_delay_ns_.load(std::memory_order_relaxed);
+  queue_delay_ns_.store(average + (sample - average) / 8, std::memory_order_relaxed);
+  taken_.fetch_add(1, std::memory_order_relaxed);
+
+  if(sample < target_ns_)
+  {
+    if(first_above_ns_.load(std::memory_order_relaxed) != 0)
+      first_above_ns_.store(0, std::memory_order_relaxed);
+    if(shedding_.load(std::memory_order_relaxed))
     {
-      DEBUG("get a job. thread id: %lu\n", pthread_self());
-      (this_work_thread->pop_work())->execute_work();//处理工作队列队首的工作
+      shedding_.store(false, std::memory_order_relaxed);
+      INFO("Queue delay is back under target, accepting new work.\n");
     }
+    return;
+  }
+  int64_t first_above = first_above_ns_.load(std::memory_order_relaxed);
+  if(first_above == 0)
+    first_above_ns_.compare_exchange_strong(first_above, now + interval_ns_, std::memory_order_relaxed);
+  else if(now >= first_above && !shedding_.load(std::memory_order_relaxed))
+  {
+    shedding_.store(true, std::memory_order_relaxed);
+    WARN("Queue delay %ld us stayed above target, shedding new work.\n", static_cast<long>(sample / 1000));
   }
-  INFO("Work thread %d exits.\n", index + 1);
 }
 
 /**
- * @brief 工作分发线程分配线程池工作队列中的工作任务。
- * 
+ * @brief 外部线程提交的工作是否接受。过载时拒绝；没有工作积压时（例如所有工作线程都在执行耗时长的工作，
+ *        或者过载后队列已经清空）不会再有新的排队时间样本，直接退出过载
+ *
  */
-void ThreadPool::distribute_task()
+bool ThreadPool::admit()
 {
-  pthread_detach(pthread_self());
-  INFO("distribute_task function started. thread id: %lu\n", pthread_self())
+  if(!shedding_.load(std::memory_order_relaxed))
+    return true;
+  if(!has_work())
+  {
+    first_above_ns_.store(0, std::memory_order_relaxed);
+    shedding_.store(false, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
 
+/**
+ * @brief 管理线程。周期性地回收退出的线程，并根据排队时间和被阻塞的线程数增加线程
+ *
+ */
+void ThreadPool::manage()
+{
   while(pool_activate)
   {
-    sem_wait(&task_num_);//线程信号量等待函数，每次使信号量值减1，直至为0
-    if(pool_activate != true)
+    manage_cond_.waitForSeconds(MANAGE_INTERVAL_MS / 1000.0);
+    if(!pool_activate)
       break;
-    work_thread::WorkThread* selected_thread = get_next_work_thread();
-    assert(!pool_work_queue_.empty());
-    work_thread::Work::WorkPtr work_to_past = pool_work_queue_.pop_work();
-    selected_thread->add_work(work_to_past);
+    join_exited();
+
+    size_t taken = taken_.exchange(0, std::memory_order_relaxed);
+    int threads = threads_num_.load(std::memory_order_relaxed);
+    if(!has_work())
     {
-      //my_mutex::MutexLockGuard mlg(selected_thread->get_mutex());
-      if(selected_thread->state_ == IDLE)
-      {
-        selected_thread->state_ = BUSY;
-        selected_thread->get_condition().notify();  //通知激活线程来执行这项工作
-      }
+      if(taken == 0)
+        queue_delay_ns_.store(0, std::memory_order_relaxed);  // 没有新样本，旧的平均值不再代表当前状态
+      continue;
     }
+    if(threads >= max_threads_ || idle_event_.waiters() > 0)
+      continue;
+
+    int grow = 0;
+    if(queue_delay_ns_.load(std::memory_order_relaxed) > GROW_DELAY_NS || taken == 0)  // 排队太久，或者整个周期没有取出任何工作
+      grow = 1;
+    grow = std::max(grow, blocked_workers(now_ns()));  // 每个被阻塞的线程补充一个
+    grow = std::min(grow, max_threads_ - threads);
+    for(int i = 0; i < grow && spawn_worker(); ++i)
+      grows_.fetch_add(1, std::memory_order_relaxed);
+    if(grow > 0)
+      INFO("Thread pool grows to %d threads. queue delay: %ld us\n", threads_num_.load(),
+           static_cast<long>(queue_delay_ns_.load() / 1000));
   }
-  INFO("Distrubute task thread exits.\n");
 }
 
 /**
- * @brief 添加工作任务至线程池工作队列。 
- * 
- * @param new_task 
- * @return status 
+ * @brief 添加工作至线程池工作队列。
+ *
+ * @param work 失败时所有权仍属于调用者
+ * @param lane 工作的通道
+ * @param admitted 工作属于已经接受的请求，过载时也不拒绝
+ * @return status
  */
-status ThreadPool::add_task_to_pool(TaskFunc new_task)
+status ThreadPool::submit(work_thread::Work *work, work_lane lane, bool admitted)
 {
-  if(pool_work_queue_.size() > max_work_num_)
+  work->set_enqueue_time(now_ns());
+  if(lane != LANE_FAST)
+  {
+    if(current_pool != this && !admitted && !admit())  // 工作线程转交的工作已经被接受过
+    {
+      shed_.fetch_add(1, std::memory_order_relaxed);
+      return FAILED;
+    }
+    if(!lanes_[lane]->queue.push_work(work))
+    {
+      shed_.fetch_add(1, std::memory_order_relaxed);
+      WARN("Thread pool lane %d is full.\n", lane);
+      return FAILED;
+    }
+    wake_idle();
+    return SUCCESS;
+  }
+  if(current_pool == this)  // 工作线程提交的工作放入自己的队列
   {
+    work_threads_[current_index]->add_work(work);
+    wake_idle();
+    return SUCCESS;
+  }
+  if(!admitted && !admit())
+  {
+    shed_.fetch_add(1, std::memory_order_relaxed);
+    return FAILED;
+  }
+  if(!admitted && pool_work_queue_.size() > max_work_num_)
+  {
+    shed_.fetch_add(1, std::memory_order_relaxed);
     WARN("Thread pool is busy. queue size: %d\n", pool_work_queue_.size());
     return FAILED;
   }
-  std::shared_ptr<work_thread::Work> new_work = work_thread::Work::create_work(new_task);
-  pool_work_queue_.push_work(new_work);
-  //my_mutex::MutexLockGuard mlg(pool_mutex_);
-  sem_post(&task_num_);//线程信号量增加1
+  if(!pool_work_queue_.push_work(work))
+  {
+    shed_.fetch_add(1, std::memory_order_relaxed);
+    WARN("Thread pool work queue is full.\n");
+    return FAILED;
+  }
+  wake_idle();
   return SUCCESS;
 }
 
-
 /**
- * @brief 关闭线程池。
- * 
+ * @brief 获取线程池统计
+ *
+ * @return ThreadPool::PoolStats
  */
-void ThreadPool::close_pool()
+ThreadPool::PoolStats ThreadPool::stats()
 {
-  pool_activate = false;
-  sem_post(&task_num_);//线程信号量增加1，当有线程等待这个信号量的时候等待的线程返回
-  while(pthread_kill(distribute_thread_->thread_id(), 0) == 0)  // 确认已经退出线程。pthread_kill函数的参数signo为0时测试线程是否存在，返回0则存在
+  work_thread::Work::Stats work_stats = work_thread::Work::stats();
+  PoolStats pool_stats;
+  pool_stats.queued = pool_work_queue_.size();
+  pool_stats.idle = idle_event_.waiters();
+  pool_stats.work_allocs = work_stats.work_allocs;
+  pool_stats.work_frees = work_stats.work_frees;
+  pool_stats.heap_funcs = work_stats.heap_funcs;
+  pool_stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+  pool_stats.threads = threads_num_.load(std::memory_order_relaxed);
+  pool_stats.queue_delay_us = queue_delay_ns_.load(std::memory_order_relaxed) / 1000;
+  pool_stats.grows = grows_.load(std::memory_order_relaxed);
+  pool_stats.retires = retires_.load(std::memory_order_relaxed);
+  pool_stats.shedding = shedding_.load(std::memory_order_relaxed);
+  pool_stats.shed = shed_.load(std::memory_order_relaxed);
+  pool_stats.stale = stale_.load(std::memory_order_relaxed);
+  pool_stats.lane_queued[LANE_FAST] = pool_work_queue_.size();
+  pool_stats.lane_running[LANE_FAST] = 0;
+  for(int lane = LANE_FAST + 1; lane < LANE_NUM; ++lane)
   {
-    select(0, NULL, NULL, NULL, &delay);//定时等待
+    pool_stats.lane_queued[lane] = lanes_[lane]->queue.size();
+    pool_stats.lane_running[lane] = lanes_[lane]->running.load(std::memory_order_relaxed);
   }
-  sem_destroy(&task_num_);//销毁信号量
+  return pool_stats;
+}
+
 
+/**
+ * @brief 关闭线程池。唤醒所有线程并 join，正在执行的工作会先执行完。
+ *
+ */
+void ThreadPool::close_pool()
+{
+  if(!started || !pool_activate.exchange(false))
+    return;
+  manage_cond_.notify();
+  manage_thread_->join();
+
+  my_mutex::MutexLockGuard mlg(pool_mutex_);
+  idle_event_.notify_all();//唤醒所有睡眠的工作线程；之后才睡眠的线程会在 park() 中看到 pool_activate 为false
   for (int i = 0; i < work_threads_.size(); ++i)
-  {
-    while (pthread_kill(work_threads_[i]->work_thread_id(), 0) == 0)
-    {
-      work_threads_[i]->get_condition().notify();//通知激活该线程
-      select(0, NULL, NULL, NULL, &delay);
-    }
-  }
+    work_threads_[i]->join();
   INFO("Thread pool is closed successfully.\n");
 }
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
@@ -14,62 +14,236 @@
 #include <boost/noncopyable.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include "work_thread.h"
-#include <semaphore.h>//使用线程信号量
+#include <atomic>
+#include <my_eventcount.h>
 #include "parameters.h"
 #include "work_queue.h"
 
 namespace http_server
 {
 
-/*@brief 线程池类*/
-class ThreadPool : public boost::noncopyable
+/*
+*@brief 工作的通道。耗时差别很大的请求分开排队，慢的通道有并发上限，不能占满所有工作线程
+*/
+enum work_lane
 {
-  typedef std::function<void()> TaskFunc;
+  LANE_FAST,  // 读取、解析请求，静态内容缓存命中：微秒级，不设上限
+  LANE_IO,  // 缓存未命中，需要打开、读取文件（冷磁盘读）
+  LANE_SLOW,  // CGI等动态内容，可能阻塞数秒
+  LANE_NUM
+};
 
+/*
+*@brief 线程池类（工作窃取调度）。
+*       外部线程（reactor）提交的工作放入全局注入队列；工作线程提交的工作放入自己的工作窃取队列。
+*       工作线程依次从自己的队列、注入队列（一次取一小批，多出的放入自己的队列）、其他线程的队列获取工作，
+*       耗时长的工作阻塞一个线程时，积压在它队列里的工作会被空闲线程窃取。找不到工作时先自旋，再在 eventcount 上睡眠。
+*       线程数在 [min_worker_num, max_worker_num] 之间伸缩：管理线程每 MANAGE_INTERVAL_MS 检查一次排队时间和被阻塞的线程数，
+*       排队时间超过 GROW_DELAY_NS 或有线程被阻塞且没有空闲线程时增加线程；空闲超过 RETIRE_IDLE_MS 的线程自行退出。
+*       增加线程只看近期的排队时间，减少线程要连续空闲很久，两者之间的差距就是滞后区间，避免线程数来回振荡。
+*       准入控制（CoDel）：工作取出时的排队时间连续 queue_interval 都超过 queue_target，说明队列在持续积压而不是短暂的突发，
+*       此时拒绝外部线程提交的新工作，由 reactor 直接应答503；排队时间回落到目标以下或队列清空后恢复接受。
+*       已经接受的请求的后续工作（继续发送响应）不受准入控制，拒绝它只会截断响应。
+*       拒绝新工作让已经排队的请求在期限内完成，过载时有效吞吐量保持平稳，而不是所有请求都排队到超时。
+*       过载期间快速通道改为后进先出（自适应 LIFO）：注入队列是先进先出的环形队列，工作线程一次取出更大的一批，
+*       从最新的开始执行，排队最久、客户端最可能已经放弃的工作最后执行。
+*       通道：LANE_FAST 使用上面的注入队列和工作窃取；LANE_IO、LANE_SLOW 各有一个队列，同时执行的工作数不超过当前线程数的
+*       LANE_IO_PERCENT、LANE_SLOW_PERCENT，其余线程总能处理快速的请求。工作线程优先取快速通道，
+*       每 LANE_WEIGHT 次取工作先看一次受限的通道，快速通道一直繁忙时慢的通道也不会饿死。
+*/
+class ThreadPool : public boost::noncopyable
+{
 public:
+  /*
+  *@brief 线程池统计。work_allocs 在稳定运行时不再增长，说明提交工作没有分配内存
+  */
+  struct PoolStats
+  {
+    int queued;  // 注入队列中的工作数
+    int idle;  // 睡眠的工作线程数
+    size_t work_allocs;  // 累计 new 的 Work 对象数
+    size_t work_frees;  // 累计 delete 的 Work 对象数
+    size_t heap_funcs;  // 可调用对象在堆上分配的次数
+    size_t wakeups;  // 唤醒睡眠工作线程的次数（futex 系统调用）
+    int threads;  // 当前工作线程数
+    int64_t queue_delay_us;  // 排队时间的指数移动平均
+    size_t grows;  // 累计增加的线程数
+    size_t retires;  // 累计退出的线程数
+    bool shedding;  // 是否正在拒绝新工作
+    size_t shed;  // 累计拒绝的工作数
+    size_t stale;  // 取出时已经过期、被丢弃的工作数
+    int lane_queued[LANE_NUM];  // 各通道排队的工作数（LANE_FAST 即注入队列）
+    int lane_running[LANE_NUM];  // 受限通道正在执行的工作数，LANE_FAST 不统计
+  };
+
   ThreadPool(parameters::Parameters *pool_parameters);
 
   void start();
 
   void thread_routine(int index);
 
-  void distribute_task();
-
-  work_thread::WorkThread *get_next_work_thread();
-
   ~ThreadPool()
   {
+    close_pool();
     for (int i = 0; i < work_threads_.size(); ++i)
     {
+      while(work_thread::Work *work = work_threads_[i]->pop_work())  // 线程都已退出，留在工作窃取队列里的工作
+        work_thread::Work::destroy_work(work);
       delete work_threads_[i];
     }
+    while(work_thread::Work *work = pool_work_queue_.pop_work())  // 关闭时没有执行的工作
+      work_thread::Work::destroy_work(work);
+    for(int lane = LANE_FAST + 1; lane < LANE_NUM; ++lane)
+    {
+      while(work_thread::Work *work = lanes_[lane]->queue.pop_work())
+        work_thread::Work::destroy_work(work);
+      delete lanes_[lane];
+    }
+  }
+
+  /*
+  *@brief 添加工作任务至线程池。可调用对象直接构造在复用的 Work 对象里，不经过 std::function
+  *@param new_task 可调用对象
+  *@param lane 工作的通道
+  *@return 线程池过载（排队时间持续超过目标或队列已满）时返回FAILED，调用者应当拒绝该请求
+  */
+  template <class F>
+  status add_task_to_pool(F &&new_task, work_lane lane = LANE_FAST)
+  {
+    work_thread::Work *work = work_thread::Work::create_work(std::forward<F>(new_task));
+    if(submit(work, lane) == FAILED)
+    {
+      work_thread::Work::destroy_work(work);
+      return FAILED;
+    }
+    return SUCCESS;
   }
 
-  status add_task_to_pool(TaskFunc new_task);
+  /*
+  *@brief 添加属于某个对象（例如连接）的工作。取出工作时对象的代数已经变化（对象已关闭或被复用）则直接丢弃，不执行
+  *@param new_task 可调用对象
+  *@param owner 所属对象的代数
+  *@param expected 提交时的代数
+  *@param lane 工作的通道
+  *@param admitted 工作属于已经接受的请求（例如继续发送响应），不经过准入控制，只有队列放不下时失败
+  *@return 线程池过载时返回FAILED
+  */
+  template <class F>
+  status add_task_to_pool(F &&new_task, const std::atomic<uint64_t> *owner, uint64_t expected,
+                          work_lane lane = LANE_FAST, bool admitted = false)
+  {
+    work_thread::Work *work = work_thread::Work::create_work(std::forward<F>(new_task));
+    work->set_owner(owner, expected);
+    if(submit(work, lane, admitted) == FAILED)
+    {
+      work_thread::Work::destroy_work(work);
+      return FAILED;
+    }
+    return SUCCESS;
+  }
+
+  PoolStats stats();
 
   void close_pool();
 
 private:
-  std::vector<work_thread::WorkThread *> work_threads_;//工作线程存储数组vector
-  std::shared_ptr<my_thread::Thread> distribute_thread_;//分发线程
-  int next_;//标记下一个工作线程
-  int threads_num_;//线程数
+  /*
+  *@brief 受限通道：独立的队列和并发上限
+  */
+  struct Lane : public boost::noncopyable
+  {
+    Lane(size_t capacity, int share) : queue(capacity), running(0), percent(share) {}
+
+    WorkQueue<work_thread::Work*> queue;
+    std::atomic<int> running;  // 正在执行的工作数
+    int percent;  // 最多占用当前线程数的百分比
+  };
+
+  status submit(work_thread::Work *work, work_lane lane, bool admitted = false);
+
+  work_thread::Work* find_work(int index, int *lane);
+
+  work_thread::Work* take_fast(int index);
+
+  work_thread::Work* take_lane(int lane);
+
+  int lane_limit(int lane);
+
+  bool lane_ready(int lane);
+
+  bool has_work();
+
+  bool spawn_worker();
+
+  bool retire(int index);
+
+  void join_exited();
+
+  void manage();
+
+  int blocked_workers(int64_t now);
+
+  void record_delay(work_thread::Work *work, int64_t now);
+
+  bool admit();
+
+  void wake_idle();
+
+  bool spin(int &spin_limit);
+
+  bool park(int index);
+
+  std::vector<work_thread::WorkThread *> work_threads_;//工作线程槽位，按最大线程数预先分配
+  std::atomic<int> threads_num_;//当前线程数
+  std::atomic<int> slot_num_;//用过的槽位数，查找和窃取只需要遍历这些槽位
+  int min_threads_;//线程数下限
+  int max_threads_;//线程数上限
   bool started;//线程池开启标志位
   my_mutex::MutexLock boot_mutex_;//线程池启动锁
   my_condition::Condition boot_cond_;//线程池启动条件
 
-  pthread_barrier_t pool_barrier_;//线程池屏障
-  bool pool_activate;//线程池激活标志位
+  std::atomic<bool> pool_activate;//线程池激活标志位
+
+  my_mutex::MutexLock pool_mutex_;//线程池锁，保护槽位上线程的启动和回收
+  std::shared_ptr<my_thread::Thread> manage_thread_;//管理线程，调整线程数
+  my_mutex::MutexLock manage_mutex_;
+  my_condition::Condition manage_cond_;//关闭线程池时唤醒管理线程
 
-  my_mutex::MutexLock pool_mutex_;//线程池锁
+  std::atomic<int64_t> queue_delay_ns_;//排队时间的指数移动平均
+  std::atomic<size_t> taken_;//本管理周期内取出的工作数
+  std::atomic<size_t> grows_;
+  std::atomic<size_t> retires_;
 
-  sem_t task_num_;//任务信号量
+  int64_t target_ns_;//排队时间目标
+  int64_t interval_ns_;//排队时间持续超过目标多久后开始拒绝
+  std::atomic<int64_t> first_above_ns_;//排队时间超过目标后，开始拒绝的时刻；0 表示低于目标
+  std::atomic<bool> shedding_;//正在拒绝外部提交的新工作
+  std::atomic<size_t> shed_;
+  std::atomic<size_t> stale_;//取出时已经过期而丢弃的工作数
 
-  WorkQueue<work_thread::Work::WorkPtr> pool_work_queue_;//线程池工作队列
+  my_eventcount::EventCount idle_event_;//空闲工作线程在此睡眠
+  std::atomic<int> spinning_num_;//正在自旋等待工作的线程数
+  int max_spinning_;//同时自旋的线程数上限
+  std::atomic<size_t> wakeups_;//唤醒次数
+
+  WorkQueue<work_thread::Work*> pool_work_queue_;//全局注入队列，外部线程提交的快速通道工作
+  Lane *lanes_[LANE_NUM];//受限通道，LANE_FAST 为nullptr
 
   parameters::Parameters *pool_parameters_;
 
   int max_work_num_;
+
+  static const int WORK_BATCH = 16;  // 工作线程一次从注入队列取出的最大工作数
+  static const int SHED_BATCH = 64;  // 过载时一次取出的最大工作数，按后进先出执行
+  static const int SPIN_MIN = 64;  // 自旋次数上限的自适应范围
+  static const int SPIN_MAX = 8192;
+  static const int MANAGE_INTERVAL_MS = 100;  // 管理线程检查的周期
+  static const int64_t GROW_DELAY_NS = 5000000;  // 平均排队时间超过 5ms 时增加线程
+  static const int64_t BLOCKED_NS = 20000000;  // 一个工作执行超过 20ms 视为线程被阻塞（CGI、冷磁盘读）
+  static const int RETIRE_IDLE_MS = 10000;  // 连续空闲 10s 的线程退出
+  static const int LANE_IO_PERCENT = 50;  // 冷文件读取最多占用一半线程
+  static const int LANE_SLOW_PERCENT = 25;  // 动态内容最多占用四分之一线程
+  static const int LANE_WEIGHT = 8;  // 每取 8 次工作先看一次受限通道
 };
 
 } // namespace http_server
@@ -1,17 +1,20 @@
 /**
  * @file timer_queue.h
  * @author zX
- * @brief timer queue for thread safety
+ * @brief timer queue for thread safety, implemented as a hierarchical timing wheel
  * @version 0.1
  * @date 2019-10-24
- * 
+ *
  * @copyright Copyright (c) 2019
- * 
+ *
  */
 #ifndef TIMER_QUEUE_H_
 #define TIMER_QUEUE_H_
 
-#include <list>
+#include <algorithm>
+#include <limits.h>
+#include <limits>
+#include <vector>
 #include <timer_tick.h>
 #include <my_mutex.h>
 
@@ -19,109 +22,256 @@ namespace timer_tick
 {
 
 /*
-*@brief 定时器队列类（队列中计时器按超时时间从小到大排列）
+*@brief 定时器队列类（分层时间轮）。
+*       共 LEVELS 层，每层 LEVEL_SIZE 个槽位，第 L 层一个槽位覆盖 LEVEL_SIZE^L 毫秒。
+*       添加和删除都是O(1)：定时器按距离到期的时间放入对应层的槽位（侵入式链表），
+*       时间推进到高层槽位时把其中的定时器重新分配（cascade）到低层，第0层槽位到期时触发回调。
+*       每层用一个64位图记录非空槽位，expire() 可以直接跳过空槽位。
+*       reactor 用 wait_timeout() 得到 epoll_wait 的超时时间；其他线程添加的定时器早于 reactor 计划醒来的时刻时，
+*       add_timer() 返回true，调用者负责唤醒 reactor。
 */
 class TimerQueue
 {
 public:
-  TimerQueue()
+  static const int LEVEL_BITS = 6;
+  static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+  static const int LEVEL_MASK = LEVEL_SIZE - 1;
+  static const int LEVELS = 4;
+
+  explicit TimerQueue(int64_t now = now_ms())
+    : current_(now),
+      size_(0),
+      wake_at_(std::numeric_limits<int64_t>::max())
   {
+    std::fill(occupied_, occupied_ + LEVELS, 0);
   }
 
   ~TimerQueue(){}
 
 /**
- * @brief 添加新的定时器到定时器链表队列，并设置其迭代器.
- * 
- * @param Timer* new_timer 
+ * @brief 添加新的定时器到时间轮
+ *
+ * @param Timer* new_timer
+ * @return 超时时间早于 reactor 计划醒来的时刻，需要唤醒 reactor 时返回true
  */
-  void add_timer(Timer* new_timer)
+  bool add_timer(Timer* new_timer)
   {
     my_mutex::MutexLockGuard mlg(mutex_);
-    if(timer_queue_.empty())
-    {
-      timer_queue_.push_back(new_timer);
-      new_timer->set_iter(timer_queue_.begin());
-      return;
-    }
-
-    for(auto iter = timer_queue_.begin(); iter != timer_queue_.end(); ++iter)
+    new_timer->set_queued(true);
+    place(new_timer);
+    ++size_;
+    if(new_timer->overtime() < wake_at_)
     {
-      //队列按超时时间从小到大排列
-      if(new_timer->overtime() < (*iter)->overtime())
-      {
-        auto new_iter = timer_queue_.insert(iter, new_timer);
-        new_timer->set_iter(new_iter);
-        return;
-      }
+      wake_at_ = new_timer->overtime();  // 只唤醒一次
+      return true;
     }
-    auto new_iter = timer_queue_.insert(timer_queue_.end(), new_timer);
-    new_timer->set_iter(new_iter);
+    return false;
   }
 
 /**
- * @brief 删除指向队列中迭代器指向的定时器。如果定时器不是在队列中,程序会崩溃。
- * 
- * @param Timer* del_timer 
+ * @brief 从时间轮中删除定时器。定时器不在队列中时不做任何操作。
+ *
+ * @param Timer* del_timer
  */
   void del_timer(Timer* del_timer)
   {
     my_mutex::MutexLockGuard mlg(mutex_);
-    timer_queue_.erase(del_timer->iter());
+    if(!del_timer->queued())
+      return;
+    unlink(del_timer);
+    del_timer->set_queued(false);
+    --size_;
   }
 
-  /**
- * @brief 获取定时器队列队首元素
- * 
- * @return Timer*  timer_queue_.begin()
+/**
+ * @brief 取出所有超时时间不晚于 now 的定时器并调用其回调函数（在锁外调用，回调中可以操作队列）。
+ *        只能由一个线程（reactor）调用。
+ *
+ * @param int64_t now
+ * @return 到期的定时器个数
  */
-  Timer* top()
+  int expire(int64_t now)
   {
-    my_mutex::MutexLockGuard mlg(mutex_);
-    if(timer_queue_.empty())
-      return nullptr;
-    else
-      return *(timer_queue_.begin());
+    {
+      my_mutex::MutexLockGuard mlg(mutex_);
+      while(current_ <= now)
+      {
+        int index = static_cast<int>(current_ & LEVEL_MASK);
+        if(index == 0)  // 第0层转完一圈，从高层依次重新分配
+        {
+          for(int level = 1; level < LEVELS; ++level)
+          {
+            int level_index = static_cast<int>((current_ >> (LEVEL_BITS * level)) & LEVEL_MASK);
+            cascade(level, level_index);
+            if(level_index != 0)
+              break;
+          }
+        }
+
+        TimerNode &head = slots_[0][index];
+        while(head.next != &head)
+        {
+          Timer *timer = static_cast<Timer*>(head.next);
+          unlink(timer);
+          timer->set_queued(false);
+          timer->set_fired_tag(timer->tag());
+          --size_;
+          expired_.push_back(timer);
+        }
+
+        if(size_ == 0)
+        {
+          current_ = now + 1;
+          break;
+        }
+        ++current_;
+        current_ = std::min(next_tick(), now + 1);  // 跳过中间没有定时器到期、也不需要重新分配的时刻
+      }
+    }
+
+    int expired = static_cast<int>(expired_.size());
+    for(size_t i = 0; i < expired_.size(); ++i)
+      expired_[i]->overtime_callback(expired_[i]);   //如果超时,调用回调函数来处理。
+    expired_.clear();
+    return expired;
   }
 
-  /**
- * @brief 删除定时器队列的队首元素
- * 
- * @param Timer* del_timer 
+/**
+ * @brief 计算 epoll_wait 的超时时间并记录 reactor 计划醒来的时刻。只能由调用 expire() 的线程调用。
+ *
+ * @param int64_t now
+ * @return 距离下一次需要调用 expire() 的毫秒数；队列为空返回-1（无限等待）
  */
-  void pop()
+  int wait_timeout(int64_t now)
   {
     my_mutex::MutexLockGuard mlg(mutex_);
-    if(!timer_queue_.empty())
+    if(size_ == 0)
     {
-      timer_queue_.erase(timer_queue_.begin());
+      wake_at_ = std::numeric_limits<int64_t>::max();
+      return -1;
     }
+    wake_at_ = next_tick();
+    if(wake_at_ <= now)
+      return 0;
+    return static_cast<int>(std::min<int64_t>(wake_at_ - now, INT_MAX));
   }
 
    /**
  * @brief 判断定时器队列是否为空
- * 
- * @return 为空返回true，否则返回false 
+ *
+ * @return 为空返回true，否则返回false
  */
   bool empty()
   {
     my_mutex::MutexLockGuard mlg(mutex_);
-    return timer_queue_.empty();
+    return size_ == 0;
   }
- 
+
  /**
  * @brief 获取定时器队列大小
- * 
- * @return 定时器队列大小int 
+ *
+ * @return 定时器队列大小int
  */
   int size()
   {
     my_mutex::MutexLockGuard mlg(mutex_);
-    return timer_queue_.size();
+    return size_;
   }
 
 private:
-  std::list<Timer*> timer_queue_;//计时器链表队列，队列中计时器按超时时间从小到大排列
+  /*
+  *@brief 按距离到期的时间选择层和槽位。已经超时的放入当前槽位，超出时间轮范围的放在最高层最远的槽位，
+  *       重新分配时再按真实的超时时间放置。调用者持有锁
+  */
+  void place(Timer* timer)
+  {
+    int64_t expires = std::max(timer->overtime(), current_);
+    int64_t delta = expires - current_;
+    int level = 0;
+    while(level < LEVELS - 1 && delta >= (static_cast<int64_t>(1) << (LEVEL_BITS * (level + 1))))
+      ++level;
+    int64_t range = static_cast<int64_t>(1) << (LEVEL_BITS * LEVELS);
+    if(delta >= range)
+      expires = current_ + range - 1;
+    int slot = static_cast<int>((expires >> (LEVEL_BITS * level)) & LEVEL_MASK);
+
+    TimerNode &head = slots_[level][slot];
+    timer->prev = head.prev;
+    timer->next = &head;
+    head.prev->next = timer;
+    head.prev = timer;
+    occupied_[level] |= 1ULL << slot;
+    timer->set_slot(level, slot);
+  }
+
+  void unlink(Timer* timer)
+  {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    TimerNode &head = slots_[timer->level()][timer->slot()];
+    if(head.next == &head)
+      occupied_[timer->level()] &= ~(1ULL << timer->slot());
+    timer->prev = timer->next = timer;
+  }
+
+  /*
+  *@brief 把高层一个槽位中的定时器重新放到低层
+  */
+  void cascade(int level, int slot)
+  {
+    TimerNode &head = slots_[level][slot];
+    if(head.next == &head)
+      return;
+    TimerNode list;  // 先摘下整条链表，避免放回同一槽位时死循环
+    list.next = head.next;
+    list.prev = head.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head.prev = head.next = &head;
+    occupied_[level] &= ~(1ULL << slot);
+    while(list.next != &list)
+    {
+      Timer *timer = static_cast<Timer*>(list.next);
+      list.next = timer->next;
+      timer->next->prev = &list;
+      place(timer);
+    }
+  }
+
+  /*
+  *@brief 从 current_ 开始，下一个有定时器到期（第0层）或需要重新分配（高层）的时刻。调用者持有锁
+  */
+  int64_t next_tick()
+  {
+    int64_t best = std::numeric_limits<int64_t>::max();
+    for(int level = 0; level < LEVELS; ++level)
+    {
+      if(occupied_[level] == 0)
+        continue;
+      int shift = LEVEL_BITS * level;
+      int64_t block = current_ >> shift;
+      int index = static_cast<int>(block & LEVEL_MASK);
+      // 高层的当前槽位在 current_ 恰好位于槽位边界时才是本轮，否则其中的定时器属于下一轮
+      bool aligned = level == 0 || (current_ & ((static_cast<int64_t>(1) << shift) - 1)) == 0;
+      int start = aligned ? index : index + 1;
+      uint64_t later = start < LEVEL_SIZE ? occupied_[level] & (~0ULL << start) : 0;
+      int64_t round = block & ~static_cast<int64_t>(LEVEL_MASK);
+      int64_t tick;
+      if(later != 0)
+        tick = (round | __builtin_ctzll(later)) << shift;
+      else
+        tick = ((round + LEVEL_SIZE) | __builtin_ctzll(occupied_[level])) << shift;
+      best = std::min(best, tick);
+    }
+    return best;
+  }
+
+  TimerNode slots_[LEVELS][LEVEL_SIZE];
+  uint64_t occupied_[LEVELS];  // 每层非空槽位的位图
+  int64_t current_;  // 下一个要处理的时刻
+  int size_;
+  int64_t wake_at_;  // reactor 计划醒来的时刻
+  std::vector<Timer*> expired_;  // expire() 中到期的定时器，只由reactor线程使用
   my_mutex::MutexLock mutex_;
 };
 
@@ -129,4 +279,4 @@ private:
 } // namespace timer_tick
 
 
-#endif // TIMER_QUEUE_H_
\ No newline at end of file
+#endif // TIMER_QUEUE_H_
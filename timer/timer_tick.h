@@ -1,7 +1,7 @@
 /**
  * @file timer_tick.h
  * @author zX
- * @brief Timer class. The timer contain overtime, callback function, iterator in queue and fd.
+ * @brief Timer class. The timer contain overtime, callback function, wheel links and fd.
  * @version 0.1
  * @date 2019-10-24
  * 
@@ -12,23 +12,54 @@
 #define TIMER_TICK_H_
 
 #include <functional>
+#include <stdint.h>
 #include <time.h>
-#include <list>
 
 namespace timer_tick
 {
 
 /*
-*@brief 定时器类
+*@brief 单调时钟的当前时间，毫秒。定时器的超时时间都使用这个时钟，不受系统时间调整影响
 */
-class Timer
+inline int64_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+*@brief 时间轮槽位中的侵入式双向循环链表节点
+*/
+struct TimerNode
+{
+  TimerNode() : prev(this), next(this) {}
+
+  // 复制出的节点不在任何链表中
+  TimerNode(const TimerNode&) : prev(this), next(this) {}
+
+  TimerNode& operator=(const TimerNode&) { return *this; }
+
+  TimerNode *prev;
+  TimerNode *next;
+};
+
+/*
+*@brief 定时器类。可以直接嵌入到连接对象中，加入定时器队列不需要分配内存
+*/
+class Timer : public TimerNode
 {
 public:
   typedef std::function<void (Timer*)> callback_func_;
-  Timer(int fd, callback_func_ func, time_t overtime = 0) 
+  Timer(int fd, callback_func_ func, int64_t overtime = 0) 
     : fd_(fd), 
       overtime_callback_(func), 
-      overtime_(overtime)
+      overtime_(overtime),
+      tag_(0),
+      fired_tag_(0),
+      queued_(false),
+      level_(0),
+      slot_(0)
   {
   }
 
@@ -55,22 +86,50 @@ public:
 
   /*
   *@brief 设置超时时间
-  *@param time_t overtime
+  *@param int64_t overtime 单调时钟毫秒，见 now_ms()
   */
-  void set_overtime(time_t overtime)
+  void set_overtime(int64_t overtime)
   {
     overtime_ = overtime;
   }
 
   /*
   *@brief 获取超时时间
-  *@return  超时时间 time_t overtime_
+  *@return  超时时间 int64_t overtime_
   */
-  time_t overtime()
+  int64_t overtime()
   {
     return overtime_;
   }
 
+  /*
+  *@brief 设置标签。定时器不在队列中时由加入它的线程设置，回调中用 fired_tag() 判断这次超时是否已经过时
+  *@param uint64_t tag
+  */
+  void set_tag(uint64_t tag)
+  {
+    tag_ = tag;
+  }
+
+  uint64_t tag()
+  {
+    return tag_;
+  }
+
+  /*
+  *@brief 到期时的标签，由 expire() 在队列锁内记录。回调在锁外执行，这期间其他线程可能已经重新设置并加入了定时器
+  *@param uint64_t tag
+  */
+  void set_fired_tag(uint64_t tag)
+  {
+    fired_tag_ = tag;
+  }
+
+  uint64_t fired_tag()
+  {
+    return fired_tag_;
+  }
+
   bool operator<(const Timer& b)
   {
     if(overtime_ < b.overtime_)
@@ -80,21 +139,41 @@ public:
   }
 
   /*
-  *@brief 设置迭代器
-  *@param std::list<Timer*>::iterator iter
+  *@brief 设置定时器在时间轮中的位置
+  *@param int level, int slot
+  */
+  void set_slot(int level, int slot)
+  {
+    level_ = static_cast<uint8_t>(level);
+    slot_ = static_cast<uint8_t>(slot);
+  }
+
+  int level()
+  {
+    return level_;
+  }
+
+  int slot()
+  {
+    return slot_;
+  }
+
+  /*
+  *@brief 设置定时器是否在定时器队列中
+  *@param bool queued
   */
-  void set_iter(std::list<Timer*>::iterator iter)
+  void set_queued(bool queued)
   {
-    iter_ = iter;
+    queued_ = queued;
   }
 
   /*
-  *@brief 获取链表迭代器
-  *@return  std::list<Timer*>::iterator
+  *@brief 定时器是否在定时器队列中
+  *@return  bool queued_
   */
-  std::list<Timer*>::iterator iter()
+  bool queued()
   {
-    return iter_;
+    return queued_;
   }
 
   /*
@@ -109,8 +188,12 @@ public:
 private:
   int fd_;
   callback_func_ overtime_callback_;//超时回调函数对象
-  time_t overtime_;//超时时间
-  std::list<Timer*>::iterator iter_;//list<Timer*> 链表迭代器
+  int64_t overtime_;//超时时间，毫秒
+  uint64_t tag_;//加入队列时的标签
+  uint64_t fired_tag_;//到期时的标签，只由调用 expire() 的线程读写
+  bool queued_;//是否在定时器队列中
+  uint8_t level_;//所在时间轮的层
+  uint8_t slot_;//所在层的槽位
 };
 
 
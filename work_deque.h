@@ -0,0 +1,154 @@
+/**
+ * @file work_deque.h
+ * @author zX
+ * @brief Chase-Lev work-stealing deque
+ * @version 0.1
+ * @date 2019-10-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef WORKDEQUE_H_
+#define WORKDEQUE_H_
+
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/*
+*@brief 工作窃取双端队列（Chase-Lev）。
+*       所属的工作线程在底部 push_work()/pop_work()（后进先出，缓存友好），不需要CAS；
+*       其他线程用 steal_work() 从顶部窃取最早放入的工作，只有与所有者争最后一个元素或窃取者之间竞争时才需要CAS。
+*       存放的是指针，所有权随指针转移。数组满时所有者把容量翻倍，旧数组保留到析构，正在读取旧数组的窃取者不受影响。
+*/
+template <class T>
+class WorkDeque : public boost::noncopyable
+{
+public:
+  explicit WorkDeque(size_t capacity = 256)
+    : top_(0),
+      bottom_(0)
+  {
+    size_t size = 2;
+    while(size < capacity)
+      size <<= 1;
+    array_.store(new Array(size), std::memory_order_relaxed);
+  }
+
+  ~WorkDeque()
+  {
+    delete array_.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < retired_.size(); ++i)
+      delete retired_[i];
+  }
+
+  /*
+  *@brief 在底部放入工作，只能由所属的工作线程调用
+  */
+  void push_work(T *work)
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Array *a = array_.load(std::memory_order_relaxed);
+    if(b - t > static_cast<int64_t>(a->mask))  // 已满，扩容
+      a = grow(a, t, b);
+    a->put(b, work);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /*
+  *@brief 从底部取出最近放入的工作，只能由所属的工作线程调用
+  *@return 为空返回nullptr
+  */
+  T* pop_work()
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array *a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);  // 先让窃取者看到 bottom_ 减小，再读取 top_
+    int64_t t = top_.load(std::memory_order_relaxed);
+    T *work = nullptr;
+    if(t <= b)
+    {
+      work = a->get(b);
+      if(t == b)  // 最后一个元素，与窃取者竞争
+      {
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+          work = nullptr;
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+    }
+    else  // 为空
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    return work;
+  }
+
+  /*
+  *@brief 从顶部窃取最早放入的工作，任何线程都可以调用
+  *@return 为空或与其他线程竞争失败时返回nullptr
+  */
+  T* steal_work()
+  {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if(t >= b)
+      return nullptr;
+    Array *a = array_.load(std::memory_order_acquire);
+    T *work = a->get(t);
+    if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return nullptr;
+    return work;
+  }
+
+  /*
+  *@brief 队列中的工作数（近似值）
+  */
+  int size() const
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<int>(b - t) : 0;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+private:
+  struct Array
+  {
+    explicit Array(size_t size) : mask(size - 1), cells(new std::atomic<T*>[size]) {}
+    ~Array() { delete[] cells; }
+
+    T* get(int64_t i) const { return cells[i & mask].load(std::memory_order_relaxed); }
+    void put(int64_t i, T *work) { cells[i & mask].store(work, std::memory_order_relaxed); }
+
+    size_t mask;
+    std::atomic<T*> *cells;
+  };
+
+  Array* grow(Array *old, int64_t t, int64_t b)
+  {
+    Array *a = new Array((old->mask + 1) * 2);
+    for(int64_t i = t; i < b; ++i)
+      a->put(i, old->get(i));
+    retired_.push_back(old);  // 窃取者可能还在读旧数组
+    array_.store(a, std::memory_order_release);
+    return a;
+  }
+
+  char pad0_[64];
+  std::atomic<int64_t> top_;  // 窃取者竞争的一端
+  char pad1_[64 - sizeof(int64_t)];
+  std::atomic<int64_t> bottom_;  // 只由所有者修改
+  std::atomic<Array*> array_;
+  std::vector<Array*> retired_;
+};
+
+#endif
@@ -1,146 +1,224 @@
 /**
  * @file work_queue.h
  * @author zX
- * @brief Work Queue For Thread Safety
+ * @brief Bounded lock-free MPMC work queue
  * @version 0.1
  * @date 2019-10-24
- * 
+ *
  * @copyright Copyright (c) 2019
- * 
+ *
  */
 
 #ifndef WORKQUEUE_H_
 #define WORKQUEUE_H_
 
-#include <my_mutex.h>
-using namespace my_mutex;
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
 
-/*@brief 工作节点结构*/
-template <class T>
-struct work_node
-{
-  work_node *next;
-  T work;
-};
+static const size_t CACHE_LINE_SIZE = 64;
 
-/*@brief 工作队列类*/
+/*
+*@brief 有界无锁多生产者多消费者工作队列（Vyukov 环形队列）。
+*       每个槽位带一个序号：序号等于位置时可写，等于位置+1时可读。
+*       生产者和消费者分别用CAS推进 enqueue_pos_ / dequeue_pos_ 认领槽位，之后只访问自己的槽位，
+*       入队出队都不需要加锁，也不分配内存。两个位置放在不同的缓存行，避免生产者和消费者互相使缓存行失效。
+*       容量向上取整为2的幂，队列满时 push_work() 返回false。
+*/
 template <class T>
-class WorkQueue
+class WorkQueue : public boost::noncopyable
 {
-private:
-  work_node<T> *head_node;//头节点
-  work_node<T> *cur;//指向当前节点
-  MutexLock mutex;
-  boost::atomic_int queue_size_; // 记录队列的大小。可以更换为int。
-
 public:
-  WorkQueue() : queue_size_(0)
+  explicit WorkQueue(size_t capacity)
   {
-    head_node = new work_node<T>;
-    head_node->next = nullptr;
-    cur = head_node;
+    size_t size = 2;
+    while(size < capacity)
+      size <<= 1;
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for(size_t i = 0; i < size; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
   }
 
   /*
-  *@brief 添加新的工作节点
+  *@brief 添加新的工作
   *@param 模板类T work
+  *@return 队列已满返回false
   */
-  void push_work(T work)
+  bool push_work(T work)
   {
-    MutexLockGuard mlg(mutex);
-    work_node<T> *new_node = new work_node<T>;
-    new_node->work = work;
-    new_node->next = nullptr;
-    cur->next = new_node;
-    cur = new_node;
-    queue_size_++;
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while(true)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if(diff == 0)
+      {
+        if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if(diff < 0)  // 槽位还没有被消费者取走，队列已满
+        return false;
+      else  // 其他生产者已经认领了该位置
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+    cell->work = std::move(work);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
   }
 
   /*
-  *@brief 判断工作队列是否为空
-  *@return 为空返回true；否则，返回fasle
+  *@brief 删除并返回工作队列的队首工作
+  *@return 返回模板类T，队列为空时返回 T()（空指针）
   */
-  bool empty()
+  T pop_work()
   {
-    MutexLockGuard mlg(mutex);
-    if(cur == head_node)
-      return true;
-    else
-      return false;
-    
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while(true)
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if(diff == 0)
+      {
+        if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if(diff < 0)  // 队列为空
+        return T();
+      else
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+    T work = std::move(cell->work);
+    cell->work = T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return work;
   }
 
-  /*void pop_work()
+  /*
+  *@brief 批量添加工作，一次CAS认领连续的多个槽位
+  *@param works 工作数组，已入队的元素被移走
+  *@param count 个数
+  *@return 实际入队的个数，队列满时小于count
+  */
+  size_t push_works(T *works, size_t count)
   {
-    MutexLockGuard mlg(mutex);
-    if(cur == head_node)
-      return;
-    work_node<T> *temp = head_node->next;
-    if(cur == temp)
-      cur = head_node;
-    head_node->next = temp->next;
-    delete temp;
-  }*/
-
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t n;
+    while(true)
+    {
+      n = 0;
+      while(n < count && cells_[(pos + n) & mask_].sequence.load(std::memory_order_acquire) == pos + n)
+        ++n;
+      if(n == 0)
+      {
+        Cell &cell = cells_[pos & mask_];
+        if(static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos) < 0)
+          return 0;  // 队列已满
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if(enqueue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        break;
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+      Cell &cell = cells_[(pos + i) & mask_];
+      cell.work = std::move(works[i]);
+      cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+  }
 
   /*
-  *@brief 删除并返回工作队列的队首节点
-  *@return 返回模板类T work_to_pop
+  *@brief 批量取出工作，一次CAS认领连续的多个槽位
+  *@param works 输出数组
+  *@param count 最多取出的个数
+  *@return 实际取出的个数，队列为空返回0
   */
-  T pop_work()
+  size_t pop_works(T *works, size_t count)
   {
-    MutexLockGuard mlg(mutex);
-    if(cur == head_node)
-      return nullptr;
-    work_node<T> *temp = head_node->next;
-    if(cur == temp)
-      cur = head_node;
-    head_node->next = temp->next;
-    T work_to_pop = temp->work;
-    delete temp;
-    queue_size_--;
-    return work_to_pop;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t n;
+    while(true)
+    {
+      n = 0;
+      while(n < count && cells_[(pos + n) & mask_].sequence.load(std::memory_order_acquire) == pos + n + 1)
+        ++n;
+      if(n == 0)
+      {
+        Cell &cell = cells_[pos & mask_];
+        if(static_cast<intptr_t>(cell.sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos + 1) < 0)
+          return 0;  // 队列为空
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if(dequeue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        break;
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+      Cell &cell = cells_[(pos + i) & mask_];
+      works[i] = std::move(cell.work);
+      cell.work = T();
+      cell.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+    }
+    return n;
   }
 
   /*
-  *@brief 获取队首节点内容
-  *@return 返回模板类T
+  *@brief 判断工作队列是否为空（不加锁，并发修改时是近似值）
+  *@return 为空返回true；否则，返回fasle
   */
-  T top()
+  bool empty() const
   {
-    MutexLockGuard mlg(mutex);
-    return head_node->next->work;
+    return size() == 0;
   }
 
   /*
-  *@brief 获取队列大小
+  *@brief 获取队列大小（近似值）
   *@return 队列大小int size
   */
-  int size()
+  int size() const
   {
-    /*MutexLockGuard mlg(mutex);
-    work_node<T> *pNode = head_node->next;
-    int size = 0;
-    while(pNode!=nullptr)
-    {
-      size++;
-      pNode = pNode->next;
-    }
-    return size;*/
-    int size = static_cast<int>(queue_size_);
-    return size;
+    size_t tail = enqueue_pos_.load(std::memory_order_acquire);
+    size_t head = dequeue_pos_.load(std::memory_order_acquire);
+    intptr_t size = static_cast<intptr_t>(tail - head);
+    return size > 0 ? static_cast<int>(size) : 0;
+  }
+
+  size_t capacity() const
+  {
+    return mask_ + 1;
   }
 
   ~WorkQueue()
   {
-    while(head_node->next!=nullptr)
-    {
-      work_node<T> *delNode = head_node->next;
-      head_node->next = delNode->next;
-      delete delNode;
-    }
-    delete head_node;
   }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T work;
+  };
+
+  char pad0_[CACHE_LINE_SIZE];
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  char pad1_[CACHE_LINE_SIZE - sizeof(size_t) - sizeof(std::unique_ptr<Cell[]>)];
+  std::atomic<size_t> enqueue_pos_;  // 生产者认领的下一个位置
+  char pad2_[CACHE_LINE_SIZE - sizeof(size_t)];
+  std::atomic<size_t> dequeue_pos_;  // 消费者认领的下一个位置
+  char pad3_[CACHE_LINE_SIZE - sizeof(size_t)];
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -9,6 +9,8 @@
  * 
  */
 #include "work_thread.h"
+#include "work_queue.h"
+#include <atomic>
 
 #define LOGGER_WARN
 #include <logger.h>
@@ -18,18 +20,101 @@ namespace http_server
 namespace work_thread
 {
 
+static const int LOCAL_FREE_MAX = 128;  // 每线程空闲链表的上限
+static const int FREE_BATCH = 32;  // 与全局回收队列之间一次转移的个数
+
+/*
+ * 提交工作的是 reactor 线程，释放工作的是工作线程，Work 对象会从工作线程流向 reactor。
+ * 工作线程的空闲链表超过上限时把一批对象放入全局回收队列（无锁环形队列），
+ * 空闲链表为空的线程从回收队列取一批，都取不到时才 new。
+ */
+static __thread Work *local_free = nullptr;
+static __thread int local_free_num = 0;
+static WorkQueue<Work*> free_depot(4096);
+
+static std::atomic<size_t> work_allocs(0);
+static std::atomic<size_t> work_frees(0);
+static std::atomic<size_t> heap_funcs(0);
+
+Work* Work::acquire()
+{
+  if(local_free == nullptr)
+  {
+    Work *works[FREE_BATCH];
+    size_t count = free_depot.pop_works(works, FREE_BATCH);
+    for(size_t i = 0; i < count; ++i)
+    {
+      works[i]->next_free_ = local_free;
+      local_free = works[i];
+    }
+    local_free_num += static_cast<int>(count);
+  }
+  if(local_free == nullptr)
+  {
+    work_allocs.fetch_add(1, std::memory_order_relaxed);
+    return new Work();
+  }
+  Work *work = local_free;
+  local_free = work->next_free_;
+  --local_free_num;
+  work->next_free_ = nullptr;
+  return work;
+}
+
+void Work::destroy_work(Work *work)
+{
+  if(work->destroy_ != nullptr)
+    work->destroy_(work->target(), work->heap_ != nullptr);
+  work->invoke_ = nullptr;
+  work->destroy_ = nullptr;
+  work->heap_ = nullptr;
+
+  work->next_free_ = local_free;
+  local_free = work;
+  if(++local_free_num <= LOCAL_FREE_MAX)
+    return;
+
+  Work *works[FREE_BATCH];
+  for(int i = 0; i < FREE_BATCH; ++i)
+  {
+    works[i] = local_free;
+    local_free = local_free->next_free_;
+  }
+  local_free_num -= FREE_BATCH;
+  size_t pushed = free_depot.push_works(works, FREE_BATCH);
+  for(size_t i = pushed; i < FREE_BATCH; ++i)  // 回收队列已满
+  {
+    delete works[i];
+    work_frees.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 void Work::execute_work()
 {
-  if (work_ == nullptr)
+  if (invoke_ == nullptr)
   {
     WARN("No work to execute !!! ");
   }
   else
   {
-    work_();
+    invoke_(target());
   }
 }
 
+Work::Stats Work::stats()
+{
+  Stats stats;
+  stats.work_allocs = work_allocs.load(std::memory_order_relaxed);
+  stats.work_frees = work_frees.load(std::memory_order_relaxed);
+  stats.heap_funcs = heap_funcs.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Work::count_heap_func()
+{
+  heap_funcs.fetch_add(1, std::memory_order_relaxed);
+}
+
 } // namespace work_thread
 
 } // namespace http_server
\ No newline at end of file
@@ -13,11 +13,17 @@
 
 #include <boost/noncopyable.hpp>//noncopyable类阻止派生类拷贝构造和赋值构造。
 #include <memory>//使用智能指针
+#include <new>
+#include <cstddef>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+#include <utility>
 
 #include <my_thread.h>
 #include <my_mutex.h>
 #include <my_condition.h>
-#include "work_queue.h"
+#include "work_deque.h"
 
 #include <iostream>
 
@@ -33,39 +39,134 @@ namespace work_thread
 {
 
 /**
- *@brief 线程中的工作Work类，包含线程工作的执行函数
- * 
+ *@brief 线程中的工作Work类，包含线程工作的执行函数。
+ *       可调用对象直接构造在内部缓冲区里（超过 INLINE_SIZE 时才在堆上分配），只能移动、没有引用计数，
+ *       以指针的形式在队列间传递所有权。Work 对象本身由 create_work()/destroy_work() 通过每线程空闲链表回收，
+ *       稳定运行时提交工作不分配内存。
  */
-class Work
+class Work : public boost::noncopyable
 {
 public:
   typedef std::function<void ()> work_func;
-  typedef std::shared_ptr<Work> WorkPtr;
+
+  static const size_t INLINE_SIZE = 48;
+
+  /*
+  *@brief 分配统计，只在慢路径上计数
+  */
+  struct Stats
+  {
+    size_t work_allocs;  // new 出来的 Work 对象数
+    size_t work_frees;  // 回收队列满时 delete 的 Work 对象数
+    size_t heap_funcs;  // 可调用对象超过 INLINE_SIZE，在堆上分配的次数
+  };
 
 public:
-  Work(work_func work) : work_(work)
-  { 
+  /*
+  *@brief 创建工作，优先复用本线程空闲链表中的 Work 对象
+  *@param func 可调用对象，移动（或复制）到 Work 内部
+  *@return 指向新工作的指针，用 destroy_work() 释放
+  */
+  template <class F>
+  static Work* create_work(F &&func)
+  {
+    Work *work = acquire();
+    work->set(std::forward<F>(func));
+    return work;
   }
 
-  Work(){}
+  /*
+  *@brief 销毁可调用对象，Work 对象放回本线程的空闲链表
+  */
+  static void destroy_work(Work *work);
 
   /*@brief 执行工作*/
   void execute_work();
 
   /*
-  *@brief 创建工作
-  *@return 返回指向创建的新的工作的指针WorkPtr
+  *@brief 提交时记录的时刻（单调时钟纳秒），用于统计排队时间
   */
-  static WorkPtr create_work(work_func work)
+  void set_enqueue_time(int64_t ns) { enqueue_time_ = ns; }
+
+  int64_t enqueue_time() const { return enqueue_time_; }
+
+  /*
+  *@brief 设置工作所属对象的代数。对象每次状态变化都会改变代数，排队期间代数变了说明工作已经过期（例如连接已超时关闭）
+  *@param owner 所属对象的代数，工作执行前必须保持有效
+  *@param expected 提交时的代数
+  */
+  void set_owner(const std::atomic<uint64_t> *owner, uint64_t expected)
   {
-    return WorkPtr(new Work(work));
+    owner_ = owner;
+    expected_ = expected;
   }
 
-  ~Work(){}
+  /*
+  *@brief 所属对象的代数已经变化，工作不需要再执行
+  */
+  bool stale() const
+  {
+    return owner_ != nullptr && owner_->load(std::memory_order_acquire) != expected_;
+  }
 
+  static Stats stats();
 
 private:
-  work_func work_;
+  typedef void (*invoke_func)(void *func);
+  typedef void (*destroy_func)(void *func, bool heap);
+
+  Work() : invoke_(nullptr), destroy_(nullptr), heap_(nullptr), next_free_(nullptr), enqueue_time_(0), owner_(nullptr), expected_(0) {}
+
+  ~Work(){}
+
+  static Work* acquire();
+
+  template <class F>
+  void set(F &&func)
+  {
+    typedef typename std::decay<F>::type Func;
+    if(sizeof(Func) <= INLINE_SIZE && alignof(Func) <= alignof(std::max_align_t))
+    {
+      new (&storage_) Func(std::forward<F>(func));
+      heap_ = nullptr;
+    }
+    else
+    {
+      heap_ = new Func(std::forward<F>(func));
+      count_heap_func();
+    }
+    invoke_ = &invoke<Func>;
+    destroy_ = &destroy<Func>;
+    owner_ = nullptr;
+  }
+
+  template <class Func>
+  static void invoke(void *func)
+  {
+    (*static_cast<Func*>(func))();
+  }
+
+  template <class Func>
+  static void destroy(void *func, bool heap)
+  {
+    if(heap)
+      delete static_cast<Func*>(func);
+    else
+      static_cast<Func*>(func)->~Func();
+  }
+
+  void* target() { return heap_ != nullptr ? heap_ : static_cast<void*>(&storage_); }
+
+  static void count_heap_func();
+
+  invoke_func invoke_;
+  destroy_func destroy_;
+  void *heap_;  // 可调用对象放不进内部缓冲区时指向堆上的对象
+  Work *next_free_;  // 空闲链表
+  int64_t enqueue_time_;
+  const std::atomic<uint64_t> *owner_;  // 所属对象的代数，nullptr 表示工作不会过期
+  uint64_t expected_;
+  typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type storage_;
 
 };
 
@@ -78,97 +179,94 @@ class WorkThread : public boost::noncopyable
 public:
   typedef std::shared_ptr<WorkThread> WorkThreadPtr;
   typedef std::function<void (void*)> ThreadFunc;
-  thread_state state_;
+  std::atomic<thread_state> state_;
+  std::atomic<int64_t> task_start_;  // 正在执行的工作开始的时刻（单调时钟纳秒），空闲时为0
 
 public:
   WorkThread(ThreadFunc func) 
-  : thread_func_(func),
-    mutex_(),
-    pcond_(mutex_),
-    thread_(new my_thread::Thread(thread_func_, this))
+  : state_(QUIT),
+    task_start_(0),
+    thread_func_(func)
   {
   }
 
   ~WorkThread() {}
 
-  /*@brief 工作线程初始化*/
+  /*@brief 在这个槽位上启动一个新的线程。线程池收缩后槽位可以重新使用*/
   void start()
   {
+    thread_.reset(new my_thread::Thread(thread_func_, this));
     thread_->start();
-    thread_id_ = thread_->thread_id();
   }
 
-  /*
-  *@brief 获取工作线程ID
-  *@return 工作线程ID pthread_t thread_id_
-  * */
-  pthread_t work_thread_id()
+  /*@brief 等待线程退出并释放，之后槽位可以重新 start()*/
+  void join()
   {
-    return thread_id_;
+    if(thread_)
+    {
+      thread_->join();
+      thread_.reset();
+    }
   }
 
   /*
-  *@brief 获取互斥锁
-  *@return  互斥锁MutexLock& mutex_
+  *@brief 槽位上是否有线程（运行中或已退出但还没有 join）
   */
-  MutexLock& get_mutex()
+  bool started() const
   {
-    return mutex_;
+    return thread_ != nullptr;
   }
 
-  /*
-  *@brief 获取工作条件
-  *@return 工作条件Condition& pcond_
-  */
-  Condition& get_condition()
-  {
-    return pcond_;
-  }
+  inline void add_work(Work *new_work);
 
-  inline void add_work(Work::WorkPtr new_work);
+  inline Work* pop_work();
 
-  inline Work::WorkPtr pop_work();
+  inline Work* steal_work();
 
-  inline bool work_empty();
+  inline int work_size();
 
 private:
   ThreadFunc thread_func_;
-  MutexLock mutex_;
-  Condition pcond_;
   
   std::shared_ptr<my_thread::Thread> thread_; 
-  pthread_t thread_id_;
 
-  WorkQueue<Work::WorkPtr> work_queue_;//工作队列
+  WorkDeque<Work> work_deque_;//工作窃取队列，本线程在底部存取，其他线程从顶部窃取
 
 };
 
 /*
-*@brief 添加新的工作至工作线程的工作队列
-*@param 新的工作内容Work::WorkPtr new_work
+*@brief 添加新的工作至工作线程的工作队列，只能由本工作线程调用
+*@param 新的工作Work* new_work，所有权转移给队列
+*/
+inline void WorkThread::add_work(Work *new_work)
+{
+  work_deque_.push_work(new_work);
+}
+
+/*
+*@brief 取出本线程最近加入的工作，只能由本工作线程调用
+*@return 队列为空返回nullptr
 */
-inline void WorkThread::add_work(Work::WorkPtr new_work)
+inline Work* WorkThread::pop_work()
 {
-  work_queue_.push_work(new_work);
+  return work_deque_.pop_work();
 }
 
 /*
-*@brief 删除工作线程的工作队列队首的已有工作
-*@return 返回指向工作队列队首的指针Work::WorkPtr
+*@brief 其他工作线程从队列顶部窃取最早加入的工作
+*@return 队列为空或竞争失败返回nullptr
 */
-inline Work::WorkPtr WorkThread::pop_work()
+inline Work* WorkThread::steal_work()
 {
-  Work::WorkPtr tmp = work_queue_.pop_work();
-  return tmp;
+  return work_deque_.steal_work();
 }
 
 /*
-*@brief 判断工作线程的工作队列是否为空
-*@return 为空返回true；否则，返回false
+*@brief 获取工作队列中的工作数（近似值）
 */
-inline bool WorkThread::work_empty()
+inline int WorkThread::work_size()
 {
-  return work_queue_.empty();
+  return work_deque_.size();
 }
 
 } // namespace work_thread